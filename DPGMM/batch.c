@@ -0,0 +1,35 @@
+#include "src/batch/batch.h" // batch_load, batch_run, batch_export, batch_destroy
+#include "src/threadpool/threadpool.h" // threadpool_create, threadpool_destroy
+#include <stdio.h> // printf, fprintf
+#include <time.h> // time, clock_gettime
+
+#define THREADS 4 // Number of models sampled at once
+#define BURNIN 100 // Sweeps discarded from every model
+#define SAMPLES 1000 // Sweeps summarised for every model
+#define ALPHA 1.0 // Initial concentration parameter
+#define KAPPA 0.0001 // Prior precision scale factor
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s manifest\n", argv[0]);
+		return 1;
+	}
+
+	// Model i uses stream i of the system time
+	Batch *batch = batch_load(argv[1], (uint32_t)time(NULL));
+	printf("Sampling %d models on %d threads.\n", batch->num_models, THREADS);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ThreadPool *pool = threadpool_create(THREADS);
+	batch_run(batch, pool, BURNIN, SAMPLES, ALPHA, KAPPA);
+	threadpool_destroy(pool);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + 1e-9*(end.tv_nsec - start.tv_nsec);
+	printf("Sampling complete in %.3f s (%.3f ms per model).\n", seconds, 1e3*seconds/batch->num_models);
+
+	batch_export(batch, "output/batch_summary.txt", "output/batch_assignments.txt");
+	batch_destroy(batch);
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "src/crp.h" // crp_init, crp_destroy, update_table_assignments, update_alpha, LIST_ENUMERATE
+#include "src/fastmath/fastmath.h" // fast_exp, fast_log, fast_log1p, fast_lgamma
+#include "src/random/random.h" // seed_rng, randu
+#include "src/utils/utils.h" // import_data
+#include <Accelerate/Accelerate.h> // cblas_daxpy, cblas_dtpsv, cblas_ddot
+#include <math.h> // exp, log, log1p, lgamma, nextafter, fabs, M_PI
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy
+#include <time.h> // clock_gettime
+
+/*
+ * Compares the approximations in src/fastmath/ with libm. The first part times each
+ * kernel over an array of arguments in the range the sampler uses and reports the
+ * largest difference from libm in ulps of max(|f(x)|, 1). Below 1 this is an absolute
+ * error, which is what matters for the log probabilities and near the roots of lgamma.
+ * The second part runs the collapsed sampler on the data and then scores every
+ * customer against the tables with either set of kernels, reporting the time taken
+ * and the total variation distance between the draw probabilities.
+ */
+
+#define SEED 1 // Seed of the random number generator
+#define LENGTH 1048576 // Number of arguments per kernel
+#define REPEATS 20 // Number of passes over the arguments
+#define SWEEPS 1000 // Sweeps of the sampler before the tables are scored
+#define SCORE_PASSES 100 // Passes over the customers when scoring
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Times a loop over the arguments with the kernel inlined. Sets NS to the nanoseconds per call. */
+#define TIME_KERNEL(NS, KERNEL, X, Y) do {\
+	double start = now();\
+	for(int r=0; r<REPEATS; r++) {\
+		for(int i=0; i<LENGTH; i++) {\
+			Y[i] = KERNEL(X[i]);\
+		}\
+	}\
+	NS = 1e9*(now() - start)/((double)REPEATS*LENGTH);\
+} while(0)
+
+
+
+/* Prints the timings of the libm and fast versions of a kernel and the largest difference in their results */
+static void report_kernel(const char *name, const double *y, const double *y_ref, const double libm_ns, const double fast_ns)
+{
+	double max_ulp = 0;
+	for(int i=0; i<LENGTH; i++) {
+		double scale = fabs(y_ref[i]) > 1 ? fabs(y_ref[i]) : 1;
+		double ulp = nextafter(scale, INFINITY) - scale;
+		double err = fabs(y[i] - y_ref[i])/ulp;
+		if(err > max_ulp) {
+			max_ulp = err;
+		}
+	}
+	printf("%-8s %8.2f ns %8.2f ns %8.2fx %10.1f\n", name, libm_ns, fast_ns, libm_ns/fast_ns, max_ulp);
+}
+
+
+
+/* Squared norm of L⁻¹(x-ξ) for the table */
+static double quadratic_form(const Table *table, const double *customer)
+{
+	const int D = table->D;
+	double z[D];
+	memcpy(z, customer, D*sizeof(double));
+	cblas_daxpy(D, -1.0, table->xi, 1, z, 1);
+	cblas_dtpsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, D, table->psi, z, 1);
+	return cblas_ddot(D, z, 1, z, 1);
+}
+
+
+
+/*
+ * Defines NAME_draw_probabilities, which computes the draw probabilities of a customer in
+ * the same way as crp_log_predictive, with the given kernels inlined
+ */
+#define DEFINE_SCORING(NAME, EXP, LOG, LOG1P, LGAMMA)\
+static void NAME##_draw_probabilities(ChineseRestaurant *cr, const double *customer, double *p)\
+{\
+	const double D = cr->D;\
+	int k = List_count(cr->occupied_tables);\
+	double weight[k+1], half_nu[k+1], shrink[k+1], logdetpsi[k+1];\
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {\
+		weight[i] = table_i->size;\
+		half_nu[i] = 0.5*(table_i->nu + 1);\
+		shrink[i] = table_i->kappa/(table_i->kappa + 1);\
+		logdetpsi[i] = table_i->logdetpsi;\
+		p[i] = quadratic_form(table_i, customer);\
+	}\
+	weight[k] = cr->alpha;\
+	half_nu[k] = 0.5*(cr->table_prior.nu + 1);\
+	shrink[k] = cr->table_prior.kappa/(cr->table_prior.kappa + 1);\
+	logdetpsi[k] = cr->table_prior.logdetpsi;\
+	p[k] = quadratic_form(&cr->table_prior, customer);\
+	for(i=0; i<k+1; i++) {\
+		p[i] = LOG(weight[i]) + LGAMMA(half_nu[i]) - LGAMMA(half_nu[i] - 0.5*D)\
+			+ 0.5*D*LOG(M_PI*shrink[i]) - half_nu[i]*LOG1P(p[i]*shrink[i]) - logdetpsi[i];\
+	}\
+	double maxlogp = p[k];\
+	for(i=0; i<k; i++) {\
+		if(p[i] > maxlogp) {\
+			maxlogp = p[i];\
+		}\
+	}\
+	for(i=0; i<k+1; i++) {\
+		p[i] = EXP(p[i] - maxlogp);\
+	}\
+	double Z = 0;\
+	for(i=0; i<k+1; i++) {\
+		Z += p[i];\
+	}\
+	for(i=0; i<k+1; i++) {\
+		p[i] /= Z;\
+	}\
+}
+
+DEFINE_SCORING(libm, exp, log, log1p, lgamma)
+DEFINE_SCORING(fast, fast_exp, fast_log, fast_log1p, fast_lgamma)
+
+
+
+/* Scores every customer SCORE_PASSES times. Sets NS to the nanoseconds per customer. */
+#define TIME_SCORING(NS, DRAW_PROBABILITIES, CR, P) do {\
+	double start = now();\
+	for(int r=0; r<SCORE_PASSES; r++) {\
+		for(int c=0; c<CR->N; c++) {\
+			DRAW_PROBABILITIES(CR, CR->customers[c], P);\
+		}\
+	}\
+	NS = 1e9*(now() - start)/((double)SCORE_PASSES*CR->N);\
+} while(0)
+
+
+
+/* Times the scoring of every customer with both sets of kernels and compares the draw probabilities */
+static void compare_scoring(ChineseRestaurant *cr)
+{
+	const int N = cr->N;
+	int k = List_count(cr->occupied_tables);
+#ifdef CRP_LAZY_CHOLESKY
+	LIST_ENUMERATE(cr->occupied_tables, j, node_j, table_j) {
+		refresh_table(cr, table_j);
+	}
+#endif
+	double p[k+1], p_ref[k+1];
+	double libm_ns, fast_ns, crp_ns;
+	TIME_SCORING(libm_ns, libm_draw_probabilities, cr, p_ref);
+	TIME_SCORING(fast_ns, fast_draw_probabilities, cr, p);
+	TIME_SCORING(crp_ns, crp_log_predictive, cr, p);
+	double mean_tv = 0, max_tv = 0;
+	for(int c=0; c<N; c++) {
+		libm_draw_probabilities(cr, cr->customers[c], p_ref);
+		fast_draw_probabilities(cr, cr->customers[c], p);
+		double tv = 0;
+		for(int i=0; i<k+1; i++) {
+			tv += 0.5*fabs(p[i] - p_ref[i]);
+		}
+		mean_tv += tv/N;
+		if(tv > max_tv) {
+			max_tv = tv;
+		}
+	}
+	printf("%5d %10.1f ns %10.1f ns %8.2fx %10.1f ns %12.3g %12.3g\n", k, libm_ns, fast_ns, libm_ns/fast_ns, crp_ns, mean_tv, max_tv);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	const int N = 272; // Number of data points
+	const int D = 2; // Dimensionality of data
+
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s data\n", argv[0]);
+		exit(1);
+	}
+	Rng rng;
+	seed_rng(&rng, SEED);
+
+	// Kernels over the arguments they see in the sampler
+	double *x = malloc(LENGTH*sizeof(double));
+	double *y = malloc(LENGTH*sizeof(double));
+	double *y_ref = malloc(LENGTH*sizeof(double));
+	double libm_ns, fast_ns;
+	printf("kernel       libm     fast  speedup  max ulp\n");
+	for(int i=0; i<LENGTH; i++) {
+		x[i] = -50*randu(&rng); // logp - maxlogp
+	}
+	TIME_KERNEL(libm_ns, exp, x, y_ref);
+	TIME_KERNEL(fast_ns, fast_exp, x, y);
+	report_kernel("exp", y, y_ref, libm_ns, fast_ns);
+	for(int i=0; i<LENGTH; i++) {
+		x[i] = exp(20*randu(&rng)); // Table sizes and normalising constants
+	}
+	TIME_KERNEL(libm_ns, log, x, y_ref);
+	TIME_KERNEL(fast_ns, fast_log, x, y);
+	report_kernel("log", y, y_ref, libm_ns, fast_ns);
+	for(int i=0; i<LENGTH; i++) {
+		x[i] = exp(10*randu(&rng) - 8); // Scaled Mahalanobis distances
+	}
+	TIME_KERNEL(libm_ns, log1p, x, y_ref);
+	TIME_KERNEL(fast_ns, fast_log1p, x, y);
+	report_kernel("log1p", y, y_ref, libm_ns, fast_ns);
+	for(int i=0; i<LENGTH; i++) {
+		x[i] = 0.5 + exp(10*randu(&rng)); // Half the degrees of freedom
+	}
+	TIME_KERNEL(libm_ns, lgamma, x, y_ref);
+	TIME_KERNEL(fast_ns, fast_lgamma, x, y);
+	report_kernel("lgamma", y, y_ref, libm_ns, fast_ns);
+	free(x);
+	free(y);
+	free(y_ref);
+
+	// Sweeps of the sampler as built
+	double xi[] = {0.,0.};
+	double psi[] = {1., 0.,1.};
+	double *data = malloc(N*D*sizeof(double));
+	import_data(argv[1], N, D, data);
+	ChineseRestaurant *cr = crp_init(data, N, D, &rng, 1.0, xi, 0.0001, 2., psi);
+	double start = now();
+	for(int i=0; i<SWEEPS; i++) {
+		update_table_assignments(cr);
+		update_alpha(cr);
+	}
+#ifdef CRP_FAST_MATH
+	printf("\n%d sweeps with -DCRP_FAST_MATH: %.3f s\n", SWEEPS, now() - start);
+#else
+	printf("\n%d sweeps with libm: %.3f s\n", SWEEPS, now() - start);
+#endif
+
+	// Draw probabilities for the tables of the last sample, and for a restaurant where every customer sits alone
+	printf("\ntables  libm/customer  fast/customer  speedup  crp_log_predictive  mean TV  max TV\n");
+	compare_scoring(cr);
+	crp_destroy(cr);
+	cr = crp_init(data, N, D, &rng, 1.0, xi, 0.0001, 2., psi);
+	for(int c=0; c<N; c++) {
+		seat_customer_at(cr, c, NULL);
+	}
+	compare_scoring(cr);
+	crp_destroy(cr);
+	free(data);
+	return 0;
+}
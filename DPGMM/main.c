@@ -1,21 +1,24 @@
-#include "src/crp.h" // crp_init, update_table_assignments, update_alpha, LIST_ENUMERATE
+#include "src/crp.h" // crp_init, crp_destroy, update_table_assignments, update_alpha, export_assignments, LIST_ENUMERATE
 #include "src/random/random.h" // initialise_rngs
-#include "src/utils/utils.h" // export_data
+#include "src/utils/utils.h" // import_data, export_data
+#include "src/auxiliary/auxiliary.h" // auxiliary_init, auxiliary_sweep
+#include "src/frozen/frozen.h" // frozen_create, frozen_add_draw, frozen_save
 #include <stdio.h> // printf
+#include <stdlib.h> // malloc, free
 
 #define BURNIN  0 // Burn-in
 #define SAMPLES 10000 // Number of posterior samples to draw
-
-/************************** Global variables **********************************/
-const int N = 272; // Number of data points
-const int D = 2; // Dimensionality of data.
-extern double **customers; // NxD array of data. Defined in crp_init() of crp.c.
-/******************************************************************************/
+#define AUXILIARY_TABLES 0 // Number of auxiliary tables for Neal's algorithm 8. Zero uses the collapsed sampler.
+#define FREEZE_INTERVAL 100 // Number of samples between the posterior draws kept for scoring new points
 
 int main(int argc, char *argv[])
 {
+	const int N = 272; // Number of data points
+	const int D = 2; // Dimensionality of data.
+
 	// Seeds rng with system time
-	initialise_rngs();
+	Rng rng;
+	initialise_rngs(&rng);
 
 	// Component hyperparameters
 	double xi[] = {0.,0.};
@@ -26,35 +29,50 @@ int main(int argc, char *argv[])
 	// Concentration parameter
 	double alpha = 1.0;
 
+	// Import data
+	double *data = malloc(N*D*sizeof(double));
+	import_data(argv[1], N, D, data);
+
 	// Initialise CRP
-	ChineseRestaurant *cr = crp_init(argv[1], alpha, xi, kappa, nu, psi);
+	ChineseRestaurant *cr = crp_init(data, N, D, &rng, alpha, xi, kappa, nu, psi);
+	free(data);
+	AuxiliarySampler *as = AUXILIARY_TABLES > 0 ? auxiliary_init(cr, AUXILIARY_TABLES) : NULL;
+	FrozenPosterior *posterior = frozen_create(D);
 
 	// Perform burn-in
 	printf("Performing burn-in.\n");
 	for(int i=0; i<BURNIN; i++) {
-		update_table_assignments(cr);
+		as != NULL ? auxiliary_sweep(as) : update_table_assignments(cr);
 		update_alpha(cr);
 	}
 	
 	// Sample posterior
 	printf("Burn-in complete. Sampling will now begin.\n");
 	for(int i=0; i<SAMPLES; i++) {
-		update_table_assignments(cr);
+		as != NULL ? auxiliary_sweep(as) : update_table_assignments(cr);
 		update_alpha(cr);
 		//Export samples to file
 		export_data(INT, &(cr->occupied_tables->count), 1, "output/occupied_tables.txt");
 		export_data(DOUBLE, &(cr->alpha), 1,"output/alpha.txt");
 
 		LIST_ENUMERATE(cr->occupied_tables, j, node_j, table_j){
+			refresh_table(cr, table_j); // The lazy Cholesky path leaves ξ and Ψ stale until refreshed
 			export_data(DOUBLE, table_j->xi, D, "output/xi.txt");
 			export_data(DOUBLE, table_j->psi, D*(D+1)/2, "output/psi.txt");
 			export_data(DOUBLE, &(table_j->nu), 1, "output/nu.txt");
 			export_data(DOUBLE, &(table_j->kappa), 1, "output/kappa.txt");
 			export_data(INT, &(table_j->size), 1, "output/table_sizes.txt");
 		}
-		
+		if((i+1) % FREEZE_INTERVAL == 0) {
+			frozen_add_draw(posterior, cr);
+		}
 	}
 	printf("Sampling complete.\n");
+	// Freeze the thinned draws for the score program
+	frozen_save(posterior, "output/posterior.bin");
+	frozen_destroy(posterior);
+	// Export the final table assignments
+	export_assignments(cr, "output/assignments.txt");
 	
 	// Create contour plot of predictive posterior distribution
 	printf("Evaluating posterior predictive distribution on meshgrid.\n");
@@ -68,6 +86,15 @@ int main(int argc, char *argv[])
 	// Evaluate predictive posterior on mesh grid
 	posterior_predictive_surface(cr, nx, xgrid, ny, ygrid);
 
+#ifdef CRP_VALIDATE_FLOAT
+	report_float_divergence(cr);
+#endif
+
+	if(as != NULL) {
+		auxiliary_destroy(as);
+	}
+	crp_destroy(cr);
+
 	printf("Complete.\n");
 	return 0;
 }
\ No newline at end of file
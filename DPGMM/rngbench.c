@@ -0,0 +1,99 @@
+#include "src/random/random.h" // seed_rng_stream, rng_name, randu, fill_randu, randn, philox_fill_randu
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free
+#include <time.h> // clock_gettime
+
+/*
+ * Compares the uniform generators of src/random/. For each backend it times filling
+ * an array with fill_randu, single randu and randn calls, and prints the mean and
+ * variance of the uniforms as a sanity check (1/2 and 1/12). It then times Philox
+ * variates drawn without a generator by philox_fill_randu, and checks that they are
+ * the ones the generator gives.
+ */
+
+#define SEED 1 // Seed of every generator
+#define LENGTH 1048576 // Number of variates per pass
+#define REPEATS 50 // Number of passes
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Times one backend and prints a line of the table */
+static void bench_backend(const RngBackend backend, double *x)
+{
+	Rng rng;
+	seed_rng_stream(&rng, backend, SEED, 0);
+
+	double start = now();
+	for(int r=0; r<REPEATS; r++) {
+		fill_randu(&rng, x, LENGTH);
+	}
+	double fill_ns = 1e9*(now() - start)/((double)REPEATS*LENGTH);
+	double mean = 0, var = 0;
+	for(int i=0; i<LENGTH; i++) {
+		mean += x[i];
+	}
+	mean /= LENGTH;
+	for(int i=0; i<LENGTH; i++) {
+		var += (x[i] - mean)*(x[i] - mean);
+	}
+	var /= LENGTH - 1;
+
+	start = now();
+	for(int r=0; r<REPEATS; r++) {
+		for(int i=0; i<LENGTH; i++) {
+			x[i] = randu(&rng);
+		}
+	}
+	double randu_ns = 1e9*(now() - start)/((double)REPEATS*LENGTH);
+
+	start = now();
+	for(int r=0; r<REPEATS; r++) {
+		for(int i=0; i<LENGTH; i++) {
+			x[i] = randn(&rng);
+		}
+	}
+	double randn_ns = 1e9*(now() - start)/((double)REPEATS*LENGTH);
+
+	printf("%-14s %8.2f ns %8.2f ns %8.2f ns %10.6f %10.6f\n", rng_name(backend), fill_ns, randu_ns, randn_ns, mean, 12*var);
+}
+
+
+
+int main(void)
+{
+	double *x = malloc(LENGTH*sizeof(double));
+	double *y = malloc(LENGTH*sizeof(double));
+	printf("%d lanes, %d word buffer\n", RNG_LANES, RNG_BUFFER_SIZE);
+	printf("generator      fill_randu     randu     randn       mean   12*var\n");
+	bench_backend(RNG_DSFMT, x);
+	bench_backend(RNG_XOSHIRO, x);
+	bench_backend(RNG_PHILOX, x);
+
+	// Each pass draws its own part of one stream, as a thread given that part would
+	double start = now();
+	for(int r=0; r<REPEATS; r++) {
+		philox_fill_randu(SEED, 0, (uint64_t)r*LENGTH, x, LENGTH);
+	}
+	printf("\nphilox_fill_randu without a generator: %.2f ns\n", 1e9*(now() - start)/((double)REPEATS*LENGTH));
+	Rng rng;
+	seed_rng_stream(&rng, RNG_PHILOX, SEED, 0);
+	for(int r=0; r<REPEATS; r++) {
+		fill_randu(&rng, y, LENGTH);
+	}
+	int mismatches = 0;
+	for(int i=0; i<LENGTH; i++) {
+		mismatches += x[i] != y[i];
+	}
+	printf("Mismatches with the last pass of the generator: %d\n", mismatches);
+	free(x);
+	free(y);
+	return 0;
+}
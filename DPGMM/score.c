@@ -0,0 +1,77 @@
+#include "src/frozen/frozen.h" // frozen_load, frozen_log_predictive, frozen_membership
+#include "src/threadpool/threadpool.h" // threadpool_create
+#include <stdio.h> // printf, fprintf, fopen, fscanf, fclose
+#include <stdlib.h> // malloc
+#include <string.h> // strcmp
+
+#define THREADS 4 // Threads used to score the points
+#define CHUNK 65536 // Number of points read and scored at a time
+
+/*
+ * Scores points with a frozen posterior written by the sampler.
+ *     ./score [-m] output/posterior.bin [points]
+ * Prints the log posterior predictive density of each point. With -m, the membership
+ * probabilities under the last posterior draw follow on the same line. Points are read
+ * from stdin unless a file is given.
+ */
+int main(int argc, char *argv[])
+{
+	int membership = 0;
+	int arg = 1;
+	if(arg < argc && strcmp(argv[arg], "-m") == 0) {
+		membership = 1;
+		arg++;
+	}
+	if(arg >= argc) {
+		fprintf(stderr, "Usage: %s [-m] model [points]\n", argv[0]);
+		return 1;
+	}
+	FrozenPosterior *fp = frozen_load(argv[arg++]);
+	const int D = fp->D;
+	const long draw = fp->num_draws - 1;
+	const long K = frozen_draw_size(fp, draw);
+
+	FILE *stream = stdin;
+	if(arg < argc && strcmp(argv[arg], "-") != 0) {
+		stream = fopen(argv[arg], "r");
+		if(stream == NULL) {
+			fprintf(stderr, "Could not open %s.\n", argv[arg]);
+			return 1;
+		}
+	}
+
+	ThreadPool *pool = threadpool_create(THREADS);
+	double *X = malloc(CHUNK*D*sizeof(double));
+	double *logp = malloc(CHUNK*sizeof(double));
+	double *probs = membership ? malloc(CHUNK*K*sizeof(double)) : NULL;
+	long n;
+	do {
+		// Read up to CHUNK points
+		for(n=0; n<CHUNK; n++) {
+			int j;
+			for(j=0; j<D && fscanf(stream, "%lf%*[, \t\n]", &X[n*D+j]) == 1; j++);
+			if(j < D) {
+				break;
+			}
+		}
+
+		frozen_log_predictive(fp, pool, X, n, logp);
+		if(membership) {
+			frozen_membership(fp, pool, draw, X, n, probs);
+		}
+		for(long i=0; i<n; i++) {
+			printf("%f", logp[i]);
+			for(long k=0; membership && k<K; k++) {
+				printf("\t%f", probs[i*K+k]);
+			}
+			printf("\n");
+		}
+	} while(n == CHUNK);
+
+	if(stream != stdin) {
+		fclose(stream);
+	}
+	threadpool_destroy(pool);
+	frozen_destroy(fp);
+	return 0;
+}
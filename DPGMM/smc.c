@@ -0,0 +1,93 @@
+#include "src/smc/smc.h" // smc_init, smc_observe, smc_map_particle, smc_mean_tables
+#include "src/random/random.h" // initialise_rngs
+#include "src/utils/utils.h" // export_data
+#include "src/crp.h" // linspace, posterior_predictive_surface, LIST_ENUMERATE
+#include <stdio.h> // printf, fprintf, fopen, fscanf, fclose
+#include <string.h> // strcmp
+
+#define PARTICLES 1000 // Number of particles
+#define THREADS 4 // Threads used to score the particles
+#define ESS_FRACTION 0.5 // Resample when the effective sample size falls below this fraction of the particles
+#define EXPORT_INTERVAL 10 // Number of points between exports of the filter diagnostics
+
+/* Reads the next D dimensional point from the stream. Returns 0 at the end of the stream. */
+static int read_point(FILE *stream, const int D, double *x)
+{
+	for(int j=0; j<D; j++) {
+		if(fscanf(stream, "%lf%*[, \t\n]", &x[j]) != 1) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const int D = 2; // Dimensionality of data.
+
+	// Seeds rng with system time
+	Rng rng;
+	initialise_rngs(&rng);
+
+	// Component hyperparameters
+	double xi[] = {0.,0.};
+	double psi[] = {1., 0.,1.};
+	double kappa = 0.0001;
+	double nu = 2.;
+
+	// Concentration parameter
+	double alpha = 1.0;
+
+	// Points arrive on stdin unless a file or named pipe is given
+	FILE *stream = stdin;
+	if(argc > 1 && strcmp(argv[1], "-") != 0) {
+		stream = fopen(argv[1], "r");
+		if(stream == NULL) {
+			fprintf(stderr, "Could not open %s.\n", argv[1]);
+			return 1;
+		}
+	}
+
+	SMC *smc = smc_init(D, &rng, PARTICLES, THREADS, ESS_FRACTION, alpha, xi, kappa, nu, psi);
+	double x[D];
+	printf("Filtering points.\n");
+	while(read_point(stream, D, x)) {
+		smc_observe(smc, x);
+		if(smc->n % EXPORT_INTERVAL == 0) {
+			double mean_tables = smc_mean_tables(smc);
+			export_data(DOUBLE, &mean_tables, 1, "output/smc_tables.txt");
+			export_data(DOUBLE, &smc->ess, 1, "output/smc_ess.txt");
+			export_data(DOUBLE, &smc->log_evidence, 1, "output/smc_evidence.txt");
+		}
+	}
+	if(stream != stdin) {
+		fclose(stream);
+	}
+	printf("Filtered %ld points with %d resampling steps. Log evidence = %f\n", smc->n, smc->resamples, smc->log_evidence);
+
+	// Export the tables of the most probable particle in the same format as the Gibbs sampler
+	ChineseRestaurant *cr = smc_map_particle(smc);
+	export_data(INT, &(cr->occupied_tables->count), 1, "output/occupied_tables.txt");
+	LIST_ENUMERATE(cr->occupied_tables, j, node_j, table_j){
+		refresh_table(cr, table_j); // The lazy Cholesky path leaves ξ and Ψ stale until refreshed
+		export_data(DOUBLE, table_j->xi, D, "output/xi.txt");
+		export_data(DOUBLE, table_j->psi, D*(D+1)/2, "output/psi.txt");
+		export_data(DOUBLE, &(table_j->nu), 1, "output/nu.txt");
+		export_data(DOUBLE, &(table_j->kappa), 1, "output/kappa.txt");
+		export_data(INT, &(table_j->size), 1, "output/table_sizes.txt");
+	}
+
+	// Create contour plot of predictive posterior distribution
+	printf("Evaluating posterior predictive distribution on meshgrid.\n");
+	int nx = 500;
+	int ny = 500;
+	double xgrid[nx];	
+	double ygrid[ny];
+	linspace(0,7, nx, xgrid);
+	linspace(40, 100, ny, ygrid);
+	posterior_predictive_surface(cr, nx, xgrid, ny, ygrid);
+
+	smc_destroy(smc);
+	printf("Complete.\n");
+	return 0;
+}
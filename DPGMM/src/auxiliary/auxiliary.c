@@ -0,0 +1,206 @@
+#include "auxiliary.h"
+#include <Accelerate/Accelerate.h> // cblas_dtpsv, cblas_dtpmv, cblas_dspr, cblas_ddot
+#include <math.h> // log, exp, sqrt, M_PI, INFINITY
+#include <stdlib.h> // calloc, realloc
+#include <string.h> // memcpy, memset
+#include "../random/random.h" // randu, randn, rand_gamma
+
+
+
+/* Allocates the mean and precision factor of a D dimensional component */
+static void component_alloc(Component *component, const int D)
+{
+	component->D = D;
+	component->mu = calloc(D, sizeof(double));
+	component->R = calloc(D*(D+1)/2, sizeof(double));
+}
+
+
+
+/* Exchanges two components without copying their contents */
+static void swap_components(Component *a, Component *b)
+{
+	Component tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+
+
+/* Makes sure there is a component for every table id below num_tables */
+static void reserve_components(AuxiliarySampler *as, const unsigned int num_tables)
+{
+	if(num_tables <= as->capacity) {
+		return;
+	}
+	unsigned int capacity = as->capacity > 0 ? as->capacity : 16;
+	while(capacity < num_tables) {
+		capacity *= 2;
+	}
+	as->components = realloc(as->components, capacity*sizeof(Component));
+	for(unsigned int i=as->capacity; i<capacity; i++) {
+		component_alloc(&as->components[i], as->cr->D);
+	}
+	as->capacity = capacity;
+}
+
+
+
+/* Creates an auxiliary table sampler for the restaurant with m auxiliary tables */
+AuxiliarySampler *auxiliary_init(ChineseRestaurant *cr, const int m)
+{
+	AuxiliarySampler *as = calloc(1, sizeof(AuxiliarySampler));
+	as->cr = cr;
+	as->m = m;
+	as->aux = calloc(m, sizeof(Component));
+	for(int j=0; j<m; j++) {
+		component_alloc(&as->aux[j], cr->D);
+	}
+	reserve_components(as, cr->num_tables);
+	return as;
+}
+
+
+
+/* Frees the sampler. The restaurant is left untouched. */
+void auxiliary_destroy(AuxiliarySampler *as)
+{
+	for(int j=0; j<as->m; j++) {
+		free(as->aux[j].mu);
+		free(as->aux[j].R);
+	}
+	for(unsigned int i=0; i<as->capacity; i++) {
+		free(as->components[i].mu);
+		free(as->components[i].R);
+	}
+	free(as->aux);
+	free(as->components);
+	free(as);
+}
+
+
+
+/* Draws a Gaussian component from the NIW distribution with the table's hyperparameters */
+void draw_component(Rng *rng, const Table *table, Component *component)
+{
+	const int D = table->D;
+	// Bartlett decomposition: with A lower triangular, Aᵢᵢ² ~ χ²(ν-i) and Aᵢⱼ ~ N(0,1) below the diagonal,
+	// the precision BB' with B = U⁻¹A is Wishart(Ψ⁻¹, ν) whenever Ψ = U'U.
+	double B[D*D]; // Column major
+	double *R = component->R;
+	memset(B, 0, D*D*sizeof(double));
+	for(int j=0; j<D; j++) {
+		B[j+j*D] = sqrt(2.0*rand_gamma(rng, 0.5*(table->nu - j)));
+		for(int i=j+1; i<D; i++) {
+			B[i+j*D] = randn(rng);
+		}
+		cblas_dtpsv(CblasColMajor, CblasUpper, CblasNoTrans, CblasNonUnit, D, table->psi, &B[j*D], 1);
+	}
+
+	// R = chol(BB')
+	memset(R, 0, (D*(D+1)/2)*sizeof(double));
+	for(int j=0; j<D; j++) {
+		cblas_dspr(CblasColMajor, CblasUpper, D, 1.0, &B[j*D], 1, R);
+	}
+	cholesky(D, R);
+
+	// μ = ξ + R⁻¹z/√κ has covariance (R'R)⁻¹/κ
+	for(int i=0; i<D; i++) {
+		component->mu[i] = randn(rng)/sqrt(table->kappa);
+	}
+	cblas_dtpsv(CblasColMajor, CblasUpper, CblasNoTrans, CblasNonUnit, D, R, component->mu, 1);
+	cblas_daxpy(D, 1.0, table->xi, 1, component->mu, 1);
+
+	component->lognorm = logdet(D, R) - 0.5*D*log(2*M_PI);
+}
+
+
+
+/* Log density of a customer under a Gaussian component */
+double log_gaussian(const Component *component, const double *customer)
+{
+	const int D = component->D;
+	double z[D]; // tmp storage for the result of R(x-μ)
+	memcpy(z, customer, D*sizeof(double));
+	cblas_daxpy(D, -1.0, component->mu, 1, z, 1);
+	cblas_dtpmv(CblasColMajor, CblasUpper, CblasNoTrans, CblasNonUnit, D, component->R, z, 1);
+	return component->lognorm - 0.5*cblas_ddot(D, z, 1, z, 1);
+}
+
+
+
+/* Draws the components and then updates the table assignments of every customer */
+void auxiliary_sweep(AuxiliarySampler *as)
+{
+	ChineseRestaurant *cr = as->cr;
+	double **customers = cr->customers;
+	Rng *rng = cr->rng;
+	const int m = as->m;
+
+	// Draw the components once per sweep: occupied tables from their posterior, auxiliary tables from the prior
+	reserve_components(as, cr->num_tables);
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		refresh_table(cr, table_i);
+		draw_component(rng, table_i, &as->components[table_i->id]);
+	}
+	for(int j=0; j<m; j++) {
+		draw_component(rng, &cr->table_prior, &as->aux[j]);
+	}
+
+	for(int c=0; c<cr->N; c++) {
+		// A singleton's table is about to be emptied, so its component replaces one of the
+		// auxiliary tables (the "reuse" variant of Favaro and Teh, 2013)
+		if(cr->assigned_tables[c] != NO_TABLE) {
+			Table *table = cr->tables[cr->assigned_tables[c]];
+			if(table->size == 1) {
+				swap_components(&as->components[table->id], &as->aux[(int)(m*randu(rng))]);
+			}
+		}
+		stand_customer(cr, c);
+
+		// Unnormalised log probabilities of the occupied tables followed by the auxiliary tables
+		int k = List_count(cr->occupied_tables);
+		double logp[k+m];
+		double maxlogp = -INFINITY;
+		LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+			logp[i] = log(table_i->size) + log_gaussian(&as->components[table_i->id], customers[c]);
+			if(logp[i] > maxlogp) {
+				maxlogp = logp[i];
+			}
+		}
+		double logaux = log(cr->alpha/m);
+		for(int j=0; j<m; j++) {
+			logp[k+j] = logaux + log_gaussian(&as->aux[j], customers[c]);
+			if(logp[k+j] > maxlogp) {
+				maxlogp = logp[k+j];
+			}
+		}
+
+		// Draw from the multinomial distribution over the k+m tables
+		double Z = 0;
+		for(int j=0; j<k+m; j++) {
+			logp[j] = exp(logp[j] - maxlogp);
+			Z += logp[j];
+		}
+		double u = Z*randu(rng);
+		int drawn = 0;
+		while(drawn < k+m-1 && u >= logp[drawn]) {
+			u -= logp[drawn++];
+		}
+
+		if(drawn < k) { // Existing table
+			ListNode *node = cr->occupied_tables->first;
+			for(int j=0; j<drawn; j++) {
+				node = node->next;
+			}
+			seat_customer_at(cr, c, node->value);
+		} else { // Auxiliary table j becomes a new occupied table and is replaced by a fresh draw
+			int j = drawn - k;
+			Table *table = seat_customer_at(cr, c, NULL);
+			reserve_components(as, table->id + 1);
+			swap_components(&as->components[table->id], &as->aux[j]);
+			draw_component(rng, &cr->table_prior, &as->aux[j]);
+		}
+	}
+	finish_sweep(cr);
+}
@@ -0,0 +1,47 @@
+#ifndef _AUXILIARY_H
+#define _AUXILIARY_H
+
+#include "../crp.h" /* ChineseRestaurant and Table structs */
+
+/*
+ * Uncollapsed Gibbs sampler with auxiliary tables (Algorithm 8 of Neal, 2000).
+ *
+ * Every occupied table carries an explicit Gaussian component drawn from its
+ * NIW posterior once per sweep, so scoring a customer is a quadratic form rather
+ * than a Student-t predictive. The restaurant still tracks the NIW hyperparameters
+ * of each table, which are used to redraw the components at the start of a sweep.
+ */
+
+/* Gaussian component with mean mu and precision matrix R'R */
+typedef struct Component {
+	int D; // Dimensionality of data
+	double *mu; // Mean
+	double *R; // Upper Cholesky factor of the precision matrix (uses packed upper triangular storage)
+	double lognorm; // log|R| - (D/2)log(2π)
+} Component;
+
+/* Auxiliary table sampler */
+typedef struct AuxiliarySampler {
+	ChineseRestaurant *cr; /* Restaurant holding the table assignments and NIW hyperparameters */
+	int m; /* Number of auxiliary tables */
+	Component *aux; /* Components of the auxiliary tables, drawn from the prior */
+	Component *components; /* Maps table ids to the components of the occupied tables */
+	unsigned int capacity; /* Allocated length of the components array */
+} AuxiliarySampler;
+
+/* Creates an auxiliary table sampler for the restaurant with m auxiliary tables */
+AuxiliarySampler *auxiliary_init(ChineseRestaurant *cr, const int m);
+
+/* Frees the sampler. The restaurant is left untouched. */
+void auxiliary_destroy(AuxiliarySampler *as);
+
+/* Draws a Gaussian component from the NIW distribution with the table's hyperparameters */
+void draw_component(Rng *rng, const Table *table, Component *component);
+
+/* Log density of a customer under a Gaussian component */
+double log_gaussian(const Component *component, const double *customer);
+
+/* Draws the components and then updates the table assignments of every customer */
+void auxiliary_sweep(AuxiliarySampler *as);
+
+#endif
@@ -0,0 +1,152 @@
+#include "batch.h"
+#include <stdio.h> // fopen, fscanf, fprintf, fclose
+#include <stdlib.h> // malloc, calloc, realloc, free, exit
+#include <string.h> // strlen, memcpy
+#include <time.h> // clock_gettime
+#include "../dpgmm/dpgmm.h" // dpgmm_create_stream, dpgmm_step, dpgmm_num_clusters, dpgmm_alpha, dpgmm_assignments, dpgmm_destroy
+#include "../utils/utils.h" // import_data
+
+#define PATH_LENGTH 4096 // Longest path accepted in a manifest
+
+
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Reads a manifest of datasets. Model i will use stream i of the seed. */
+Batch *batch_load(const char *manifest, const uint32_t seed)
+{
+	FILE *fp = fopen(manifest, "r");
+	if(fp == NULL) {
+		fprintf(stderr, "Cannot open %s\n", manifest);
+		exit(1);
+	}
+	Batch *batch = calloc(1, sizeof(Batch));
+	batch->seed = seed;
+	int capacity = 0;
+	char path[PATH_LENGTH];
+	int N, D;
+	while(fscanf(fp, "%4095s %d %d", path, &N, &D) == 3) {
+		if(N < 1 || D < 1) {
+			fprintf(stderr, "Invalid size %d by %d for %s in %s\n", N, D, path, manifest);
+			exit(1);
+		}
+		if(batch->num_models == capacity) {
+			capacity = capacity > 0 ? 2*capacity : 64;
+			batch->paths = realloc(batch->paths, capacity*sizeof(char *));
+			batch->N = realloc(batch->N, capacity*sizeof(int));
+			batch->D = realloc(batch->D, capacity*sizeof(int));
+		}
+		int i = batch->num_models++;
+		batch->paths[i] = malloc(strlen(path) + 1);
+		memcpy(batch->paths[i], path, strlen(path) + 1);
+		batch->N[i] = N;
+		batch->D[i] = D;
+	}
+	fclose(fp);
+	batch->results = calloc(batch->num_models, sizeof(BatchResult));
+	return batch;
+}
+
+
+
+/* Frees the batch and its results */
+void batch_destroy(Batch *batch)
+{
+	for(int i=0; i<batch->num_models; i++) {
+		free(batch->paths[i]);
+		free(batch->results[i].labels);
+	}
+	free(batch->paths);
+	free(batch->N);
+	free(batch->D);
+	free(batch->results);
+	free(batch);
+}
+
+
+
+/* Reads, samples and frees the model of one dataset, leaving its summary in the dataset's result slot */
+static void run_model(void *arg, const int index)
+{
+	Batch *batch = arg;
+	BatchResult *result = &batch->results[index];
+	const int N = batch->N[index];
+	const int D = batch->D[index];
+	double start = now();
+
+	double *data = malloc(N*D*sizeof(double));
+	import_data(batch->paths[index], N, D, data);
+	double xi[D];
+	double psi[D*(D+1)/2];
+	for(int j=0; j<D; j++) {
+		xi[j] = 0;
+		for(int i=0; i<=j; i++) {
+			psi[i+(j+1)*j/2] = i == j;
+		}
+	}
+	DPGMM *model = dpgmm_create_stream(data, N, D, batch->alpha, xi, batch->kappa, D, psi, batch->seed, index);
+	free(data);
+
+	dpgmm_step(model, batch->burnin);
+	result->mean_clusters = 0;
+	result->mean_alpha = 0;
+	for(int i=0; i<batch->samples; i++) {
+		dpgmm_step(model, 1);
+		result->mean_clusters += dpgmm_num_clusters(model);
+		result->mean_alpha += dpgmm_alpha(model);
+	}
+	if(batch->samples > 0) {
+		result->mean_clusters /= batch->samples;
+		result->mean_alpha /= batch->samples;
+	}
+	result->num_clusters = dpgmm_num_clusters(model);
+	result->labels = malloc(N*sizeof(int));
+	dpgmm_assignments(model, result->labels);
+	dpgmm_destroy(model);
+	result->seconds = now() - start;
+}
+
+
+
+/* Samples every model on the pool. Each model is swept burnin + samples times. */
+void batch_run(Batch *batch, ThreadPool *pool, const int burnin, const int samples, const double alpha, const double kappa)
+{
+	batch->burnin = burnin;
+	batch->samples = samples;
+	batch->alpha = alpha;
+	batch->kappa = kappa;
+	parallel_for(pool, batch->num_models, run_model, batch);
+}
+
+
+
+/* Writes one summary line and one line of cluster labels per dataset, in manifest order */
+void batch_export(const Batch *batch, const char *summary_file, const char *labels_file)
+{
+	FILE *summary = fopen(summary_file, "w");
+	FILE *labels = fopen(labels_file, "w");
+	if(summary == NULL || labels == NULL) {
+		fprintf(stderr, "Cannot open %s or %s\n", summary_file, labels_file);
+		exit(1);
+	}
+	fprintf(summary, "# path\tN\tD\tclusters\tmean_clusters\tmean_alpha\tseconds\n");
+	for(int i=0; i<batch->num_models; i++) {
+		const BatchResult *result = &batch->results[i];
+		fprintf(summary, "%s\t%d\t%d\t%d\t%f\t%f\t%f\n", batch->paths[i], batch->N[i], batch->D[i],
+			result->num_clusters, result->mean_clusters, result->mean_alpha, result->seconds);
+		for(int j=0; j<batch->N[i]; j++) {
+			fprintf(labels, "%d\t", result->labels[j]);
+		}
+		fprintf(labels, "\n");
+	}
+	fclose(summary);
+	fclose(labels);
+}
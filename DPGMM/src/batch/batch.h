@@ -0,0 +1,57 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stdint.h> /* uint32_t */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Runs one DPGMM per dataset of a manifest on a thread pool.
+ *
+ * Each line of the manifest names a data file followed by its number of rows and
+ * columns. Every model is read, created, sampled and freed by a single task, so it
+ * has its own restaurant and random number generator, and at most one model per
+ * thread is in memory at a time. Model i draws from stream i of the seed, which makes
+ * the results independent of the number of threads and keeps the generators of the
+ * models independent rather than seeded with adjacent seeds. The tasks write their results into
+ * slots of a shared array, which batch_export writes out in manifest order.
+ *
+ * Every model uses the prior of main.c scaled to its dimension: ξ = 0, Ψ = I, ν = D,
+ * with the κ and initial α passed to batch_run.
+ */
+
+/* Summary of the samples drawn for one dataset */
+typedef struct BatchResult {
+	int num_clusters; /* Number of clusters in the last sample */
+	double mean_clusters; /* Number of clusters averaged over the samples */
+	double mean_alpha; /* Concentration parameter averaged over the samples */
+	int *labels; /* Cluster of each data point in the last sample */
+	double seconds; /* Time spent on the model, including reading its data */
+} BatchResult;
+
+/* Datasets of a manifest and the results of their models */
+typedef struct Batch {
+	int num_models; /* Number of datasets */
+	char **paths; /* Data file of each dataset */
+	int *N; /* Number of data points in each dataset */
+	int *D; /* Dimensionality of each dataset */
+	uint32_t seed; /* Seed whose streams drive the models */
+	int burnin; /* Sweeps discarded before sampling */
+	int samples; /* Sweeps summarised in the results */
+	double alpha; /* Initial concentration parameter */
+	double kappa; /* Prior precision scale factor */
+	BatchResult *results; /* Result slot of each dataset */
+} Batch;
+
+/* Reads a manifest of datasets. Model i will use stream i of the seed. */
+Batch *batch_load(const char *manifest, const uint32_t seed);
+
+/* Frees the batch and its results */
+void batch_destroy(Batch *batch);
+
+/* Samples every model on the pool. Each model is swept burnin + samples times. */
+void batch_run(Batch *batch, ThreadPool *pool, const int burnin, const int samples, const double alpha, const double kappa);
+
+/* Writes one summary line and one line of cluster labels per dataset, in manifest order */
+void batch_export(const Batch *batch, const char *summary_file, const char *labels_file);
+
+#endif
@@ -1,85 +1,261 @@
 #include "crp.h"
-#include <Accelerate/Accelerate.h> // cblas_dscal, cblas_daxpy, cblas_dtpsv
-#include <math.h> // log, exp, lgamma, sqrt, M_PI
+#include <Accelerate/Accelerate.h> // cblas_dscal, cblas_daxpy, cblas_dtpsv, cblas_dspr, cblas_saxpy, cblas_stpsv, cblas_sdot
+#include <math.h> // log, exp, lgamma, log1p, sqrt, log1pf, fabs, M_PI
 #include <stdlib.h> // calloc
-#include <string.h> // memcpy
+#include <string.h> // memcpy, memset
 #include "random/random.h" // randu 
-#include "slicesample/slicesample.h"  // slice_sample_alpha
-#include "utils/utils.h" // import_data, export_data
+#include "slicesample/slicesample.h"  // slice_sample_alpha, gibbs_sample_alpha
+#include "utils/utils.h" // export_data
+#include "fastmath/fastmath.h" // fast_exp, fast_log, fast_log1p, fast_lgamma
+#include "kdtree/kdtree.h" // kdtree_build, kdtree_destroy, kdtree_update, kdtree_add, kdtree_remove, kdtree_candidates
 #include <stdio.h>
 
-/********************* Global variables *************************/
-extern const int N;	// Number of data points. Defined in main
-extern const int D; // Dimensionality of data. Defined in main
-double **customers; // Data points stored as an N by D array.
-/****************************************************************/
-
-
-/* Initialises Chinese restaurant processs */
-ChineseRestaurant *crp_init(const char *filename, const double alpha, const double xi[], const double kappa, const double nu, const double psi[])
+/* Table ids are compacted after a sweep once the empty tables outnumber the occupied ones */
+#define COMPACT_RATIO 2
+
+/* Number of sweeps between full recomputations of the sufficient statistics */
+#define REFRESH_INTERVAL 100
+
+/* The kd-tree over the tables is only built once there are this many occupied tables */
+#define INDEX_MIN_TABLES 64
+
+/* Default bound on the total variation distance introduced by pruning tables in crp_draw */
+#define PRUNE_TOLERANCE 1e-6
+
+/* Transcendental functions of the scoring loop in crp_log_predictive. Compile with -DCRP_FAST_MATH to use the
+ * approximations in fastmath.h. Everything else, log_likelihood included, uses libm. */
+#ifdef CRP_FAST_MATH
+#define EXP fast_exp
+#define LOG fast_log
+#define LOG1P fast_log1p
+#define LGAMMA fast_lgamma
+#else
+#define EXP exp
+#define LOG log
+#define LOG1P log1p
+#define LGAMMA lgamma
+#endif
+
+/* Initialises Chinese restaurant processs with a copy of the N by D data array (row major) */
+ChineseRestaurant *crp_init(const double *data, const int N, const int D, Rng *rng, const double alpha, const double xi[], const double kappa, const double nu, const double psi[])
 {
-	ChineseRestaurant *cr = calloc(1, sizeof(ChineseRestaurant));
+	ChineseRestaurant *cr = crp_create(D, rng, alpha, xi, kappa, nu, psi);
 
-	// Allocate space for data
-	customers = calloc(N,sizeof(double *));
+	// Copy the data
+	cr->N = N;
+	cr->customers = calloc(N,sizeof(double *));
 	for(int i=0; i<N; i++) {
-		customers[i] = calloc(D,sizeof(double));
+		cr->customers[i] = calloc(D,sizeof(double));
+		memcpy(cr->customers[i], &data[i*D], D*sizeof(double));
 	}
-	// Import data
-	import_data(filename, N, D, customers);
+
+	// Initially, no customers are seated. We represent this using NO_TABLE
+	cr->assigned_tables = malloc(N*sizeof(table_id));
+	for(int i=0; i<N; i++) {
+		cr->assigned_tables[i] = NO_TABLE;
+	}
+	
+	// Prepare an empty table
+	add_new_table(cr);
+	
+	return cr;
+}
+
+
+
+/* Creates a restaurant with no customers and no tables */
+ChineseRestaurant *crp_create(const int D, Rng *rng, const double alpha, const double xi[], const double kappa, const double nu, const double psi[])
+{
+	ChineseRestaurant *cr = calloc(1, sizeof(ChineseRestaurant));
+	cr->D = D;
+	cr->rng = rng;
 
 	// Set concentration parameter
 	cr->alpha = alpha;
+#ifdef CRP_SPATIAL_INDEX
+	cr->prune_tolerance = PRUNE_TOLERANCE;
+#endif
 	
 	// Set prior hyperparameters
 	Table *table_prior = &cr->table_prior;
+	table_prior->D = D;
 	table_prior->xi = calloc(D,sizeof(double));
 	memcpy(table_prior->xi, xi , D*sizeof(double));
 	table_prior->kappa = kappa;
 	table_prior->nu = nu;
 	table_prior->psi = calloc(D*(D+1)/2, sizeof(double));
 	memcpy(table_prior->psi, psi, (D*(D+1)/2)*sizeof(double));
-	table_prior->logdetpsi = logdet(psi);
-	
-	// Initially, no customers are seated. We represent this using NULL pointers
-	cr->assigned_tables = calloc(N,sizeof(ListNode));
+	table_prior->logdetpsi = logdet(D, psi);
+#ifdef CRP_FLOAT_SCORING
+	table_prior->xi_f = calloc(D, sizeof(float));
+	table_prior->psi_f = calloc(D*(D+1)/2, sizeof(float));
+	pack_table(table_prior);
+#endif
+	cr->prior_scatter = calloc(D*(D+1)/2, sizeof(double));
+	niw_scatter(table_prior, cr->prior_scatter);
 	
 	// Create the lists of occupied and empty tables
 	cr->occupied_tables = List_create();
 	cr->empty_tables = List_create();
 	
-	// Prepare an empty table
-	add_new_table(cr);
-	
 	return cr;
 }
 
 
 
+/* Frees the restaurant, its customers and the tables no other restaurant holds */
+void crp_destroy(ChineseRestaurant *cr)
+{
+#ifdef CRP_SPATIAL_INDEX
+	if(cr->index != NULL) {
+		kdtree_destroy(cr->index);
+	}
+#endif
+	LIST_FOREACH(cr->occupied_tables, node) {
+		Table *table = node->value;
+		if(--table->refs == 0) {
+			destroy_table(table);
+		}
+	}
+	List_destroy(cr->occupied_tables);
+	while(List_count(cr->empty_tables) > 0) {
+		destroy_table(List_pop(cr->empty_tables));
+	}
+	List_destroy(cr->empty_tables);
+	for(int i=0; i<cr->N; i++) {
+		free(cr->customers[i]);
+	}
+	free(cr->customers);
+	free(cr->assigned_tables);
+	free(cr->tables);
+	free(cr->table_prior.xi);
+	free(cr->table_prior.psi);
+#ifdef CRP_FLOAT_SCORING
+	free(cr->table_prior.xi_f);
+	free(cr->table_prior.psi_f);
+#endif
+	free(cr->prior_scatter);
+	free(cr);
+}
+
+
+
 /* Adds a new empty table and assigns it the prior hyperparameters */
 void add_new_table(ChineseRestaurant *cr)
 {
-	Table *new_table = calloc(1, sizeof(Table));
-	new_table->size = 0;
-	new_table->xi = calloc(D,sizeof(double));
-	memcpy(new_table->xi, cr->table_prior.xi , D*sizeof(double));
-	new_table->kappa = cr->table_prior.kappa;
-	new_table->nu = cr->table_prior.nu;
-	new_table->psi = calloc(D*(D+1)/2, sizeof(double));
-	memcpy(new_table->psi, cr->table_prior.psi, (D*(D+1)/2)*sizeof(double));
-	new_table->logdetpsi = cr->table_prior.logdetpsi;
+	Table *table = new_table(&cr->table_prior);
+
+	// Give the table the next unused id, growing the id map if necessary
+	if(cr->num_tables >= NO_TABLE) {
+		fprintf(stderr, "Exceeded %u tables. Rebuild without CRP_SMALL_TABLE_IDS.\n", (unsigned int)NO_TABLE);
+		exit(1);
+	}
+	if(cr->num_tables == cr->table_capacity) {
+		cr->table_capacity = cr->table_capacity > 0 ? 2*cr->table_capacity : 16;
+		cr->tables = realloc(cr->tables, cr->table_capacity*sizeof(Table *));
+	}
+	table->id = cr->num_tables;
+	cr->tables[cr->num_tables++] = table;
 	
 	// Add new table to list of empty tables
-	List_push(cr->empty_tables, new_table);
+	List_push(cr->empty_tables, table);
+	table->node = cr->empty_tables->last;
+}
+
+
+
+/* Allocates an empty table with the prior hyperparameters. It is not added to any restaurant. */
+Table *new_table(const Table *prior)
+{
+	const int D = prior->D;
+	Table *table = calloc(1, sizeof(Table));
+	table->D = D;
+	table->refs = 1;
+	table->size = 0;
+	table->xi = calloc(D,sizeof(double));
+	memcpy(table->xi, prior->xi , D*sizeof(double));
+	table->kappa = prior->kappa;
+	table->nu = prior->nu;
+	table->psi = calloc(D*(D+1)/2, sizeof(double));
+	memcpy(table->psi, prior->psi, (D*(D+1)/2)*sizeof(double));
+	table->logdetpsi = prior->logdetpsi;
+#ifdef CRP_LAZY_CHOLESKY
+	table->sum = calloc(D, sizeof(double));
+	table->scatter = calloc(D*(D+1)/2, sizeof(double));
+	table->stale = 0;
+#endif
+#ifdef CRP_SPATIAL_INDEX
+	table->slot = -1;
+#endif
+#ifdef CRP_FLOAT_SCORING
+	table->xi_f = malloc(D*sizeof(float));
+	memcpy(table->xi_f, prior->xi_f, D*sizeof(float));
+	table->psi_f = malloc((D*(D+1)/2)*sizeof(float));
+	memcpy(table->psi_f, prior->psi_f, (D*(D+1)/2)*sizeof(float));
+	table->shrink_f = prior->shrink_f;
+	table->power_f = prior->power_f;
+	table->lognorm_f = prior->lognorm_f;
+#endif
+	return table;
+}
+
+
+
+/* Returns an unshared copy of the table and its hyperparameters */
+Table *copy_table(const Table *table)
+{
+	const int D = table->D;
+	Table *copy = malloc(sizeof(Table));
+	*copy = *table;
+	copy->refs = 1;
+#ifdef CRP_SPATIAL_INDEX
+	copy->slot = -1;
+#endif
+	copy->xi = malloc(D*sizeof(double));
+	memcpy(copy->xi, table->xi, D*sizeof(double));
+	copy->psi = malloc((D*(D+1)/2)*sizeof(double));
+	memcpy(copy->psi, table->psi, (D*(D+1)/2)*sizeof(double));
+#ifdef CRP_LAZY_CHOLESKY
+	copy->sum = malloc(D*sizeof(double));
+	memcpy(copy->sum, table->sum, D*sizeof(double));
+	copy->scatter = malloc((D*(D+1)/2)*sizeof(double));
+	memcpy(copy->scatter, table->scatter, (D*(D+1)/2)*sizeof(double));
+#endif
+#ifdef CRP_FLOAT_SCORING
+	copy->xi_f = malloc(D*sizeof(float));
+	memcpy(copy->xi_f, table->xi_f, D*sizeof(float));
+	copy->psi_f = malloc((D*(D+1)/2)*sizeof(float));
+	memcpy(copy->psi_f, table->psi_f, (D*(D+1)/2)*sizeof(float));
+#endif
+	return copy;
+}
+
+
+
+/* Frees a table and its hyperparameters */
+void destroy_table(Table *table)
+{
+	free(table->xi);
+	free(table->psi);
+#ifdef CRP_LAZY_CHOLESKY
+	free(table->sum);
+	free(table->scatter);
+#endif
+#ifdef CRP_FLOAT_SCORING
+	free(table->xi_f);
+	free(table->psi_f);
+#endif
+	free(table);
 }
 
 
 
 /* Resets the table parameters to the prior hyperparameters */
-void clear_empty_table(ChineseRestaurant *cr, ListNode *tablenode)
+void clear_empty_table(ChineseRestaurant *cr, Table *empty_table)
 {
+	const int D = cr->D;
 	// Remove the empty table from the list of occupied tables
-	Table *empty_table = List_remove(cr->occupied_tables,tablenode);
+	List_remove(cr->occupied_tables, empty_table->node);
 
 	// Reset the table hyperparameters to the prior hyperparameters
 	empty_table->size = 0;
@@ -88,9 +264,64 @@ void clear_empty_table(ChineseRestaurant *cr, ListNode *tablenode)
 	empty_table->nu = cr->table_prior.nu;
 	memcpy(empty_table->psi, cr->table_prior.psi, (D*(D+1)/2)*sizeof(double));
 	empty_table->logdetpsi = cr->table_prior.logdetpsi;
-
-	// Add the table to the list of empty tables
+#ifdef CRP_LAZY_CHOLESKY
+	memset(empty_table->sum, 0, D*sizeof(double));
+	memset(empty_table->scatter, 0, (D*(D+1)/2)*sizeof(double));
+	empty_table->stale = 0;
+#endif
+#ifdef CRP_FLOAT_SCORING
+	const Table *prior = &cr->table_prior;
+	memcpy(empty_table->xi_f, prior->xi_f, D*sizeof(float));
+	memcpy(empty_table->psi_f, prior->psi_f, (D*(D+1)/2)*sizeof(float));
+	empty_table->shrink_f = prior->shrink_f;
+	empty_table->power_f = prior->power_f;
+	empty_table->lognorm_f = prior->lognorm_f;
+#endif
+
+	// Add the table to the list of empty tables. Its id is reused when the table is next drawn.
 	List_push(cr->empty_tables, empty_table);
+	empty_table->node = cr->empty_tables->last;
+}
+
+
+
+/* Relabels the occupied tables 0,...,K-1 and frees surplus empty tables */
+void compact_tables(ChineseRestaurant *cr)
+{
+	table_id *new_ids = malloc(cr->num_tables*sizeof(table_id)); // Maps old ids to new ids
+#ifdef CRP_SPATIAL_INDEX
+	// The tree holds pointers to the empty tables freed below. finish_sweep rebuilds it.
+	if(cr->index != NULL) {
+		kdtree_destroy(cr->index);
+		cr->index = NULL;
+	}
+#endif
+
+	// Occupied tables take ids 0,...,K-1 in list order
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		new_ids[table_i->id] = i;
+		table_i->id = i;
+		cr->tables[i] = table_i;
+	}
+
+	// Keep a single empty table for the next draw and free the rest
+	while(List_count(cr->empty_tables) > 1) {
+		destroy_table(List_pop(cr->empty_tables));
+	}
+	cr->num_tables = i;
+	if(List_count(cr->empty_tables) == 1) {
+		Table *empty_table = List_last(cr->empty_tables);
+		empty_table->id = cr->num_tables;
+		cr->tables[cr->num_tables++] = empty_table;
+	}
+
+	// Relabel the customers
+	for(int j=0; j<cr->N; j++) {
+		if(cr->assigned_tables[j] != NO_TABLE) {
+			cr->assigned_tables[j] = new_ids[cr->assigned_tables[j]];
+		}
+	}
+	free(new_ids);
 }
 
 
@@ -106,46 +337,209 @@ Table *next_available_table(ChineseRestaurant *cr)
 
 
 
-/* Draws a table using CRP */
-ListNode *crp_draw(ChineseRestaurant *cr, const int customer_index)
+/* Draws a table using CRP. Returns NULL if an empty table was drawn. */
+Table *crp_draw(ChineseRestaurant *cr, const int customer_index)
 {
 	int k = List_count(cr->occupied_tables); // Number of occupied tables 
 	double logp[k+1]; // Unnormalised log probabilities for sitting at each of the tables
+#ifdef CRP_SPATIAL_INDEX
+	if(cr->index != NULL) {
+		// Only the tables found by the kd-tree are scored, and the draw is made among those
+		Table *candidates[k];
+		double logZ;
+		int j = kdtree_candidates(cr, cr->index, cr->customers[customer_index], cr->prune_tolerance, candidates, logp, &logZ);
+		int drawn = crp_sample(cr->rng, logp, j, logZ);
+		return drawn == j ? NULL : candidates[drawn];
+	}
+#endif
+	double logZ = crp_log_predictive(cr, cr->customers[customer_index], logp);
+	int j = crp_sample(cr->rng, logp, k, logZ);
+	if(j == k) { // Empty table was drawn
+		return NULL;
+	}
+	ListNode *node = cr->occupied_tables->first;
+	while(j-- > 0) {
+		node = node->next;
+	}
+	return node->value;
+}
+
+
+
+/* Computes the squared norm of L⁻¹(x-ξ), the only part of log_likelihood that depends on the customer */
+static double mahalanobis(const Table *table, const double *customer)
+{
+	const int D = table->D;
+	double z[D]; // tmp storage for the result of L⁻¹(x-ξ)
+	memcpy(z, customer, D*sizeof(double));
+	cblas_daxpy(D,-1.0,table->xi,1,z,1);
+	cblas_dtpsv(CblasColMajor,CblasUpper,CblasTrans,CblasNonUnit,D,table->psi,z,1);
+	return cblas_ddot(D,z,1,z,1);
+}
+
+
+
+/* 
+ * Log density of the Student-t predictive up to the log determinant of Ψ, given half the
+ * degrees of freedom plus one (ν+1)/2, the shrinkage κ/(κ+1) and the squared norm q of L⁻¹(x-ξ)
+ */
+static inline double student_t(const int D, const double half_nu, const double shrink, const double q)
+{
+	return lgamma(half_nu) - lgamma(half_nu - 0.5*D) + 0.5*D*log(M_PI*shrink) - half_nu*log1p(q*shrink);
+}
+
+
+
+#ifdef CRP_VALIDATE_FLOAT
+/* Scores the customer again in double precision and records how far the draw probabilities have diverged */
+static void validate_float(ChineseRestaurant *cr, const double *customer, const double *logp, const double logZ)
+{
+	int k = List_count(cr->occupied_tables);
+	double logp_d[k+1];
+	logp_d[k] = log(cr->alpha) + log_likelihood(&cr->table_prior, customer);
+	double maxlogp = logp_d[k];
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		logp_d[i] = log(table_i->size) + log_likelihood(table_i, customer);
+		if(logp_d[i] > maxlogp) {
+			maxlogp = logp_d[i];
+		}
+	}
+	double Z = 0;
+	for(i=0; i<k+1; i++) {
+		Z += exp(logp_d[i] - maxlogp);
+	}
+	double logZ_d = log(Z) + maxlogp;
+
+	// Total variation distance between the two draw distributions
+	double tv = 0;
+	for(i=0; i<k+1; i++) {
+		tv += 0.5*fabs(exp(logp[i] - logZ) - exp(logp_d[i] - logZ_d));
+		if(fabs(logp[i] - logp_d[i]) > cr->max_logp_error) {
+			cr->max_logp_error = fabs(logp[i] - logp_d[i]);
+		}
+	}
+	cr->validated_scores++;
+	cr->sum_tv += tv;
+	if(tv > cr->max_tv) {
+		cr->max_tv = tv;
+	}
+}
+
+
+
+/* Prints how far the float draw probabilities have diverged from the double ones */
+void report_float_divergence(const ChineseRestaurant *cr)
+{
+	printf("Float scoring: %lu customers scored, total variation distance %g on average and %g at most, log probability error %g at most.\n",
+		cr->validated_scores, cr->validated_scores > 0 ? cr->sum_tv/cr->validated_scores : 0.0, cr->max_tv, cr->max_logp_error);
+}
+#endif
+
+
+
+/* 
+ * Scores a customer against every table. logp[j] is the unnormalised log probability of
+ * sitting at occupied table j, and logp[k] that of sitting at an empty table.
+ * Returns the log normalising constant. Does not touch the random number generator.
+ */
+double crp_log_predictive(ChineseRestaurant *cr, const double *customer, double *logp)
+{
+	int k = List_count(cr->occupied_tables); // Number of occupied tables 
 	double maxlogp; // Largest unnormalised log probability. Used to normalise the probabilities
-	Table *empty_table = next_available_table(cr);
+#ifdef CRP_FLOAT_SCORING
+	// The tables are scored in single precision. Only the normalisation is done in double.
+	float x[cr->D];
+	for(int d=0; d<cr->D; d++) {
+		x[d] = customer[d];
+	}
+#endif
 	
+#ifdef CRP_FLOAT_SCORING
 	// Probability of sitting at an empty table
-	logp[k] = log(cr->alpha) + log_likelihood(empty_table, customers[customer_index]);
-	maxlogp = logp[k];
+	logp[k] = LOG(cr->alpha) + log_likelihood_f(&cr->table_prior, x);
 
 	// Probabilities of sitting at the occupied tables
 	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
-		logp[i] = log(table_i->size) + log_likelihood(table_i, customers[customer_index]);
+		refresh_table(cr, table_i);
+		logp[i] = LOG(table_i->size) + log_likelihood_f(table_i, x);
+	}
+#else
+	// The quadratic forms are computed table by table, and the transcendental functions
+	// are then applied in a loop over arrays, which can be vectorised with -DCRP_FAST_MATH.
+	double weight[k+1], half_nu[k+1], shrink[k+1], logdetpsi[k+1];
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		refresh_table(cr, table_i);
+		weight[i] = table_i->size;
+		half_nu[i] = 0.5*(table_i->nu + 1);
+		shrink[i] = table_i->kappa/(table_i->kappa + 1);
+		logdetpsi[i] = table_i->logdetpsi;
+		logp[i] = mahalanobis(table_i, customer);
+	}
+	// An empty table is scored like an occupied table with weight α
+	weight[k] = cr->alpha;
+	half_nu[k] = 0.5*(cr->table_prior.nu + 1);
+	shrink[k] = cr->table_prior.kappa/(cr->table_prior.kappa + 1);
+	logdetpsi[k] = cr->table_prior.logdetpsi;
+	logp[k] = mahalanobis(&cr->table_prior, customer);
+	// student_t with the kernels of the scoring loop
+	for(i=0; i<k+1; i++) {
+		logp[i] = LOG(weight[i]) + LGAMMA(half_nu[i]) - LGAMMA(half_nu[i] - 0.5*cr->D) + 0.5*cr->D*LOG(M_PI*shrink[i])
+			- half_nu[i]*LOG1P(logp[i]*shrink[i]) - logdetpsi[i];
+	}
+#endif
+	maxlogp = logp[k];
+	for(i=0; i<k; i++) {
 		if(logp[i] > maxlogp) {
 			maxlogp = logp[i];
 		}
 	}
 
-	// Compute normalising constant without numerical overflow/underflow
+	// Compute normalising constant without numerical overflow/underflow. The exponentials
+	// are taken in a loop of their own, which can be vectorised with -DCRP_FAST_MATH.
+	double w[k+1];
+	for(i=0; i<k+1; i++) {
+		w[i] = EXP(logp[i] - maxlogp);
+	}
 	double Z = 0;
 	for(i=0; i<k+1; i++) {
-		Z += exp(logp[i] - maxlogp);
+		Z += w[i];
 	}
-	double logZ = log(Z) + maxlogp;
+#ifdef CRP_VALIDATE_FLOAT
+	validate_float(cr, customer, logp, LOG(Z) + maxlogp);
+#endif
+	return LOG(Z) + maxlogp;
+}
+
 
+
+/* Log posterior predictive density of a customer, given the logZ that crp_log_predictive returned for them */
+double crp_log_density(const ChineseRestaurant *cr, const double logZ)
+{
+	// The seated customers, which are all N only once every customer has been seated
+	unsigned long seated = 0;
+	LIST_FOREACH(cr->occupied_tables, node) {
+		seated += ((Table *)node->value)->size;
+	}
+	// log_likelihood leaves out a factor of π^-D
+	return logZ - log(cr->alpha + seated) - cr->D*log(M_PI);
+}
+
+
+
+/* Draws j in 0,...,k from the probabilities exp(logp[j] - logZ). k stands for an empty table. */
+int crp_sample(Rng *rng, const double *logp, const int k, const double logZ)
+{
 	// Draw a new table by samppling from the multinomial distribution over 
 	// (p0,...,pk) where pj is the probability of sitting at table j.
-	double u = randu();
+	double u = randu(rng);
 	double cum_prob_j = 0; // cumulative probability
-	
-	LIST_ENUMERATE(cr->occupied_tables, j, node_j, table_j) {
+	for(int j=0; j<k; j++) {
 		cum_prob_j += exp(logp[j] - logZ);
 		if(u < cum_prob_j) {
-			return node_j; // Table j was drawn
+			return j; // Table j was drawn
 		}
 	}
-	 // Empty table was drawn 
-	return NULL;
+	return k;
 }
 
 
@@ -154,13 +548,24 @@ ListNode *crp_draw(ChineseRestaurant *cr, const int customer_index)
 void stand_customer(ChineseRestaurant *cr, const int customer_index)
 {
 	// If the customer is not already standing up, then stand the customer from their current table
-	if(cr->assigned_tables[customer_index] != NULL) {
-		Table *table = cr->assigned_tables[customer_index]->value;
+	if(cr->assigned_tables[customer_index] != NO_TABLE) {
+		Table *table = cr->tables[cr->assigned_tables[customer_index]];
+		cr->assigned_tables[customer_index] = NO_TABLE;
 		table->size -= 1;
 		if(table->size == 0) { // If the table is now empty, then mark it as such.
-			clear_empty_table(cr, cr->assigned_tables[customer_index]);
+#ifdef CRP_SPATIAL_INDEX
+			if(cr->index != NULL) {
+				kdtree_remove(cr->index, table);
+			}
+#endif
+			clear_empty_table(cr, table);
 		} else { // Otherwise, update table parameters to reflect the loss of a customer
-			table_update(table,customer_index, -1);
+			table_update(table, cr->customers[customer_index], -1);
+#ifdef CRP_SPATIAL_INDEX
+			if(cr->index != NULL) {
+				kdtree_update(cr, cr->index, table);
+			}
+#endif
 		}
 	}
 }
@@ -170,36 +575,59 @@ void stand_customer(ChineseRestaurant *cr, const int customer_index)
 /* Draws a new table for the customer to sit at using the CRP and updates the table hyperparameters accordingly */
 void seat_customer(ChineseRestaurant *cr, const int customer_index)
 {
-	Table *drawn_table;
-	ListNode *drawn_table_node =  crp_draw(cr,customer_index);
+	seat_customer_at(cr, customer_index, crp_draw(cr,customer_index));
+}
+
 
-	if(drawn_table_node != NULL) { // Seat customer at an existing table
-		cr->assigned_tables[customer_index] = drawn_table_node;
-		drawn_table = drawn_table_node->value;
-		drawn_table->size +=1;
+
+/* Seats customer at the given table, or at the next empty table if NULL, and returns the table */
+Table *seat_customer_at(ChineseRestaurant *cr, const int customer_index, Table *table)
+{
+#ifdef CRP_SPATIAL_INDEX
+	int opened = table == NULL;
+#endif
+	if(table != NULL) { // Seat customer at an existing table
+		table->size +=1;
 	} else { // Seat at an empty table
-		drawn_table = List_pop(cr->empty_tables);
-		drawn_table->size +=1;
-		List_push(cr->occupied_tables, drawn_table);
-		cr->assigned_tables[customer_index] = cr->occupied_tables->last;
+		table = next_available_table(cr);
+		List_pop(cr->empty_tables);
+		table->size +=1;
+		List_push(cr->occupied_tables, table);
+		table->node = cr->occupied_tables->last;
 	}
+	cr->assigned_tables[customer_index] = table->id;
 	// Update table parameters
-	table_update(drawn_table, customer_index, 1);
+	table_update(table, cr->customers[customer_index], 1);
+#ifdef CRP_SPATIAL_INDEX
+	if(cr->index != NULL) {
+		opened ? kdtree_add(cr, cr->index, table) : kdtree_update(cr, cr->index, table);
+	}
+#endif
+	return table;
 }
 
 
 
 /* Updates the table hyperparameters after a customer is add/removed from table */
-void table_update(Table *table, const int customer_index, const int sign)
+void table_update(Table *table, const double *customer, const int sign)
 {	
+	const int D = table->D;
+#ifdef CRP_LAZY_CHOLESKY
+	// Accumulate the sufficient statistics and defer the rest of the update to refresh_table
+	cblas_daxpy(D, sign, customer, 1, table->sum, 1);
+	cblas_dspr(CblasColMajor, CblasUpper, D, sign, customer, 1, table->scatter);
+	table->nu += sign;
+	table->kappa += sign;
+	table->stale = 1;
+#else
 	// Ψₒ =  Ψ + σ(κ/κₒ)(x-ξ)(x-ξ)'
 	double z[D];
-	memcpy(z,customers[customer_index],D*sizeof(double));				
+	memcpy(z,customer,D*sizeof(double));				
 	double p = table->kappa/(table->kappa + sign);
 	cblas_daxpy(D,-1,table->xi,1,z,1);
 	cblas_dscal(D, sqrt(p),z,1);
-	choldate(table->psi, z, sign);
-	table->logdetpsi = logdet(table->psi);
+	choldate(D, table->psi, z, sign);
+	table->logdetpsi = logdet(D, table->psi);
 
 	// νₒ = ν + σ 
 	table->nu += sign;
@@ -209,7 +637,108 @@ void table_update(Table *table, const int customer_index, const int sign)
 
 	// ξₒ = (κξ + σx)/κₒ
 	cblas_dscal(D, p,table->xi,1);
-	cblas_daxpy(D,sign/table->kappa,customers[customer_index],1,table->xi,1);
+	cblas_daxpy(D,sign/table->kappa,customer,1,table->xi,1);
+#ifdef CRP_FLOAT_SCORING
+	pack_table(table);
+#endif
+#endif
+}
+
+
+
+#ifdef CRP_LAZY_CHOLESKY
+/* Rebuilds the hyperparameters of a stale table from its sufficient statistics */
+void refresh_table(ChineseRestaurant *cr, Table *table)
+{
+	if(table->stale) {
+		niw_posterior(&cr->table_prior, cr->prior_scatter, table->size, table->sum, table->scatter, table);
+		table->stale = 0;
+#ifdef CRP_FLOAT_SCORING
+		pack_table(table);
+#endif
+	}
+}
+
+
+
+/* Recomputes the sufficient statistics of every occupied table from the table assignments */
+void refresh_statistics(ChineseRestaurant *cr)
+{
+	const int D = cr->D;
+	double **customers = cr->customers;
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		memset(table_i->sum, 0, D*sizeof(double));
+		memset(table_i->scatter, 0, (D*(D+1)/2)*sizeof(double));
+		table_i->stale = 1;
+	}
+	for(int j=0; j<cr->N; j++) {
+		if(cr->assigned_tables[j] != NO_TABLE) {
+			Table *table = cr->tables[cr->assigned_tables[j]];
+			cblas_daxpy(D, 1.0, customers[j], 1, table->sum, 1);
+			cblas_dspr(CblasColMajor, CblasUpper, D, 1.0, customers[j], 1, table->scatter);
+		}
+	}
+}
+#endif
+
+
+
+#ifdef CRP_FLOAT_SCORING
+/* Rebuilds the single precision scoring parameters from the table hyperparameters */
+void pack_table(Table *table)
+{
+	const int D = table->D;
+	for(int i=0; i<D; i++) {
+		table->xi_f[i] = table->xi[i];
+	}
+	for(int i=0; i<D*(D+1)/2; i++) {
+		table->psi_f[i] = table->psi[i];
+	}
+	// The constant terms of log_likelihood are summed in double and rounded once
+	table->shrink_f = table->kappa/(table->kappa + 1);
+	table->power_f = -0.5*(table->nu + 1);
+	table->lognorm_f = student_t(D, 0.5*(table->nu + 1), table->kappa/(table->kappa + 1), 0.0) - table->logdetpsi;
+}
+#endif
+
+
+
+/* Computes Ψ + κξξ' for the table's hyperparameters (uses packed upper triangular storage) */
+void niw_scatter(const Table *table, double *scatter)
+{
+	const int D = table->D;
+	// Ψ = U'U where U is the Cholesky factor stored in psi
+	for(int j=0; j<D; j++) {
+		for(int i=0; i<=j; i++) {
+			TRIU(scatter,i,j) = table->kappa*table->xi[i]*table->xi[j];
+			for(int k=0; k<=i; k++) {
+				TRIU(scatter,i,j) += TRIU(table->psi,k,i)*TRIU(table->psi,k,j);
+			}
+		}
+	}
+}
+
+
+
+/* Sets the table hyperparameters to the NIW posterior given (possibly weighted) sufficient statistics */
+void niw_posterior(const Table *prior, const double *prior_scatter, const double n, const double *sum, const double *scatter, Table *table)
+{
+	const int D = prior->D;
+	// κₒ = κ + n, νₒ = ν + n
+	table->kappa = prior->kappa + n;
+	table->nu = prior->nu + n;
+
+	// ξₒ = (κξ + Σx)/κₒ
+	memcpy(table->xi, sum, D*sizeof(double));
+	cblas_daxpy(D, prior->kappa, prior->xi, 1, table->xi, 1);
+	cblas_dscal(D, 1.0/table->kappa, table->xi, 1);
+
+	// Ψₒ = Ψ + κξξ' + Σxx' - κₒξₒξₒ'
+	memcpy(table->psi, prior_scatter, (D*(D+1)/2)*sizeof(double));
+	cblas_daxpy(D*(D+1)/2, 1.0, scatter, 1, table->psi, 1);
+	cblas_dspr(CblasColMajor, CblasUpper, D, -table->kappa, table->xi, 1, table->psi);
+	cholesky(D, table->psi);
+	table->logdetpsi = logdet(D, table->psi);
 }
 
 
@@ -217,12 +746,49 @@ void table_update(Table *table, const int customer_index, const int sign)
 /* Updates the table assignments in the restaurant */
 void update_table_assignments(ChineseRestaurant *cr)
 {
-	for(int i=0; i<N; i++) {
+	for(int i=0; i<cr->N; i++) {
 		// Stand the customer so we can reseat them
 		stand_customer(cr, i);
 		// Draw new table for the customer and seat them
 		seat_customer(cr, i);		
 	}
+	finish_sweep(cr);
+}
+
+
+
+/* Housekeeping once every customer has been reseated */
+void finish_sweep(ChineseRestaurant *cr)
+{
+	// Keep the table ids dense once enough tables have been emptied
+	if(List_count(cr->empty_tables) > COMPACT_RATIO*List_count(cr->occupied_tables)) {
+		compact_tables(cr);
+	}
+	cr->sweeps++;
+#ifdef CRP_LAZY_CHOLESKY
+	// Clear the rounding error accumulated by adding and removing customers
+	if(cr->sweeps % REFRESH_INTERVAL == 0) {
+		refresh_statistics(cr);
+	}
+#endif
+#ifdef CRP_SPATIAL_INDEX
+	// Rebuild the tree so that its bounds are tight again
+	if(cr->index != NULL) {
+		kdtree_destroy(cr->index);
+		cr->index = NULL;
+	}
+	if(List_count(cr->occupied_tables) >= INDEX_MIN_TABLES) {
+		cr->index = kdtree_build(cr);
+	}
+#endif
+}
+
+
+
+/* Appends the current table assignment of every customer to file */
+void export_assignments(ChineseRestaurant *cr, const char *filename)
+{
+	export_data(TABLE_ID_TYPE, cr->assigned_tables, cr->N, filename);
 }
 
 
@@ -230,8 +796,16 @@ void update_table_assignments(ChineseRestaurant *cr)
 /* Updates the concentration parameter */
 void update_alpha(ChineseRestaurant *cr)
 {
+	int k = List_count(cr->occupied_tables);
+#ifdef CRP_ESCOBAR_WEST_ALPHA
+	// The auxiliary variable update needs a proper conditional, which needs at least two tables
+	if(k > 1) {
+		cr->alpha = gibbs_sample_alpha(cr->rng, cr->alpha, k, cr->N);
+		return;
+	}
+#endif
 	// Slice sampling with slice width of 1.0
-	cr->alpha = slice_sample_alpha(cr->alpha, List_count(cr->occupied_tables), N, 1.0);
+	cr->alpha = slice_sample_alpha(cr->rng, cr->alpha, k, cr->N, 1.0, &cr->alpha_cache);
 }
 
 
@@ -239,23 +813,28 @@ void update_alpha(ChineseRestaurant *cr)
 /* Computes the log posterior predictive probability of a customer joining the table */
 double log_likelihood(Table *table, const double *customer)
 {
-	double result;
-	double z[D]; // tmp storage for the result of L⁻¹(x-ξ)
-	memcpy(z, customer, D*sizeof(double));
-	cblas_daxpy(D,-1.0,table->xi,1,z,1);
-	cblas_dtpsv(CblasColMajor,CblasUpper,CblasTrans,CblasNonUnit,D,table->psi,z,1);
-	result = -0.5*(table->nu+1)*log(1 +  cblas_ddot(D,z,1,z,1)*table->kappa/(table->kappa + 1));
-	result += lgamma( 0.5*(table->nu + 1) );
-    result -= lgamma( 0.5*(table->nu + 1 - D) );
-    result += 0.5*D * log( M_PI*(table->kappa/(table->kappa + 1)) );
-    result -= table->logdetpsi;
-    return result;
+	return student_t(table->D, 0.5*(table->nu + 1), table->kappa/(table->kappa + 1), mahalanobis(table, customer)) - table->logdetpsi;
 }
 
 
 
+#ifdef CRP_FLOAT_SCORING
+/* Single precision version of log_likelihood */
+float log_likelihood_f(const Table *table, const float *customer)
+{
+	const int D = table->D;
+	float z[D]; // tmp storage for the result of L⁻¹(x-ξ)
+	memcpy(z, customer, D*sizeof(float));
+	cblas_saxpy(D, -1.0f, table->xi_f, 1, z, 1);
+	cblas_stpsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, D, table->psi_f, z, 1);
+	return table->lognorm_f + table->power_f*log1pf(table->shrink_f*cblas_sdot(D, z, 1, z, 1));
+}
+#endif
+
+
+
 /* Updates/downdates the upper Cholesky factor U after a rank-1 modification. */
-void choldate(double *U, const double *x, const int sign)
+void choldate(const int D, double *U, const double *x, const int sign)
 {
 	double y[D];
     memcpy(y, x, D*sizeof(double));
@@ -276,9 +855,26 @@ void choldate(double *U, const double *x, const int sign)
 
 
 
+/* Overwrites the packed upper triangle of a positive definite matrix with its upper Cholesky factor. */
+void cholesky(const int D, double *A)
+{
+	double s;
+	for(int j=0; j<D; j++) {
+		for(int i=0; i<=j; i++) {
+			s = TRIU(A,i,j);
+			for(int k=0; k<i; k++) {
+				s -= TRIU(A,k,i)*TRIU(A,k,j);
+			}
+			TRIU(A,i,j) = (i == j) ? sqrt(s) : s/TRIU(A,i,i);
+		}
+	}
+}
+
+
+
 /* Computes the logarithm of the determinant for an upper packed triangular matrix U. */
 /* This is simply the sum of the logarithms of the diagonal entries. */
-double logdet(const double *U)
+double logdet(const int D, const double *U)
 {
     double result = 0;
     int i;
@@ -312,6 +908,7 @@ void posterior_predictive_surface(ChineseRestaurant *cr, const int nx, const dou
 			x[0] = xgrid[i];
 			output[i] = (cr->alpha/(cr->alpha + cr->occupied_tables->count)) * exp(log_likelihood(empty_table, x));
 			LIST_ENUMERATE(cr->occupied_tables, k, node_k, table_k) {
+				refresh_table(cr, table_k);
 				output[i] += (table_k->size/(cr->alpha + cr->occupied_tables->count)) * exp(log_likelihood(table_k, x));
 			}
 		}
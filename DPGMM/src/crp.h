@@ -1,7 +1,44 @@
 #ifndef _CRP_H
 #define _CRP_H
 
+#include <stdint.h> /* uint16_t, uint32_t */
 #include "list/list.h" /* List and ListNode structs */
+#include "utils/utils.h" /* TYPE */
+#include "random/random.h" /* Rng */
+#include "slicesample/slicesample.h" /* AlphaCache */
+
+/*
+ * Table identifiers. Customers are mapped to the id of their table rather than
+ * to a pointer, so the assignment vector is dense and can be exported directly.
+ * Compile with -DCRP_SMALL_TABLE_IDS to halve its size when K stays below 65535.
+ */
+#ifdef CRP_SMALL_TABLE_IDS
+typedef uint16_t table_id;
+#define NO_TABLE UINT16_MAX /* Marks a customer who is not seated */
+#define TABLE_ID_TYPE UINT16 /* export_data type of a table id */
+#else
+typedef uint32_t table_id;
+#define NO_TABLE UINT32_MAX
+#define TABLE_ID_TYPE UINT32
+#endif
+
+/*
+ * Precision of the table scores. Compile with -DCRP_FLOAT_SCORING to keep a single
+ * precision copy of the scoring parameters of each table and to score customers in
+ * float. Sufficient statistics and Cholesky updates stay in double. Compile with
+ * -DCRP_VALIDATE_FLOAT to also score every customer in double and record how far
+ * the two sets of draw probabilities diverge.
+ */
+#if defined(CRP_VALIDATE_FLOAT) && !defined(CRP_FLOAT_SCORING)
+#define CRP_FLOAT_SCORING
+#endif
+
+/*
+ * Compile with -DCRP_SPATIAL_INDEX to keep a kd-tree over the table locations once there
+ * are many tables, so that crp_draw only scores the tables a customer could plausibly
+ * join (see src/kdtree/). The error this introduces is set by prune_tolerance.
+ */
+struct KdTree;
 
 /* 
  * Returns the ijth element of the upper packed triangular matrix A
@@ -11,22 +48,63 @@
 
 /* Table struct */
 typedef struct Table {
+	table_id id; // Index of the table in the restaurant's table array
+	ListNode *node; // Node holding the table in either the occupied or empty list
+	unsigned int refs; // Number of restaurants sharing the table. Shared tables are copied before they are modified.
 	unsigned int size; // Number of customers at the table
+	int D; // Dimensionality of data
 	/* Normal-inverse-Wishart hyperparameters */
 	double *xi; // Location
 	double kappa; // Precision scale factor
 	double nu;	// Degrees of freedom
 	double *psi; // Right Cholesky factor of inverse scale matrix (uses packed upper triangular storage)
 	double logdetpsi; // Log determinant of the Cholesky factor
+#ifdef CRP_LAZY_CHOLESKY
+	/* Sufficient statistics. xi, psi and logdetpsi are rebuilt from these when the table is next scored. */
+	double *sum; // Sum of the customers at the table
+	double *scatter; // Sum of the outer products of the customers (uses packed upper triangular storage)
+	int stale; // Nonzero if xi, psi and logdetpsi are out of date
+#endif
+#ifdef CRP_FLOAT_SCORING
+	/* Single precision scoring parameters. Rebuilt by pack_table whenever the hyperparameters change. */
+	float *xi_f; // Location
+	float *psi_f; // Cholesky factor of the inverse scale matrix (uses packed upper triangular storage)
+	float shrink_f; // κ/(κ+1)
+	float power_f; // -(ν+1)/2
+	float lognorm_f; // Terms of the log predictive that do not depend on the customer
+#endif
+#ifdef CRP_SPATIAL_INDEX
+	int slot; // Position of the table in the kd-tree, or -1 if the table is not in the tree
+#endif
 } Table;
 
 /* Chinese restaurant object */
 typedef struct ChineseRestaurant {
+	int N; /* Number of customers */
+	int D; /* Dimensionality of data */
+	double **customers; /* Customers stored as an N by D array. Owned by the restaurant. */
+	Rng *rng; /* Random number generator. Not owned, and may be shared by restaurants used on one thread. */
 	double alpha; /* Concentration parameter */
+	AlphaCache alpha_cache; /* Saves lgamma evaluations between slice sampling updates of alpha */
 	Table table_prior; /* Table struct containing prior hyperparameters */
-	ListNode **assigned_tables; /* Maps customers to their table. Stores list node ptrs rather than table ptrs to allow list node removal without search. */
+	double *prior_scatter; /* Ψ + κξξ' for the prior hyperparameters (uses packed upper triangular storage) */
+	unsigned int sweeps; /* Number of completed sweeps over the customers */
+	table_id *assigned_tables; /* Maps customers to the id of their table. NO_TABLE marks a standing customer. */
+	Table **tables; /* Maps table ids to tables */
+	unsigned int num_tables; /* Number of table ids in use, i.e. occupied plus empty tables */
+	unsigned int table_capacity; /* Allocated length of the tables array */
 	List *occupied_tables; /* Linked list of non-empty tables */
-	List *empty_tables; /* Linked list of empty tables */
+	List *empty_tables; /* Linked list of empty tables. Their ids are recycled by next_available_table. */
+#ifdef CRP_VALIDATE_FLOAT
+	unsigned long validated_scores; /* Number of customers scored in both precisions */
+	double sum_tv; /* Summed total variation distance between the float and double draw probabilities */
+	double max_tv; /* Largest total variation distance */
+	double max_logp_error; /* Largest error in an unnormalised log probability */
+#endif
+#ifdef CRP_SPATIAL_INDEX
+	struct KdTree *index; /* kd-tree over the occupied tables, or NULL while there are few of them */
+	double prune_tolerance; /* Largest total variation distance between the pruned and exact draw probabilities */
+#endif
 } ChineseRestaurant;
 
 /* Iterates over both the elements and their value in a list using an index. */
@@ -38,14 +116,32 @@ typedef struct ChineseRestaurant {
     INDEX < LIST->count;\
     INDEX++, NODE = NODE->next, VALUE = Node_value(NODE))
 
-/* Initialises Chinese restaurant processs */
-ChineseRestaurant *crp_init(const char* filename, const double alpha, const double xi[], const double kappa, const double nu, const double psi[]);
+/* Initialises Chinese restaurant processs with a copy of the N by D data array (row major) */
+ChineseRestaurant *crp_init(const double *data, const int N, const int D, Rng *rng, const double alpha, const double xi[], const double kappa, const double nu, const double psi[]);
+
+/* Creates a restaurant with no customers and no tables */
+ChineseRestaurant *crp_create(const int D, Rng *rng, const double alpha, const double xi[], const double kappa, const double nu, const double psi[]);
+
+/* Frees the restaurant, its customers and the tables no other restaurant holds */
+void crp_destroy(ChineseRestaurant *cr);
 
 /* Adds a new empty table and assigns it the prior hyperparameters*/
 void add_new_table(ChineseRestaurant *cr);
 
+/* Allocates an empty table with the prior hyperparameters. It is not added to any restaurant. */
+Table *new_table(const Table *prior);
+
+/* Returns an unshared copy of the table and its hyperparameters */
+Table *copy_table(const Table *table);
+
+/* Frees a table and its hyperparameters */
+void destroy_table(Table *table);
+
 /* Resets the table parameters to the prior hyperparameters */
-void clear_empty_table(ChineseRestaurant *cr, ListNode *tablenode);
+void clear_empty_table(ChineseRestaurant *cr, Table *table);
+
+/* Relabels the occupied tables 0,...,K-1 and frees surplus empty tables */
+void compact_tables(ChineseRestaurant *cr);
 
 /* Returns a pointer to the next empty table in the restaurant */
 Table *next_available_table(ChineseRestaurant *cr);
@@ -53,29 +149,84 @@ Table *next_available_table(ChineseRestaurant *cr);
 /* Seats customer at the given table and updates the table hyperparameters accordingly */
 void stand_customer(ChineseRestaurant *cr, const int customer_index);
 
-/* Draws a table using CRP */
-ListNode *crp_draw(ChineseRestaurant *cr, const int customer_index);
+/* Draws a table using CRP. Returns NULL if an empty table was drawn. */
+Table *crp_draw(ChineseRestaurant *cr, const int customer_index);
+
+/* 
+ * Scores a customer against every table. logp[j] is the unnormalised log probability of
+ * sitting at occupied table j, and logp[k] that of sitting at an empty table.
+ * Returns the log normalising constant. Does not touch the random number generator.
+ */
+double crp_log_predictive(ChineseRestaurant *cr, const double *customer, double *logp);
+
+/* Log posterior predictive density of a customer, given the logZ that crp_log_predictive returned for them */
+double crp_log_density(const ChineseRestaurant *cr, const double logZ);
+
+/* Draws j in 0,...,k from the probabilities exp(logp[j] - logZ). k stands for an empty table. */
+int crp_sample(Rng *rng, const double *logp, const int k, const double logZ);
 
 /* Removes customer from their current table and updates the table hyperparameters accordingly */
 void seat_customer(ChineseRestaurant *cr, const int customer_index);
 
+/* Seats customer at the given table, or at the next empty table if NULL, and returns the table */
+Table *seat_customer_at(ChineseRestaurant *cr, const int customer_index, Table *table);
+
 /* Updates the table hyperparameters after a customer is added/removed from table */
-void table_update(Table *table, const int customer_index, const int sign);
+void table_update(Table *table, const double *customer, const int sign);
 
 /* Computes the (unnormalised) conditional log likelihood of a customer joining the table */
 double log_likelihood(Table *table, const double *customer);
 
+#ifdef CRP_FLOAT_SCORING
+/* Rebuilds the single precision scoring parameters from the table hyperparameters */
+void pack_table(Table *table);
+
+/* Single precision version of log_likelihood */
+float log_likelihood_f(const Table *table, const float *customer);
+#endif
+
+#ifdef CRP_VALIDATE_FLOAT
+/* Prints how far the float draw probabilities have diverged from the double ones */
+void report_float_divergence(const ChineseRestaurant *cr);
+#endif
+
+/* Computes Ψ + κξξ' for the table's hyperparameters (uses packed upper triangular storage) */
+void niw_scatter(const Table *table, double *scatter);
+
+/* Sets the table hyperparameters to the NIW posterior given (possibly weighted) sufficient statistics */
+void niw_posterior(const Table *prior, const double *prior_scatter, const double n, const double *sum, const double *scatter, Table *table);
+
+#ifdef CRP_LAZY_CHOLESKY
+/* Rebuilds the hyperparameters of a stale table from its sufficient statistics */
+void refresh_table(ChineseRestaurant *cr, Table *table);
+
+/* Recomputes the sufficient statistics of every occupied table from the table assignments */
+void refresh_statistics(ChineseRestaurant *cr);
+#else
+/* Table hyperparameters are always up to date when they are updated eagerly */
+#define refresh_table(cr, table)
+#endif
+
 /* Updates the table assignments in the restaurant */
 void update_table_assignments(ChineseRestaurant *cr);
 
+/* Housekeeping once every customer has been reseated */
+void finish_sweep(ChineseRestaurant *cr);
+
+/* Appends the current table assignment of every customer to file */
+void export_assignments(ChineseRestaurant *cr, const char *filename);
+
 /* Updates the concentration parameter */
 void update_alpha(ChineseRestaurant *cr);
 
 /* Updates/downdates the upper Cholesky factor U after a rank-1 modification. */
-void choldate(double *U, const double *x, const int sign);
+void choldate(const int D, double *U, const double *x, const int sign);
+
+/* Overwrites the packed upper triangle of a positive definite matrix with its upper Cholesky factor. */
+void cholesky(const int D, double *A);
 
 /* Computes the logarithm of the determinant for an upper packed triangular matrix U. */
-double logdet(const double *U);
+double logdet(const int D, const double *U);
 
 /* Evenly spaced numbers over a specified interval. */
 void linspace(const double start, const double stop, const int num, double *output);
@@ -0,0 +1,102 @@
+#include "dpgmm.h"
+#include <stdlib.h> // calloc, malloc, free
+#include "../crp.h" // crp_init, crp_destroy, update_table_assignments, update_alpha, crp_log_predictive, crp_log_density
+#include "../random/random.h" // Rng, seed_rng_stream, RNG_DEFAULT
+
+/* Model state */
+struct DPGMM {
+	Rng rng; /* Random number generator used only by this model */
+	ChineseRestaurant *cr; /* Restaurant holding the data and table assignments */
+};
+
+
+
+/* Creates a model for a copy of the N by D data array (row major) */
+DPGMM *dpgmm_create(const double *data, const int N, const int D, const double alpha, const double xi[], const double kappa, const double nu, const double psi[], const uint32_t seed)
+{
+	// seed_rng uses stream 0 of the default generator
+	return dpgmm_create_stream(data, N, D, alpha, xi, kappa, nu, psi, seed, 0);
+}
+
+
+
+/* Creates a model like dpgmm_create whose random numbers are stream number stream of the seed */
+DPGMM *dpgmm_create_stream(const double *data, const int N, const int D, const double alpha, const double xi[], const double kappa, const double nu, const double psi[], const uint64_t seed, const uint64_t stream)
+{
+	DPGMM *model = calloc(1, sizeof(DPGMM));
+	seed_rng_stream(&model->rng, RNG_DEFAULT, seed, stream);
+	model->cr = crp_init(data, N, D, &model->rng, alpha, xi, kappa, nu, psi);
+	return model;
+}
+
+
+
+/* Frees the model */
+void dpgmm_destroy(DPGMM *model)
+{
+	crp_destroy(model->cr);
+	free(model);
+}
+
+
+
+/* Performs the given number of sweeps, each followed by an update of the concentration parameter */
+void dpgmm_step(DPGMM *model, const int sweeps)
+{
+	for(int i=0; i<sweeps; i++) {
+		update_table_assignments(model->cr);
+		update_alpha(model->cr);
+	}
+}
+
+
+
+/* Number of occupied tables */
+int dpgmm_num_clusters(const DPGMM *model)
+{
+	return List_count(model->cr->occupied_tables);
+}
+
+
+
+/* Concentration parameter */
+double dpgmm_alpha(const DPGMM *model)
+{
+	return model->cr->alpha;
+}
+
+
+
+/* Writes the size of each cluster to sizes, which must hold dpgmm_num_clusters entries */
+void dpgmm_cluster_sizes(const DPGMM *model, unsigned int *sizes)
+{
+	LIST_ENUMERATE(model->cr->occupied_tables, i, node_i, table_i) {
+		sizes[i] = table_i->size;
+	}
+}
+
+
+
+/* Writes the cluster of each data point to labels, using the order of dpgmm_cluster_sizes */
+void dpgmm_assignments(const DPGMM *model, int *labels)
+{
+	ChineseRestaurant *cr = model->cr;
+	int *position = malloc(cr->num_tables*sizeof(int)); // Maps table ids to positions in the occupied list
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		position[table_i->id] = i;
+	}
+	for(int j=0; j<cr->N; j++) {
+		labels[j] = cr->assigned_tables[j] != NO_TABLE ? position[cr->assigned_tables[j]] : -1;
+	}
+	free(position);
+}
+
+
+
+/* Log posterior predictive density of a point given the current state */
+double dpgmm_log_predictive(DPGMM *model, const double *x)
+{
+	ChineseRestaurant *cr = model->cr;
+	double logp[List_count(cr->occupied_tables)+1];
+	return crp_log_density(cr, crp_log_predictive(cr, x, logp));
+}
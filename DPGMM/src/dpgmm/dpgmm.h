@@ -0,0 +1,51 @@
+#ifndef _DPGMM_H
+#define _DPGMM_H
+
+#include <stdint.h> /* uint32_t, uint64_t */
+
+/*
+ * Embeddable DPGMM sampler.
+ *
+ * A model owns a copy of its data, its restaurant and its random number generator, so
+ * any number of models can be used in one process. A model is not safe to use from two
+ * threads at once, but different models can be stepped concurrently.
+ */
+
+/* Opaque model handle */
+typedef struct DPGMM DPGMM;
+
+/* 
+ * Creates a model for a copy of the N by D data array (row major). xi, kappa, nu and psi
+ * are the NIW prior hyperparameters, with psi the packed upper Cholesky factor of Ψ.
+ */
+DPGMM *dpgmm_create(const double *data, const int N, const int D, const double alpha, const double xi[], const double kappa, const double nu, const double psi[], const uint32_t seed);
+
+/*
+ * Creates a model like dpgmm_create whose random numbers are stream number stream of the
+ * seed (see seed_rng_stream). Models created from one seed with different streams have
+ * independent generators. dpgmm_create uses stream 0.
+ */
+DPGMM *dpgmm_create_stream(const double *data, const int N, const int D, const double alpha, const double xi[], const double kappa, const double nu, const double psi[], const uint64_t seed, const uint64_t stream);
+
+/* Frees the model */
+void dpgmm_destroy(DPGMM *model);
+
+/* Performs the given number of sweeps, each followed by an update of the concentration parameter */
+void dpgmm_step(DPGMM *model, const int sweeps);
+
+/* Number of occupied tables */
+int dpgmm_num_clusters(const DPGMM *model);
+
+/* Concentration parameter */
+double dpgmm_alpha(const DPGMM *model);
+
+/* Writes the size of each cluster to sizes, which must hold dpgmm_num_clusters entries */
+void dpgmm_cluster_sizes(const DPGMM *model, unsigned int *sizes);
+
+/* Writes the cluster of each data point to labels, using the order of dpgmm_cluster_sizes */
+void dpgmm_assignments(const DPGMM *model, int *labels);
+
+/* Log posterior predictive density of a point given the current state */
+double dpgmm_log_predictive(DPGMM *model, const double *x);
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef _FASTMATH_H
+#define _FASTMATH_H
+
+#include <stdint.h> /* uint64_t, int64_t */
+#include <string.h> /* memcpy */
+#include <math.h> /* INFINITY */
+
+/*
+ * Polynomial approximations of the transcendental functions in the scoring loop.
+ *
+ * The functions are branch free apart from selects, so loops over arrays of arguments
+ * can be vectorised when the target has SIMD instructions (e.g. -O3 -march=native). They
+ * do not set errno and do not handle NaN. The error bounds below are in ulps of
+ * max(|f(x)|, 1) and were measured against long double libm over dense sweeps of
+ * 10⁸ or more arguments of each function. fastmath_test.c checks them.
+ *
+ *   fast_exp     x in [-708, 709]         at most 1 ulp. Returns 0 below -708 and ∞ above 709.
+ *   fast_log     x positive and normal    at most 2 ulp.
+ *   fast_log1p   x > -1                   at most 2 ulp.
+ *   fast_lgamma  x >= 10                  below 3 ulp, largest just above 10 where the
+ *                                         error of fast_log is amplified the most.
+ *                x in (0, 10)             absolute error at most 9e-15. The relative error
+ *                                         grows near the roots of lgamma at 1 and 2.
+ *
+ * Compile with -DCRP_FAST_MATH to use them in crp.c.
+ */
+
+#define FAST_EXP_MIN -708.0 /* Below this fast_exp underflows to zero */
+#define FAST_EXP_MAX 709.0 /* Above this fast_exp overflows to infinity */
+#define FAST_LGAMMA_SHIFT 10.0 /* Smaller arguments are shifted up before the Stirling series is used */
+
+/* Reinterprets the bits of a double as an integer and back */
+static inline uint64_t fast_bits(const double x)
+{
+	uint64_t i;
+	memcpy(&i, &x, sizeof(double));
+	return i;
+}
+
+static inline double fast_double(const uint64_t i)
+{
+	double x;
+	memcpy(&x, &i, sizeof(double));
+	return x;
+}
+
+
+
+/* exp(x) = 2ⁿexp(r) with n = round(x/log 2) and |r| <= (log 2)/2 */
+static inline double fast_exp(const double x)
+{
+	const double shifter = 0x1.8p52; // Adding this rounds to an integer held in the low bits of the mantissa
+	double xc = x < FAST_EXP_MIN ? FAST_EXP_MIN : (x > FAST_EXP_MAX ? FAST_EXP_MAX : x);
+	double t = xc*0x1.71547652b82fep0 + shifter; // x/log 2
+	double n = t - shifter;
+	// log 2 is split so that n*log2_hi is exact
+	double r = xc - n*0x1.62e42fee00000p-1;
+	r -= n*0x1.a39ef35793c76p-33;
+	// Taylor series of exp(r) to degree 13. The remainder is below 2⁻⁵⁴ for |r| <= (log 2)/2.
+	double p = 1.0/6227020800.0;
+	p = p*r + 1.0/479001600.0;
+	p = p*r + 1.0/39916800.0;
+	p = p*r + 1.0/3628800.0;
+	p = p*r + 1.0/362880.0;
+	p = p*r + 1.0/40320.0;
+	p = p*r + 1.0/5040.0;
+	p = p*r + 1.0/720.0;
+	p = p*r + 1.0/120.0;
+	p = p*r + 1.0/24.0;
+	p = p*r + 1.0/6.0;
+	p = p*r + 0.5;
+	p = p*r*r + r;
+	p += 1.0;
+	// Build 2ⁿ directly from its exponent bits
+	uint64_t scale = (fast_bits(t) + 1023) << 52;
+	double result = p*fast_double(scale);
+	return x < FAST_EXP_MIN ? 0.0 : (x > FAST_EXP_MAX ? INFINITY : result);
+}
+
+
+
+/* log(x) = e log 2 + log(m) with x = 2ᵉm and m in [√½, √2) */
+static inline double fast_log(const double x)
+{
+	uint64_t bits = fast_bits(x);
+	int64_t e = (int64_t)((bits >> 52) & 0x7ff) - 1023;
+	double m = fast_double((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL); // m in [1,2)
+	int64_t big = m > 0x1.6a09e667f3bcdp0; // m > √2
+	m = big ? 0.5*m : m;
+	e += big;
+	// log(m) = 2 atanh(s) = 2(s + s³/3 + s⁵/5 + ...) with s = (m-1)/(m+1) and |s| <= 0.1716
+	double f = m - 1.0;
+	double s = f/(m + 1.0);
+	double s2 = s*s;
+	double p = 2.0/19.0;
+	p = p*s2 + 2.0/17.0;
+	p = p*s2 + 2.0/15.0;
+	p = p*s2 + 2.0/13.0;
+	p = p*s2 + 2.0/11.0;
+	p = p*s2 + 2.0/9.0;
+	p = p*s2 + 2.0/7.0;
+	p = p*s2 + 2.0/5.0;
+	p = p*s2 + 2.0/3.0;
+	// 2s = f - sf is written this way so that the leading term carries no rounding error
+	double logm = f - s*f + s*s2*p;
+	return e*0x1.62e42fee00000p-1 + (logm + e*0x1.a39ef35793c76p-33);
+}
+
+
+
+/* log(1+x) corrected for the rounding error in 1+x. When 1+x rounds to 1 this returns x. */
+static inline double fast_log1p(const double x)
+{
+	double w = 1.0 + x;
+	double c = (w - 1.0) - x; // Rounding error in w
+	return fast_log(w) - c/w;
+}
+
+
+
+/* Stirling series for lgamma(x). Arguments below FAST_LGAMMA_SHIFT use lgamma(x) = lgamma(x+n) - log(x(x+1)...(x+n-1)). */
+static inline double fast_lgamma(double x)
+{
+	// The shift is written as a fixed number of selects so that the function stays branch free
+	double prod = 1.0;
+	for(int i=0; i<(int)FAST_LGAMMA_SHIFT; i++) {
+		int shift = x < FAST_LGAMMA_SHIFT;
+		prod = shift ? prod*x : prod;
+		x = shift ? x + 1.0 : x;
+	}
+	double y = 1.0/x;
+	double y2 = y*y;
+	// Bernoulli terms B₂ₖ/(2k(2k-1)x²ᵏ⁻¹) up to k = 7
+	double p = 1.0/156.0;
+	p = -p*y2 + 691.0/360360.0;
+	p = -p*y2 + 1.0/1188.0;
+	p = -p*y2 + 1.0/1680.0;
+	p = -p*y2 + 1.0/1260.0;
+	p = -p*y2 + 1.0/360.0;
+	p = -p*y2 + 1.0/12.0;
+	// (x - 1/2)log x - x + log(2π)/2, written so that x is not subtracted from a larger product
+	double result = (x - 0.5)*(fast_log(x) - 1.0) + (0x1.d67f1c864beb5p-1 - 0.5) + p*y;
+	return result - fast_log(prod);
+}
+
+#endif
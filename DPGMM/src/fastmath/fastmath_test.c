@@ -0,0 +1,79 @@
+#include "../list/minunit.h"
+#include "fastmath.h"
+#include <math.h>
+
+// The bounds documented in fastmath.h, in ulps of max(|f(x)|, 1)
+#define EXP_ULP 1.0
+#define LOG_ULP 2.0
+#define LOG1P_ULP 2.0
+#define LGAMMA_ULP 3.0
+#define LGAMMA_SMALL_ABS 9e-15 // Absolute error of fast_lgamma below FAST_LGAMMA_SHIFT
+
+
+/* Error of y in ulps of max(|f(x)|, 1), with f(x) computed in long double */
+static double ulps(const double y, const long double ref)
+{
+    double scale = fabs((double)ref) > 1 ? fabs((double)ref) : 1;
+    return (double)fabsl((long double)y - ref)/(nextafter(scale, INFINITY) - scale);
+}
+
+
+char *test_exp()
+{
+    for(double x = FAST_EXP_MIN; x < FAST_EXP_MAX; x += 1.3e-4) {
+        mu_assert(ulps(fast_exp(x), expl(x)) <= EXP_ULP, "fast_exp exceeds its error bound.");
+    }
+
+    return NULL;
+}
+
+
+char *test_log()
+{
+    for(double x = 1e-300; x < 1e300; x *= 1 + 3e-5) {
+        mu_assert(ulps(fast_log(x), logl(x)) <= LOG_ULP, "fast_log exceeds its error bound.");
+    }
+    for(double x = 0.5; x < 2; x += 1e-7) {
+        mu_assert(ulps(fast_log(x), logl(x)) <= LOG_ULP, "fast_log exceeds its error bound near 1.");
+    }
+
+    return NULL;
+}
+
+
+char *test_log1p()
+{
+    for(double x = -1 + 1e-12; x < 1; x += 1e-7*(1 + fabs(x))) {
+        mu_assert(ulps(fast_log1p(x), log1pl(x)) <= LOG1P_ULP, "fast_log1p exceeds its error bound.");
+    }
+    for(double x = 1; x < 1e300; x *= 1 + 3e-5) {
+        mu_assert(ulps(fast_log1p(x), log1pl(x)) <= LOG1P_ULP, "fast_log1p exceeds its error bound.");
+    }
+
+    return NULL;
+}
+
+
+char *test_lgamma()
+{
+    for(double x = FAST_LGAMMA_SHIFT; x < 1e7; x *= 1 + 1e-6) {
+        mu_assert(ulps(fast_lgamma(x), lgammal(x)) < LGAMMA_ULP, "fast_lgamma exceeds its error bound.");
+    }
+    for(double x = 1e-3; x < FAST_LGAMMA_SHIFT; x += 1e-6) {
+        mu_assert(fabsl((long double)fast_lgamma(x) - lgammal(x)) <= LGAMMA_SMALL_ABS, "fast_lgamma exceeds its absolute error bound below the shift.");
+    }
+
+    return NULL;
+}
+
+char *all_tests() {
+    mu_suite_start();
+    mu_run_test(test_exp);
+    mu_run_test(test_log);
+    mu_run_test(test_log1p);
+    mu_run_test(test_lgamma);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
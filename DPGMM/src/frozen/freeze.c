@@ -0,0 +1,114 @@
+#include "frozen.h"
+#include <Accelerate/Accelerate.h> // cblas_dtpsv
+#include <math.h> // log, sqrt, lgamma, M_PI
+#include <stdio.h> // fopen, fwrite, fclose, fprintf
+#include <stdlib.h> // calloc, realloc, exit
+#include <string.h> // memcpy, memset
+
+
+
+/* Creates an empty posterior in memory */
+FrozenPosterior *frozen_create(const int D)
+{
+	FrozenPosterior *fp = calloc(1, sizeof(FrozenPosterior));
+	fp->D = D;
+	fp->draw_start = calloc(1, sizeof(uint64_t));
+	return fp;
+}
+
+
+
+/* Stores the predictive of a table with mixture weight w as component k */
+static void freeze_component(FrozenPosterior *fp, const long k, const Table *table, const double w)
+{
+	const int D = fp->D;
+	double *L = &fp->factors[k*D*D];
+	double z[D];
+	double s = table->kappa/(table->kappa + 1);
+
+	// Columns of U'⁻¹, scaled by √s, stored row major
+	for(int j=0; j<D; j++) {
+		memset(z, 0, D*sizeof(double));
+		z[j] = 1;
+		cblas_dtpsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, D, table->psi, z, 1);
+		for(int i=0; i<D; i++) {
+			L[i*D+j] = sqrt(s)*z[i];
+		}
+	}
+	for(int i=0; i<D; i++) {
+		fp->shift[k*D+i] = 0;
+		for(int j=0; j<D; j++) {
+			fp->shift[k*D+i] += L[i*D+j]*table->xi[j];
+		}
+	}
+
+	// Normalised multivariate t density with ν+1-D degrees of freedom
+	fp->coef[2*k] = log(w) + lgamma(0.5*(table->nu + 1)) - lgamma(0.5*(table->nu + 1 - D)) + 0.5*D*log(s/M_PI) - table->logdetpsi;
+	fp->coef[2*k+1] = -0.5*(table->nu + 1);
+}
+
+
+
+/* Appends the current state of the restaurant as a posterior draw */
+void frozen_add_draw(FrozenPosterior *fp, ChineseRestaurant *cr)
+{
+	const int D = fp->D;
+	long K = List_count(cr->occupied_tables) + 1;
+	long k = fp->num_components;
+	if(k + K > fp->capacity) {
+		fp->capacity = 2*(k + K);
+		fp->coef = realloc(fp->coef, 2*fp->capacity*sizeof(double));
+		fp->shift = realloc(fp->shift, fp->capacity*D*sizeof(double));
+		fp->factors = realloc(fp->factors, fp->capacity*D*D*sizeof(double));
+	}
+
+	double n = 0;
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		n += table_i->size;
+	}
+	LIST_ENUMERATE(cr->occupied_tables, j, node_j, table_j) {
+		refresh_table(cr, table_j);
+		freeze_component(fp, k++, table_j, table_j->size/(cr->alpha + n));
+	}
+	freeze_component(fp, k++, &cr->table_prior, cr->alpha/(cr->alpha + n));
+
+	fp->num_components = k;
+	if(K > fp->max_components) {
+		fp->max_components = K;
+	}
+	fp->num_draws++;
+	fp->draw_start = realloc(fp->draw_start, (fp->num_draws+1)*sizeof(uint64_t));
+	fp->draw_start[fp->num_draws] = k;
+}
+
+
+
+/* Writes the posterior to an artifact */
+void frozen_save(const FrozenPosterior *fp, const char *filename)
+{
+	FILE *file = fopen(filename, "wb");
+	if(file == NULL) {
+		fprintf(stderr, "Could not open %s for writing.\n", filename);
+		exit(1);
+	}
+	FrozenHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FROZEN_MAGIC, sizeof(header.magic));
+	header.version = FROZEN_VERSION;
+	header.D = fp->D;
+	header.num_draws = fp->num_draws;
+	header.num_components = fp->num_components;
+	header.max_components = fp->max_components;
+
+	const long K = fp->num_components;
+	const int D = fp->D;
+	if(fwrite(&header, sizeof(header), 1, file) != 1
+		|| fwrite(fp->draw_start, sizeof(uint64_t), fp->num_draws+1, file) != (size_t)fp->num_draws+1
+		|| fwrite(fp->coef, sizeof(double), 2*K, file) != (size_t)(2*K)
+		|| fwrite(fp->shift, sizeof(double), K*D, file) != (size_t)(K*D)
+		|| fwrite(fp->factors, sizeof(double), K*D*D, file) != (size_t)(K*D*D)) {
+		fprintf(stderr, "Could not write %s.\n", filename);
+		exit(1);
+	}
+	fclose(file);
+}
@@ -0,0 +1,217 @@
+#include "frozen.h"
+#include <Accelerate/Accelerate.h> // cblas_dgemm
+#include <math.h> // log, log1p, exp, INFINITY
+#include <stdio.h> // fprintf
+#include <stdlib.h> // calloc, malloc, free, exit
+#include <string.h> // memcmp, memset
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close
+
+
+
+/* Maps an artifact into memory. Exits if it is invalid or holds no draws. */
+FrozenPosterior *frozen_load(const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Could not open %s.\n", filename);
+		exit(1);
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED || (size_t)st.st_size < sizeof(FrozenHeader)) {
+		fprintf(stderr, "Could not map %s.\n", filename);
+		exit(1);
+	}
+
+	const FrozenHeader *header = map;
+	if(memcmp(header->magic, FROZEN_MAGIC, sizeof(header->magic)) != 0 || header->version != FROZEN_VERSION) {
+		fprintf(stderr, "%s is not a version %d frozen posterior.\n", filename, FROZEN_VERSION);
+		exit(1);
+	}
+	const long K = header->num_components;
+	const int D = header->D;
+	size_t expected = sizeof(FrozenHeader) + (header->num_draws+1)*sizeof(uint64_t) + K*(2 + D + D*D)*sizeof(double);
+	if((size_t)st.st_size != expected) {
+		fprintf(stderr, "%s is truncated.\n", filename);
+		exit(1);
+	}
+	if(header->num_draws == 0) {
+		fprintf(stderr, "%s holds no draws.\n", filename);
+		exit(1);
+	}
+
+	FrozenPosterior *fp = calloc(1, sizeof(FrozenPosterior));
+	fp->D = D;
+	fp->num_draws = header->num_draws;
+	fp->num_components = K;
+	fp->max_components = header->max_components;
+	fp->draw_start = (uint64_t *)(header + 1);
+	fp->coef = (double *)(fp->draw_start + fp->num_draws + 1);
+	fp->shift = fp->coef + 2*K;
+	fp->factors = fp->shift + K*D;
+	fp->map = map;
+	fp->map_size = st.st_size;
+	return fp;
+}
+
+
+
+/* Unmaps or frees the posterior */
+void frozen_destroy(FrozenPosterior *fp)
+{
+	if(fp->map != NULL) {
+		munmap(fp->map, fp->map_size);
+	} else {
+		free(fp->draw_start);
+		free(fp->coef);
+		free(fp->shift);
+		free(fp->factors);
+	}
+	free(fp);
+}
+
+
+
+/* Batch of points handed to the thread pool */
+typedef struct ScoreJob {
+	const FrozenPosterior *fp;
+	const double *X; /* Points (n by D, row major) */
+	long n; /* Number of points */
+	long draw; /* Draw used for membership probabilities */
+	double *output; /* logp or probs */
+} ScoreJob;
+
+
+
+/* 
+ * Computes the component log densities of B points under draw s. Y is scratch space of
+ * length K*D*B, and logp[k*B+b] receives the log density of point b under component k.
+ */
+static void draw_log_densities(const FrozenPosterior *fp, const long s, const double *X, const int B, double *Y, double *logp)
+{
+	const int D = fp->D;
+	const long k0 = fp->draw_start[s];
+	const long K = frozen_draw_size(fp, s);
+
+	// Y = LX' for every component at once
+	cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, K*D, B, D, 1.0, &fp->factors[k0*D*D], D, X, D, 0.0, Y, B);
+
+	for(long k=0; k<K; k++) {
+		const double c = fp->coef[2*(k0+k)];
+		const double e = fp->coef[2*(k0+k)+1];
+		double *q = &logp[k*B];
+		memset(q, 0, B*sizeof(double));
+		for(int i=0; i<D; i++) {
+			const double m = fp->shift[(k0+k)*D+i];
+			const double *y = &Y[(k*D+i)*B];
+			for(int b=0; b<B; b++) {
+				q[b] += (y[b] - m)*(y[b] - m);
+			}
+		}
+		for(int b=0; b<B; b++) {
+			q[b] = c + e*log1p(q[b]);
+		}
+	}
+}
+
+
+
+/* Scores one block of points against every draw. Runs on the thread pool. */
+static void predictive_block(void *arg, const int index)
+{
+	const ScoreJob *job = arg;
+	const FrozenPosterior *fp = job->fp;
+	const long start = (long)index*FROZEN_BLOCK;
+	const int B = job->n - start < FROZEN_BLOCK ? job->n - start : FROZEN_BLOCK;
+	const long K = fp->max_components;
+	double *Y = malloc(K*fp->D*B*sizeof(double));
+	double *logp = malloc(K*B*sizeof(double));
+	double *result = &job->output[start];
+
+	for(int b=0; b<B; b++) {
+		result[b] = -INFINITY;
+	}
+	for(long s=0; s<fp->num_draws; s++) {
+		draw_log_densities(fp, s, &job->X[start*fp->D], B, Y, logp);
+		long Ks = frozen_draw_size(fp, s);
+		for(int b=0; b<B; b++) {
+			// Add the mixture density of this draw to the running log sum
+			double maxlogp = result[b];
+			for(long k=0; k<Ks; k++) {
+				if(logp[k*B+b] > maxlogp) {
+					maxlogp = logp[k*B+b];
+				}
+			}
+			double Z = exp(result[b] - maxlogp);
+			for(long k=0; k<Ks; k++) {
+				Z += exp(logp[k*B+b] - maxlogp);
+			}
+			result[b] = log(Z) + maxlogp;
+		}
+	}
+	for(int b=0; b<B; b++) {
+		result[b] -= log(fp->num_draws);
+	}
+	free(Y);
+	free(logp);
+}
+
+
+
+/* Log posterior predictive density of the n points in X (n by D, row major), averaged over the draws */
+void frozen_log_predictive(const FrozenPosterior *fp, ThreadPool *pool, const double *X, const long n, double *logp)
+{
+	ScoreJob job = {fp, X, n, 0, logp};
+	parallel_for(pool, (n + FROZEN_BLOCK - 1)/FROZEN_BLOCK, predictive_block, &job);
+}
+
+
+
+/* Membership probabilities of one block of points. Runs on the thread pool. */
+static void membership_block(void *arg, const int index)
+{
+	const ScoreJob *job = arg;
+	const FrozenPosterior *fp = job->fp;
+	const long start = (long)index*FROZEN_BLOCK;
+	const int B = job->n - start < FROZEN_BLOCK ? job->n - start : FROZEN_BLOCK;
+	const long K = frozen_draw_size(fp, job->draw);
+	double *Y = malloc(K*fp->D*B*sizeof(double));
+	double *logp = malloc(K*B*sizeof(double));
+
+	draw_log_densities(fp, job->draw, &job->X[start*fp->D], B, Y, logp);
+	for(int b=0; b<B; b++) {
+		double *probs = &job->output[(start+b)*K];
+		double maxlogp = -INFINITY;
+		for(long k=0; k<K; k++) {
+			if(logp[k*B+b] > maxlogp) {
+				maxlogp = logp[k*B+b];
+			}
+		}
+		double Z = 0;
+		for(long k=0; k<K; k++) {
+			probs[k] = exp(logp[k*B+b] - maxlogp);
+			Z += probs[k];
+		}
+		for(long k=0; k<K; k++) {
+			probs[k] /= Z;
+		}
+	}
+	free(Y);
+	free(logp);
+}
+
+
+
+/* 
+ * Cluster membership probabilities of the n points in X under a single draw. Row i of probs
+ * holds the probabilities of the draw's components, with the new table last.
+ */
+void frozen_membership(const FrozenPosterior *fp, ThreadPool *pool, const long draw, const double *X, const long n, double *probs)
+{
+	ScoreJob job = {fp, X, n, draw, probs};
+	parallel_for(pool, (n + FROZEN_BLOCK - 1)/FROZEN_BLOCK, membership_block, &job);
+}
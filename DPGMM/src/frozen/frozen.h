@@ -0,0 +1,83 @@
+#ifndef _FROZEN_H
+#define _FROZEN_H
+
+#include <stdint.h> /* uint32_t, uint64_t */
+#include <stddef.h> /* size_t */
+#include "../crp.h" /* ChineseRestaurant struct */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Frozen posterior: a set of posterior draws reduced to what is needed to score new points.
+ *
+ * Each draw contributes one component per occupied table plus one for a new table. A
+ * component's Student-t predictive is stored as
+ *     log p(x) = c + e log(1 + |Lx - m|²)
+ * where c includes the log mixture weight, e = -(ν+1)/2, L = √(κ/(κ+1)) U'⁻¹ for Ψ = U'U
+ * and m = Lξ. The factors of a draw are stacked into one matrix, so a block of points is
+ * whitened against every component of the draw with a single dgemm.
+ *
+ * The artifact is a FrozenHeader followed by the draw_start, coef, shift and factors
+ * arrays in that order, in native byte order. It is loaded with mmap, so loading is
+ * immediate and the pages are shared by every process scoring with the same model.
+ * Artifacts are written by freeze.c, which needs the sampler; frozen.c only scores.
+ */
+
+#define FROZEN_MAGIC "DPGMMFRZ"
+#define FROZEN_VERSION 1
+
+/* Points scored together by a single task */
+#define FROZEN_BLOCK 256
+
+/* Artifact header */
+typedef struct FrozenHeader {
+	char magic[8]; /* FROZEN_MAGIC without the terminating null */
+	uint32_t version; /* FROZEN_VERSION */
+	uint32_t D; /* Dimensionality of data */
+	uint64_t num_draws; /* Number of posterior draws */
+	uint64_t num_components; /* Number of components over all draws */
+	uint64_t max_components; /* Largest number of components in a draw */
+} FrozenHeader;
+
+/* Posterior draws that are built in memory or mapped from an artifact */
+typedef struct FrozenPosterior {
+	int D; /* Dimensionality of data */
+	long num_draws; /* Number of posterior draws */
+	long num_components; /* Number of components over all draws */
+	long max_components; /* Largest number of components in a draw */
+	uint64_t *draw_start; /* Draw s owns components draw_start[s],...,draw_start[s+1]-1 */
+	double *coef; /* c and e of each component */
+	double *shift; /* m of each component (num_components by D) */
+	double *factors; /* L of each component, row major and stacked (num_components*D by D) */
+	void *map; /* Mapping of the artifact, or NULL when built in memory */
+	size_t map_size; /* Length of the mapping */
+	long capacity; /* Allocated number of components when built in memory */
+} FrozenPosterior;
+
+/* Creates an empty posterior in memory */
+FrozenPosterior *frozen_create(const int D);
+
+/* Appends the current state of the restaurant as a posterior draw */
+void frozen_add_draw(FrozenPosterior *fp, ChineseRestaurant *cr);
+
+/* Writes the posterior to an artifact */
+void frozen_save(const FrozenPosterior *fp, const char *filename);
+
+/* Maps an artifact into memory. Exits if it is invalid or holds no draws. */
+FrozenPosterior *frozen_load(const char *filename);
+
+/* Unmaps or frees the posterior */
+void frozen_destroy(FrozenPosterior *fp);
+
+/* Log posterior predictive density of the n points in X (n by D, row major), averaged over the draws */
+void frozen_log_predictive(const FrozenPosterior *fp, ThreadPool *pool, const double *X, const long n, double *logp);
+
+/* 
+ * Cluster membership probabilities of the n points in X under a single draw. Row i of probs
+ * holds the probabilities of the draw's components, with the new table last.
+ */
+void frozen_membership(const FrozenPosterior *fp, ThreadPool *pool, const long draw, const double *X, const long n, double *probs);
+
+/* Number of components of a draw */
+#define frozen_draw_size(fp, s) ((long)((fp)->draw_start[(s)+1] - (fp)->draw_start[(s)]))
+
+#endif
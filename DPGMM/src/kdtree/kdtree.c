@@ -0,0 +1,345 @@
+#include "kdtree.h"
+#ifdef CRP_SPATIAL_INDEX
+#include <math.h> // log, log1p, exp, lgamma, M_PI, INFINITY
+#include <stdlib.h> // malloc, calloc, realloc, free
+
+#define LEAF_SIZE 8 // Largest number of tables in a leaf
+
+
+
+/* Bounds used by the nodes for a single table */
+static void table_bounds(const Table *table, double *a, double *h, double *b)
+{
+	const int D = table->D;
+	double shrink = table->kappa/(table->kappa + 1);
+	double trace = 0; // tr(Ψ) = Σᵢⱼ Uᵢⱼ²
+	for(int i=0; i<D*(D+1)/2; i++) {
+		trace += table->psi[i]*table->psi[i];
+	}
+	*h = 0.5*(table->nu + 1);
+	*a = log(table->size) + lgamma(*h) - lgamma(*h - 0.5*D) + 0.5*D*log(M_PI*shrink) - table->logdetpsi;
+	*b = shrink/trace;
+}
+
+
+
+/* Loosens the bounds of a node so that they also hold for the table */
+static void widen_node(KdNode *node, const int D, const Table *table, const double a, const double h, const double b)
+{
+	for(int d=0; d<D; d++) {
+		if(table->xi[d] < node->lo[d]) {
+			node->lo[d] = table->xi[d];
+		}
+		if(table->xi[d] > node->hi[d]) {
+			node->hi[d] = table->xi[d];
+		}
+	}
+	if(a > node->max_a) {
+		node->max_a = a;
+	}
+	if(h < node->min_h) {
+		node->min_h = h;
+	}
+	if(b < node->min_b) {
+		node->min_b = b;
+	}
+}
+
+
+
+/* Moves the tables so that the kth smallest location in dimension d is at position k */
+static void select_tables(Table **tables, int start, int end, const int k, const int d)
+{
+	while(end - start > 1) {
+		double pivot = tables[(start + end)/2]->xi[d];
+		int i = start, j = end - 1;
+		while(i <= j) {
+			while(tables[i]->xi[d] < pivot) {
+				i++;
+			}
+			while(tables[j]->xi[d] > pivot) {
+				j--;
+			}
+			if(i <= j) {
+				Table *tmp = tables[i];
+				tables[i++] = tables[j];
+				tables[j--] = tmp;
+			}
+		}
+		if(k <= j) {
+			end = j + 1;
+		} else if(k >= i) {
+			start = i;
+		} else {
+			return;
+		}
+	}
+}
+
+
+
+/* Builds the subtree over tables start,...,end-1 and returns the index of its root */
+static int build_node(KdTree *tree, const int start, const int end, const int parent)
+{
+	const int D = tree->D;
+	int index = tree->num_nodes++;
+	KdNode *node = &tree->nodes[index];
+	node->parent = parent;
+	node->start = start;
+	node->end = end;
+	node->lo = &tree->boxes[2*D*index];
+	node->hi = &tree->boxes[2*D*index + D];
+	node->max_a = -INFINITY;
+	node->min_h = INFINITY;
+	node->min_b = INFINITY;
+	for(int d=0; d<D; d++) {
+		node->lo[d] = INFINITY;
+		node->hi[d] = -INFINITY;
+	}
+	for(int i=start; i<end; i++) {
+		table_bounds(tree->tables[i], &tree->a[i], &tree->h[i], &tree->b[i]);
+		widen_node(node, D, tree->tables[i], tree->a[i], tree->h[i], tree->b[i]);
+	}
+	node->left = node->right = -1;
+	if(end - start <= LEAF_SIZE) {
+		for(int i=start; i<end; i++) {
+			tree->tables[i]->slot = i;
+			tree->leaves[i] = index;
+		}
+		return index;
+	}
+
+	// Split at the median of the widest dimension. The tables below are relabelled by the children.
+	int split = 0;
+	for(int d=1; d<D; d++) {
+		if(node->hi[d] - node->lo[d] > node->hi[split] - node->lo[split]) {
+			split = d;
+		}
+	}
+	int middle = (start + end)/2;
+	select_tables(tree->tables, start, end, middle, split);
+	int left = build_node(tree, start, middle, index);
+	int right = build_node(tree, middle, end, index);
+	// The node array does not move, since it is allocated for the largest possible tree
+	tree->nodes[index].left = left;
+	tree->nodes[index].right = right;
+	return index;
+}
+
+
+
+/* Builds a tree over the occupied tables of the restaurant */
+KdTree *kdtree_build(ChineseRestaurant *cr)
+{
+	const int D = cr->D;
+	int K = List_count(cr->occupied_tables);
+	KdTree *tree = calloc(1, sizeof(KdTree));
+	tree->D = D;
+	tree->num_tables = K;
+	tree->tables = malloc(K*sizeof(Table *));
+	tree->leaves = malloc(K*sizeof(int));
+	tree->a = malloc(K*sizeof(double));
+	tree->h = malloc(K*sizeof(double));
+	tree->b = malloc(K*sizeof(double));
+	LIST_ENUMERATE(cr->occupied_tables, i, node_i, table_i) {
+		refresh_table(cr, table_i);
+		tree->tables[i] = table_i;
+	}
+	// A tree with leaves of at least LEAF_SIZE/2 tables has fewer than 2K/(LEAF_SIZE/2) + 1 nodes
+	int max_nodes = 4*K/LEAF_SIZE + 2;
+	tree->nodes = malloc(max_nodes*sizeof(KdNode));
+	tree->boxes = malloc(2*D*max_nodes*sizeof(double));
+	if(K > 0) {
+		build_node(tree, 0, K, -1);
+	}
+	return tree;
+}
+
+
+
+/* Frees the tree. The tables are left untouched. */
+void kdtree_destroy(KdTree *tree)
+{
+	for(int i=0; i<tree->num_tables; i++) {
+		if(tree->tables[i]->slot == i) {
+			tree->tables[i]->slot = -1;
+		}
+	}
+	free(tree->nodes);
+	free(tree->boxes);
+	free(tree->tables);
+	free(tree->leaves);
+	free(tree->a);
+	free(tree->h);
+	free(tree->b);
+	free(tree->extra);
+	free(tree);
+}
+
+
+
+/* Loosens the bounds above a table after a customer has joined or left it */
+void kdtree_update(ChineseRestaurant *cr, KdTree *tree, Table *table)
+{
+	const int i = table->slot;
+	if(i < 0) { // Opened since the tree was built and scored exactly
+		return;
+	}
+	// The bounds need the current hyperparameters, so a lazy table is refreshed here
+	refresh_table(cr, table);
+	table_bounds(table, &tree->a[i], &tree->h[i], &tree->b[i]);
+	for(int index = tree->leaves[i]; index >= 0; index = tree->nodes[index].parent) {
+		widen_node(&tree->nodes[index], tree->D, table, tree->a[i], tree->h[i], tree->b[i]);
+	}
+}
+
+
+
+/* Adds a table that has just been opened */
+void kdtree_add(ChineseRestaurant *cr, KdTree *tree, Table *table)
+{
+	if(tree->num_extra == tree->extra_capacity) {
+		tree->extra_capacity = tree->extra_capacity > 0 ? 2*tree->extra_capacity : 16;
+		tree->extra = realloc(tree->extra, tree->extra_capacity*sizeof(Table *));
+	}
+	tree->extra[tree->num_extra++] = table;
+	table->slot = -1;
+}
+
+
+
+/* Removes a table that has just been emptied */
+void kdtree_remove(KdTree *tree, Table *table)
+{
+	if(table->slot >= 0) { // Its entry in the leaf is skipped from now on
+		table->slot = -1;
+		return;
+	}
+	for(int i=0; i<tree->num_extra; i++) {
+		if(tree->extra[i] == table) {
+			tree->extra[i] = tree->extra[--tree->num_extra];
+			return;
+		}
+	}
+}
+
+
+
+/* State of a search for the candidate tables of a customer */
+typedef struct Search {
+	ChineseRestaurant *cr;
+	KdTree *tree;
+	const double *customer;
+	double log_tolerance;
+	int num_candidates;
+	Table **candidates;
+	double *logp;
+	double logZ; /* Log of the summed probabilities of the tables scored so far */
+	double log_skipped; /* Log of the bound on the summed probabilities of the skipped tables */
+} Search;
+
+/* log(exp(a) + exp(b)) */
+static double log_add(const double a, const double b)
+{
+	if(a == -INFINITY) {
+		return b;
+	}
+	return a > b ? a + log1p(exp(b - a)) : b + log1p(exp(a - b));
+}
+
+
+
+/* Scores a table exactly and adds it to the candidates */
+static void score_table(Search *s, Table *table)
+{
+	double lp = log(table->size) + log_likelihood(table, s->customer);
+	s->candidates[s->num_candidates] = table;
+	s->logp[s->num_candidates++] = lp;
+	s->logZ = log_add(s->logZ, lp);
+}
+
+
+
+/* Squared distance from the customer to the bounding box of a node */
+static double box_distance(const KdNode *node, const int D, const double *x)
+{
+	double d2 = 0;
+	for(int d=0; d<D; d++) {
+		double gap = x[d] < node->lo[d] ? node->lo[d] - x[d] : (x[d] > node->hi[d] ? x[d] - node->hi[d] : 0);
+		d2 += gap*gap;
+	}
+	return d2;
+}
+
+
+
+/* Scores the tables below a node, nearer child first, unless their total probability is negligible */
+static void search_node(Search *s, const int index, const double d2)
+{
+	KdNode *node = &s->tree->nodes[index];
+	double log_bound = log(node->end - node->start) + node->max_a - node->min_h*log1p(node->min_b*d2);
+	double log_skipped = log_add(s->log_skipped, log_bound);
+	if(log_skipped <= s->log_tolerance + s->logZ) {
+		s->log_skipped = log_skipped;
+		return;
+	}
+	const int D = s->tree->D;
+	if(node->left < 0) {
+		// The distance to each location gives a tighter bound for the individual tables
+		KdTree *tree = s->tree;
+		for(int i=node->start; i<node->end; i++) {
+			if(tree->tables[i]->slot != i) {
+				continue;
+			}
+			double x2 = 0;
+			for(int d=0; d<D; d++) {
+				x2 += (s->customer[d] - tree->tables[i]->xi[d])*(s->customer[d] - tree->tables[i]->xi[d]);
+			}
+			log_bound = tree->a[i] - tree->h[i]*log1p(tree->b[i]*x2);
+			log_skipped = log_add(s->log_skipped, log_bound);
+			if(log_skipped <= s->log_tolerance + s->logZ) {
+				s->log_skipped = log_skipped;
+			} else {
+				score_table(s, tree->tables[i]);
+			}
+		}
+		return;
+	}
+	double left_d2 = box_distance(&s->tree->nodes[node->left], D, s->customer);
+	double right_d2 = box_distance(&s->tree->nodes[node->right], D, s->customer);
+	if(left_d2 <= right_d2) {
+		search_node(s, node->left, left_d2);
+		search_node(s, node->right, right_d2);
+	} else {
+		search_node(s, node->right, right_d2);
+		search_node(s, node->left, left_d2);
+	}
+}
+
+
+
+/*
+ * Finds the tables that a customer could sit at with non-negligible probability.
+ * Writes the tables to candidates and their unnormalised log probabilities to logp,
+ * followed by that of an empty table, and returns the number of tables found.
+ * logZ is set to the log normalising constant of logp.
+ */
+int kdtree_candidates(ChineseRestaurant *cr, KdTree *tree, const double *customer, const double tolerance, Table **candidates, double *logp, double *logZ)
+{
+	Search s = {cr, tree, customer, log(tolerance), 0, candidates, logp, -INFINITY, -INFINITY};
+
+	// The empty table and the tables opened since the tree was built are always scored
+	double lp_empty = log(cr->alpha) + log_likelihood(&cr->table_prior, customer);
+	s.logZ = lp_empty;
+	for(int i=0; i<tree->num_extra; i++) {
+		refresh_table(cr, tree->extra[i]);
+		score_table(&s, tree->extra[i]);
+	}
+	if(tree->num_tables > 0) {
+		search_node(&s, 0, box_distance(&tree->nodes[0], tree->D, customer));
+	}
+	logp[s.num_candidates] = lp_empty;
+	*logZ = s.logZ;
+	return s.num_candidates;
+}
+#endif
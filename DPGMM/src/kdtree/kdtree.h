@@ -0,0 +1,74 @@
+#ifndef _KDTREE_H
+#define _KDTREE_H
+
+#include "../crp.h" /* ChineseRestaurant and Table structs */
+
+/*
+ * A kd-tree over the locations ξ of the occupied tables, used by crp_draw to skip
+ * tables whose probability is negligible. Compile with -DCRP_SPATIAL_INDEX to use it.
+ *
+ * Every node keeps a bounding box of the locations below it together with bounds on
+ * the parameters of the Student-t predictive of those tables. Writing Ψ = U'U, the
+ * quadratic form in log_likelihood satisfies (x-ξ)'Ψ⁻¹(x-ξ) >= |x-ξ|²/tr(Ψ), so the
+ * distance from a customer to a box bounds the log probability of every table in it.
+ *
+ * A draw scores the tables in order of distance and skips a subtree when the total
+ * probability of the skipped tables stays below tolerance times the probability of
+ * the tables scored so far. The skipped tables are then left out of the draw, which
+ * changes the draw probabilities by at most tolerance in total variation distance.
+ *
+ * The tree is rebuilt by finish_sweep. Between rebuilds, customers who join or leave
+ * a table only loosen the bounds of the nodes above it, and tables opened during a
+ * sweep are kept in a list and always scored exactly.
+ */
+
+/* Node of the tree. Leaves hold the tables start,...,end-1 of the tree's table array. */
+typedef struct KdNode {
+	int parent; /* Index of the parent node, or -1 for the root */
+	int left, right; /* Indices of the children, or -1 for a leaf */
+	int start, end; /* Range of the tables below the node */
+	double *lo, *hi; /* Bounding box of the locations below the node */
+	double max_a; /* Upper bound on log(size) + the terms of log_likelihood that do not depend on the customer */
+	double min_h; /* Lower bound on (ν+1)/2 */
+	double min_b; /* Lower bound on κ/((κ+1)tr(Ψ)) */
+} KdNode;
+
+/* kd-tree over the occupied tables of a restaurant */
+typedef struct KdTree {
+	int D; /* Dimensionality of data */
+	int num_nodes; /* Number of nodes. The root is node 0. */
+	KdNode *nodes; /* Nodes of the tree */
+	double *boxes; /* Storage for the bounding boxes */
+	int num_tables; /* Number of tables in the tree when it was built */
+	Table **tables; /* Tables in leaf order. Entries for tables that have since been emptied are skipped. */
+	int *leaves; /* Leaf holding each entry of tables */
+	double *a, *h, *b; /* Bounds of each table, defined as for the nodes */
+	int num_extra; /* Number of tables opened since the tree was built */
+	int extra_capacity; /* Allocated length of extra */
+	Table **extra; /* Tables opened since the tree was built */
+} KdTree;
+
+/* Builds a tree over the occupied tables of the restaurant */
+KdTree *kdtree_build(ChineseRestaurant *cr);
+
+/* Frees the tree. The tables are left untouched. */
+void kdtree_destroy(KdTree *tree);
+
+/* Loosens the bounds above a table after a customer has joined or left it */
+void kdtree_update(ChineseRestaurant *cr, KdTree *tree, Table *table);
+
+/* Adds a table that has just been opened */
+void kdtree_add(ChineseRestaurant *cr, KdTree *tree, Table *table);
+
+/* Removes a table that has just been emptied */
+void kdtree_remove(KdTree *tree, Table *table);
+
+/*
+ * Finds the tables that a customer could sit at with non-negligible probability.
+ * Writes the tables to candidates and their unnormalised log probabilities to logp,
+ * followed by that of an empty table, and returns the number of tables found.
+ * logZ is set to the log normalising constant of logp.
+ */
+int kdtree_candidates(ChineseRestaurant *cr, KdTree *tree, const double *customer, const double tolerance, Table **candidates, double *logp, double *logZ);
+
+#endif
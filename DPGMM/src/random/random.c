@@ -2,55 +2,288 @@
 #include <math.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h> // memcpy
 #include <sys/time.h> // timeval struct, gettimeofday
+#include <pthread.h> // pthread_once
 #include "dSFMT.h"    //SIMD-oriented Fast Mersenne Twister
 #include "dSFMT.c"
 
 
 
 /* ===== Uniform generators ===== */
-static double randu_buffer[RANDU_BUFFER_SIZE];  // Array with uniform(0,1) random variates
-static int randu_buffer_index = 0; // Index of the next 'fresh' random variate in the buffer
+static pthread_once_t ziggurat_once = PTHREAD_ONCE_INIT; // Makes sure the ziggurat tables are only built once
 
-inline uint64_t rand_uint64(void)
+#define MANTISSA_MASK 0x000fffffffffffffULL // Low 52 bits of a word
+
+/* xoshiro256++ jump polynomials, from Blackman and Vigna's reference implementation */
+static const uint64_t xoshiro_jump[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL}; // 2^128 steps
+static const uint64_t xoshiro_long_jump[4] = {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL}; // 2^192 steps
+
+/* Philox4x32 multipliers and Weyl key increments, from Salmon et al. (2011) */
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+#define PHILOX_ROUNDS 10
+#define PHILOX_BLOCKS 64 // Counters encrypted together. The buffer holds a multiple of 2*PHILOX_BLOCKS words.
+
+
+
+/* Next output of the splitmix64 generator, used to expand a seed into a xoshiro256++ state */
+static uint64_t splitmix64(uint64_t *x)
 {
-    double r = dsfmt_gv_genrand_close1_open2();
-    return *((uint64_t *) &r) & 0x000fffffffffffff;
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
 }
 
-inline void fill_randu(double array[], int size)
+
+
+/* Advances one xoshiro256++ lane by the number of steps encoded in the jump polynomial */
+static void xoshiro_jump_lane(Xoshiro *x, const int lane, const uint64_t jump[4])
 {
-  fill_array_open_open(array, size);
+  uint64_t s[4] = {0, 0, 0, 0};
+  for(int i=0; i<4; i++) {
+    for(int b=0; b<64; b++) {
+      if(jump[i] & (1ULL << b)) {
+        for(int j=0; j<4; j++) {
+          s[j] ^= x->s[j][lane];
+        }
+      }
+      uint64_t t = x->s[1][lane] << 17;
+      x->s[2][lane] ^= x->s[0][lane];
+      x->s[3][lane] ^= x->s[1][lane];
+      x->s[1][lane] ^= x->s[2][lane];
+      x->s[0][lane] ^= x->s[3][lane];
+      x->s[2][lane] ^= t;
+      x->s[3][lane] = (x->s[3][lane] << 45) | (x->s[3][lane] >> 19);
+    }
+  }
+  for(int j=0; j<4; j++) {
+    x->s[j][lane] = s[j];
+  }
 }
 
-/* generates a random number on (0,1) with 53-bit resolution */
-inline double randu(void)
+
+
+/* Fills out with size words, interleaving the lanes. Size must be a multiple of RNG_LANES. */
+static void xoshiro_fill(Xoshiro *x, uint64_t *out, const int size)
 {
-  if (randu_buffer_index > RANDU_BUFFER_SIZE-1) {
-    fill_randu(randu_buffer, RANDU_BUFFER_SIZE);
-    randu_buffer_index = 0;
+  // Working on copies of the state lets the compiler keep each state word in a vector register
+  uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+  memcpy(s0, x->s[0], sizeof(s0));
+  memcpy(s1, x->s[1], sizeof(s1));
+  memcpy(s2, x->s[2], sizeof(s2));
+  memcpy(s3, x->s[3], sizeof(s3));
+  for(int i=0; i<size; i+=RNG_LANES) {
+    for(int l=0; l<RNG_LANES; l++) {
+      uint64_t sum = s0[l] + s3[l];
+      out[i+l] = ((sum << 23) | (sum >> 41)) + s0[l];
+      uint64_t t = s1[l] << 17;
+      s2[l] ^= s0[l];
+      s3[l] ^= s1[l];
+      s1[l] ^= s2[l];
+      s0[l] ^= s3[l];
+      s2[l] ^= t;
+      s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+    }
   }
-  return randu_buffer[randu_buffer_index++];
+  memcpy(x->s[0], s0, sizeof(s0));
+  memcpy(x->s[1], s1, sizeof(s1));
+  memcpy(x->s[2], s2, sizeof(s2));
+  memcpy(x->s[3], s3, sizeof(s3));
 }
 
-inline void seed_rng(uint32_t seed)
+
+
+/* Writes words 2*block,...,2*(block+blocks)-1 of a Philox stream to out. Blocks must be a multiple of PHILOX_BLOCKS. */
+static void philox_fill(const uint32_t key[2], const uint32_t stream[2], uint64_t block, uint64_t *out, const int blocks)
 {
- init_gen_rand(seed); 
+  for(int i=0; i<blocks; i+=PHILOX_BLOCKS, block+=PHILOX_BLOCKS) {
+    // Each round is applied to every counter before the next, so the loops over the counters vectorise
+    uint32_t c0[PHILOX_BLOCKS], c1[PHILOX_BLOCKS], c2[PHILOX_BLOCKS], c3[PHILOX_BLOCKS];
+    for(int l=0; l<PHILOX_BLOCKS; l++) {
+      c0[l] = (uint32_t)(block + l);
+      c1[l] = (uint32_t)((block + l) >> 32);
+      c2[l] = stream[0];
+      c3[l] = stream[1];
+    }
+    uint32_t k0 = key[0], k1 = key[1];
+    for(int r=0; r<PHILOX_ROUNDS; r++) {
+      for(int l=0; l<PHILOX_BLOCKS; l++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0*c0[l];
+        uint64_t p1 = (uint64_t)PHILOX_M1*c2[l];
+        uint32_t x0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+        uint32_t x2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+        c1[l] = (uint32_t)p1;
+        c3[l] = (uint32_t)p0;
+        c0[l] = x0;
+        c2[l] = x2;
+      }
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+    for(int l=0; l<PHILOX_BLOCKS; l++) {
+      out[2*(i+l)] = (uint64_t)c1[l] << 32 | c0[l];
+      out[2*(i+l) + 1] = (uint64_t)c3[l] << 32 | c2[l];
+    }
+  }
 }
 
-void initialise_rngs(void)
+
+
+/* Refills the buffer from the backend */
+static void refill(Rng *rng)
 {
-  // Initialise the Mersenne twister
-  // Seed the rng with the current system time
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  seed_rng(tv.tv_sec+tv.tv_usec);
-  // Prefill the randu_buffer
-  fill_randu(randu_buffer, RANDU_BUFFER_SIZE);
-  randu_buffer_index = 0;
+  switch(rng->backend) {
+    case RNG_DSFMT:
+      dsfmt_fill_array_close1_open2(&rng->state.dsfmt, rng->buffer.doubles, RNG_BUFFER_SIZE);
+      break;
+    case RNG_XOSHIRO:
+      xoshiro_fill(&rng->state.xoshiro, rng->buffer.words, RNG_BUFFER_SIZE);
+      break;
+    case RNG_PHILOX:
+      philox_fill(rng->state.philox.key, rng->state.philox.stream, rng->state.philox.block, rng->buffer.words, RNG_BUFFER_SIZE/2);
+      rng->state.philox.block += RNG_BUFFER_SIZE/2;
+      break;
+  }
+  rng->buffer_index = 0;
+}
+
+
+
+/* Uniform(0,1) variate from the low 52 bits of a word. For dSFMT words this is dsfmt_genrand_open_open. */
+static inline double word_to_randu(const uint64_t word)
+{
+  return (double)((word & MANTISSA_MASK) | 1)*0x1p-52;
+}
+
+
+
+inline uint64_t rand_uint64(Rng *rng)
+{
+  if (rng->buffer_index == RNG_BUFFER_SIZE) {
+    refill(rng);
+  }
+  return rng->buffer.words[rng->buffer_index++] & MANTISSA_MASK;
+}
+
+inline void fill_randu(Rng *rng, double array[], int size)
+{
+  while (size > 0) {
+    if (rng->buffer_index == RNG_BUFFER_SIZE) {
+      refill(rng);
+    }
+    int n = RNG_BUFFER_SIZE - rng->buffer_index < size ? RNG_BUFFER_SIZE - rng->buffer_index : size;
+    const uint64_t *words = &rng->buffer.words[rng->buffer_index];
+    for (int i = 0; i < n; i++) {
+      array[i] = word_to_randu(words[i]);
+    }
+    rng->buffer_index += n;
+    array += n;
+    size -= n;
+  }
+}
+
+/* generates a random number on (0,1) with 52-bit resolution */
+inline double randu(Rng *rng)
+{
+  if (rng->buffer_index == RNG_BUFFER_SIZE) {
+    refill(rng);
+  }
+  return word_to_randu(rng->buffer.words[rng->buffer_index++]);
+}
+
+void philox_fill_randu(uint64_t seed, uint64_t stream, uint64_t offset, double array[], int size)
+{
+  const uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+  const uint32_t counter[2] = {(uint32_t)stream, (uint32_t)(stream >> 32)};
+  uint64_t words[2*PHILOX_BLOCKS];
+  uint64_t block = offset/(2*PHILOX_BLOCKS)*PHILOX_BLOCKS; // First block of the group holding the offset
+  int skip = (int)(offset % (2*PHILOX_BLOCKS));
+  while (size > 0) {
+    philox_fill(key, counter, block, words, PHILOX_BLOCKS);
+    int n = 2*PHILOX_BLOCKS - skip < size ? 2*PHILOX_BLOCKS - skip : size;
+    for (int i = 0; i < n; i++) {
+      array[i] = word_to_randu(words[skip + i]);
+    }
+    block += PHILOX_BLOCKS;
+    skip = 0;
+    array += n;
+    size -= n;
+  }
+}
+
+void seed_rng_stream(Rng *rng, RngBackend backend, uint64_t seed, uint64_t stream)
+{
+  rng->backend = backend;
+  switch(backend) {
+    case RNG_DSFMT:
+      if (stream == 0 && seed <= UINT32_MAX) {
+        // Same state as earlier versions of seed_rng
+        dsfmt_init_gen_rand(&rng->state.dsfmt, (uint32_t)seed);
+      } else {
+        uint32_t key[4] = {(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+        dsfmt_init_by_array(&rng->state.dsfmt, key, 4);
+      }
+      break;
+    case RNG_XOSHIRO: {
+      Xoshiro *x = &rng->state.xoshiro;
+      uint64_t sm = seed;
+      for (int j = 0; j < 4; j++) {
+        x->s[j][0] = splitmix64(&sm);
+      }
+      for (uint64_t i = 0; i < stream; i++) {
+        xoshiro_jump_lane(x, 0, xoshiro_long_jump);
+      }
+      for (int l = 1; l < RNG_LANES; l++) {
+        for (int j = 0; j < 4; j++) {
+          x->s[j][l] = x->s[j][l-1];
+        }
+        xoshiro_jump_lane(x, l, xoshiro_jump);
+      }
+      break;
+    }
+    case RNG_PHILOX:
+      rng->state.philox.key[0] = (uint32_t)seed;
+      rng->state.philox.key[1] = (uint32_t)(seed >> 32);
+      rng->state.philox.stream[0] = (uint32_t)stream;
+      rng->state.philox.stream[1] = (uint32_t)(stream >> 32);
+      rng->state.philox.block = 0;
+      break;
+  }
+  // Prefill the buffer
+  refill(rng);
 
   // Initialise Ziggurat tables
-  create_ziggurat_tables();
+  pthread_once(&ziggurat_once, create_ziggurat_tables);
+}
+
+void seed_rng(Rng *rng, uint32_t seed)
+{
+  seed_rng_stream(rng, RNG_DEFAULT, seed, 0);
+}
+
+const char *rng_name(RngBackend backend)
+{
+  switch(backend) {
+    case RNG_DSFMT:
+      return "dSFMT";
+    case RNG_XOSHIRO:
+      return "xoshiro256++";
+    case RNG_PHILOX:
+      return "Philox4x32-10";
+  }
+  return "unknown";
+}
+
+void initialise_rngs(Rng *rng)
+{
+  // Seed the default generator with the current system time
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  seed_rng(rng, tv.tv_sec+tv.tv_usec);
   // And we're done
 }
 
@@ -191,11 +424,11 @@ extern void create_ziggurat_tables (void)
  * distribution is exp(-0.5*x*x)
  */
 
-extern double randn(void)
+extern double randn(Rng *rng)
 {
   while (1) {
     /* arbitrary mantissa (selected by NRANDI, with 1 bit for sign) */
-    const uint64_t r = rand_uint64();
+    const uint64_t r = rand_uint64(rng);
     const int64_t rabs=r>>1;
     const int idx = (int)(rabs&0xFF);
     const double x = ( r&1 ? -rabs : rabs) * wi[idx];
@@ -216,21 +449,21 @@ extern double randn(void)
        */
       double xx, yy;
       do {
-        xx = - ZIGGURAT_NOR_INV_R * log (randu());
-        yy = - log (randu());
+        xx = - ZIGGURAT_NOR_INV_R * log (randu(rng));
+        yy = - log (randu(rng));
       } while ( yy+yy <= xx*xx);
       return (rabs&0x100 ? -ZIGGURAT_NOR_R-xx : ZIGGURAT_NOR_R+xx);
     } 
-    else if ((fi[idx-1] - fi[idx]) * randu() + fi[idx] < exp(-0.5*x*x)) {
+    else if ((fi[idx-1] - fi[idx]) * randu(rng) + fi[idx] < exp(-0.5*x*x)) {
       return x;
     }
   }
 }
 
-extern double rand_exp(void)
+extern double rand_exp(Rng *rng)
 {
   while(1) {
-    uint64_t ri = rand_uint64();
+    uint64_t ri = rand_uint64(rng);
     const int idx = (int)(ri & 0xFF);
     const double x = ri * we[idx];
     if (ri < ke[idx]) {
@@ -240,26 +473,53 @@ extern double rand_exp(void)
       /* As stated in Marsaglia and Tsang
       * For the exponential tail, the method of Marsaglia[5] provides:
       * x = r - ln(U); */
-      return ZIGGURAT_EXP_R - log (randu());
+      return ZIGGURAT_EXP_R - log (randu(rng));
     }
-    else if ((fe[idx-1] - fe[idx]) * randu() + fe[idx] < exp(-x)) {
+    else if ((fe[idx-1] - fe[idx]) * randu(rng) + fe[idx] < exp(-x)) {
       return x;
     }
   }
 }
 
-extern void fill_randn(double array[], int size)
+extern void fill_randn(Rng *rng, double array[], int size)
 {
   int i;
   for (i = 0; i < size; i++) {
-    array[i] = randn();
+    array[i] = randn(rng);
   }
 }
 
-extern void fill_rand_exp(double array[], int size)
+extern void fill_rand_exp(Rng *rng, double array[], int size)
 {
   int i;
   for (i = 0; i < size; i++) {
-    array[i] = rand_exp();
+    array[i] = rand_exp(rng);
   }
-}
\ No newline at end of file
+}
+
+
+/* ===== Gamma generator ===== */
+/*
+Marsaglia and Tsang, "A simple method for generating gamma variables",
+ACM Transactions on Mathematical Software, 2000. For shape < 1 we use
+the boost Gamma(a) = Gamma(a+1) * U^(1/a).
+*/
+extern double rand_gamma(Rng *rng, double shape)
+{
+  if (shape < 1.) {
+    return rand_gamma(rng, shape + 1.) * pow(randu(rng), 1. / shape);
+  }
+  const double d = shape - 1. / 3.;
+  const double c = 1. / sqrt(9. * d);
+  double x, v;
+  while (1) {
+    do {
+      x = randn(rng);
+      v = 1. + c * x;
+    } while (v <= 0.);
+    v = v * v * v;
+    if (log(randu(rng)) < 0.5 * x * x + d - d * v + d * log(v)) {
+      return d * v;
+    }
+  }
+}
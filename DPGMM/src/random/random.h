@@ -2,39 +2,118 @@
 #define _RANDOM_H
 
 #include <stdint.h> // uint64_t, uint32_t
+#include "dSFMT.h" // dsfmt_t
 
-/* The buffer for increasing dSFMT calling efficiency.	*/
-#define RANDU_BUFFER_SIZE 65536
+/* The buffer for increasing generator calling efficiency. Must be a multiple of 2*RNG_LANES and at least dsfmt_get_min_array_size(). */
+#define RNG_BUFFER_SIZE 1024
 
-/* Seeds the dSFMT rng. */
-void seed_rng(uint32_t seed);
+/* Number of streams that the xoshiro256++ and Philox generators advance together. Four 64-bit lanes fill an AVX2 register. */
+#define RNG_LANES 4
 
-/* Creats ziggurat tables for normal and exponential */
+/* Generator used by seed_rng and initialise_rngs. Compile with -DRNG_DEFAULT=RNG_XOSHIRO or -DRNG_DEFAULT=RNG_PHILOX to change it. */
+#ifndef RNG_DEFAULT
+#define RNG_DEFAULT RNG_DSFMT
+#endif
+
+/*
+ * Uniform generators behind randu, rand_uint64 and fill_randu.
+ *
+ * RNG_DSFMT is the double precision SIMD-oriented Fast Mersenne Twister, which works
+ * on 128-bit words (compile with -DHAVE_SSE2 for the SSE2 recursion). RNG_XOSHIRO
+ * runs RNG_LANES xoshiro256++ generators side by side, lane l being lane 0 advanced
+ * by l jumps of 2^128 steps, and interleaves their outputs. RNG_PHILOX is the
+ * counter-based Philox4x32-10: word i of a stream is a function of the seed, the
+ * stream and i alone, and RNG_LANES counters are encrypted at a time.
+ */
+typedef enum {
+	RNG_DSFMT, RNG_XOSHIRO, RNG_PHILOX
+} RngBackend;
+
+/* State of RNG_LANES interleaved xoshiro256++ generators */
+typedef struct Xoshiro {
+	uint64_t s[4][RNG_LANES]; // Word i of the state of each lane
+} Xoshiro;
+
+/* Key and position of a Philox4x32-10 stream */
+typedef struct Philox {
+	uint32_t key[2]; // The seed
+	uint32_t stream[2]; // Upper half of the counter
+	uint64_t block; // Lower half of the counter for the next block of two words
+} Philox;
+
+/* 
+ * Random number generator state. Each generator is independent, so models driven by
+ * different threads should use different generators. The ziggurat tables are shared
+ * and read only once they have been created.
+ *
+ * The backend fills the buffer with 64-bit words of which randu and rand_uint64 use
+ * the low 52 bits, one word per variate, so the two never reuse each other's output.
+ */
+typedef struct Rng {
+	union {
+		uint64_t words[RNG_BUFFER_SIZE];
+		double doubles[RNG_BUFFER_SIZE]; // dSFMT output in [1,2)
+	} buffer; // First, so that it is 16-byte aligned for the SSE2 dSFMT
+	int buffer_index; // Index of the next 'fresh' word in the buffer
+	RngBackend backend; // Generator filling the buffer
+	union {
+		dsfmt_t dsfmt;
+		Xoshiro xoshiro;
+		Philox philox;
+	} state; // State of the backend
+} Rng;
+
+/* Seeds the default generator. Also creates the ziggurat tables the first time it is called. */
+void seed_rng(Rng *rng, uint32_t seed);
+
+/*
+ * Seeds a generator with stream number stream of the seed. The streams of xoshiro256++
+ * are 2^192 steps apart, and reaching one takes a number of jumps proportional to its
+ * number. Philox streams are disjoint and free to reach. dSFMT streams are seeded from
+ * the seed and the stream, so they do not overlap with overwhelming probability.
+ */
+void seed_rng_stream(Rng *rng, RngBackend backend, uint64_t seed, uint64_t stream);
+
+/* Name of a generator, for printing */
+const char *rng_name(RngBackend backend);
+
+/* Creats ziggurat tables for normal and exponential. Called by seed_rng. */
 void create_ziggurat_tables(void);
 
-/* Convenience function used for initialising both dSFMT 
- and ziggurat rngs. Uses system time to seed the dSFMT. */
-void initialise_rngs(void);
+/* Convenience function used for initialising both the uniform
+ and ziggurat rngs. Uses system time to seed the default generator. */
+void initialise_rngs(Rng *rng);
 
-/* Uniform(0,1) random variables with dSFMT. */
-double randu(void);
+/* Uniform(0,1) random variables with 52-bit resolution. */
+double randu(Rng *rng);
 
-/* Fills array with uniform(0,1) random variates */
-void fill_randu(double array[], int size);
+/* Fills array with uniform(0,1) random variates. Gives the same values as calling randu size times. */
+void fill_randu(Rng *rng, double array[], int size);
 
-/* Generates random unsigned 64-bit integers */
-uint64_t rand_uint64(void);
+/* Generates random unsigned integers below 2^52 */
+uint64_t rand_uint64(Rng *rng);
+
+/*
+ * Fills array with the uniform(0,1) variates offset,...,offset+size-1 of a Philox
+ * stream, without a generator. The values are those that randu returns after
+ * seed_rng_stream(rng, RNG_PHILOX, seed, stream), so threads can draw disjoint parts
+ * of one stream reproducibly.
+ */
+void philox_fill_randu(uint64_t seed, uint64_t stream, uint64_t offset, double array[], int size);
 
 /* Normal(0,1) random variables using ziggurat method. */
-double randn(void);
+double randn(Rng *rng);
 
 /* Fills array with normal(0,1) random variates */
-void fill_randn(double array[], int size);
+void fill_randn(Rng *rng, double array[], int size);
 
 /* Exponential(1) random variables using ziggurat method. */
-double rand_exp(void);
+double rand_exp(Rng *rng);
 
 /* Fills array with exponential(1) random variates */
-void fill_rand_exp(double array[], int size);
+void fill_rand_exp(Rng *rng, double array[], int size);
+
+/* Gamma(shape,1) random variables using Marsaglia and Tsang's method. */
+double rand_gamma(Rng *rng, double shape);
 
-#endif
\ No newline at end of file
+#endif
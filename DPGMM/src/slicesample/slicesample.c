@@ -1,27 +1,42 @@
 #include <float.h> // DBL_EPSILON, INFINITY
-#include "../random/random.h" // randu, rand_exp
+#include "../random/random.h" // randu, rand_exp, rand_gamma
 #include <math.h> // log, lgamma
 #include "slicesample.h"
 
+/* Maximum number of steps taken when stepping out (Neal, 2003) */
+#define MAX_STEPS 16
+
+/* Part of logp_alpha that does not depend on k. This holds the expensive lgamma calls. */
+static double log_gamma_ratio(double alpha, int N)
+{
+	return lgamma(alpha) - lgamma(N+alpha);
+}
+
 /* Log of unnormalised posterior density for the concentration parameter */
 double logp_alpha(double alpha, int k, int N)
 {
 	if(0 < alpha && alpha < 100*N) {
-		return (k-1.5)*log(alpha) - 0.5*alpha + lgamma(alpha) - lgamma(N+alpha);
+		return (k + ALPHA_PRIOR_SHAPE - 1)*log(alpha) - ALPHA_PRIOR_RATE*alpha + log_gamma_ratio(alpha, N);
 	} else {
 		return -INFINITY;
 	}
 }
 
 /* Slice sampling procedure for the concentration parameter.*/
-double slice_sample_alpha(double x0, int k, int N, double width)
+double slice_sample_alpha(Rng *rng, double x0, int k, int N, double width, AlphaCache *cache)
 {
 	double result; // New sample to be returned
-	double logp_x0 = logp_alpha(x0,k,N); // Log density at initial point
-	double log_height = logp_x0 - rand_exp(); // Slice height in log terms
+	double logp_result; // Log density at the new sample
+	double logp_x0; // Log density at initial point
+	if(cache != NULL && cache->alpha == x0 && cache->N == N) {
+		logp_x0 = (k + ALPHA_PRIOR_SHAPE - 1)*log(x0) - ALPHA_PRIOR_RATE*x0 + cache->log_gamma_ratio;
+	} else {
+		logp_x0 = logp_alpha(x0,k,N);
+	}
+	double log_height = logp_x0 - rand_exp(rng); // Slice height in log terms
 	
 	// Compute initali slice width: R - L
-	double R = x0 + width*randu();
+	double R = x0 + width*randu(rng);
 	double L = R - width;
 	
 	if(L<0) { /* alpha has a postive support */
@@ -29,41 +44,69 @@ double slice_sample_alpha(double x0, int k, int N, double width)
 	}
 	
 
-	/* Stepping out procedure (No maximum on the number of steps) */
-	while(log_height < logp_alpha(L,k,N)) {
+	/* Stepping out procedure, with at most MAX_STEPS steps split at random between the two ends */
+	int left_steps = (int)(MAX_STEPS*randu(rng));
+	int right_steps = MAX_STEPS - 1 - left_steps;
+	while(left_steps-- > 0 && log_height < logp_alpha(L,k,N)) {
 		L -= width;
 		if(L<0) {
 			L = DBL_EPSILON;
 			break;
 		}
 	}
-	while(log_height < logp_alpha(R,k,N))
+	while(right_steps-- > 0 && log_height < logp_alpha(R,k,N))
 		R += width;
 	
 	/* Sample from the slice, stepping in if necessary */
-	result = L + (R-L)*randu();
-	while(logp_alpha(result,k,N) < log_height) {
+	result = L + (R-L)*randu(rng);
+	while((logp_result = logp_alpha(result,k,N)) < log_height) {
 		if(result < x0) {
 			L = result;
 		} else {
 			R = result;
 		}
-		result = L + (R-L)*randu();
+		result = L + (R-L)*randu(rng);
+	}
+
+	// Remember the k independent part of the density at the new point for the next call
+	if(cache != NULL) {
+		cache->alpha = result;
+		cache->N = N;
+		cache->log_gamma_ratio = logp_result - (k + ALPHA_PRIOR_SHAPE - 1)*log(result) + ALPHA_PRIOR_RATE*result;
 	}
 	return result;
 }
 
+/* Auxiliary variable Gibbs update for the concentration parameter (Escobar and West, 1995). */
+double gibbs_sample_alpha(Rng *rng, double x0, int k, int N)
+{
+	// η | α ~ Beta(α+1, N)
+	double g = rand_gamma(rng, x0 + 1);
+	double eta = g/(g + rand_gamma(rng, N));
+
+	// α | η, k is a mixture of Gamma(a+k, b-log η) and Gamma(a+k-1, b-log η) with odds (a+k-1)/(N(b-log η))
+	double shape = ALPHA_PRIOR_SHAPE + k;
+	double rate = ALPHA_PRIOR_RATE - log(eta);
+	double odds = (shape - 1)/(N*rate);
+	if(randu(rng) < odds/(1 + odds)) {
+		return rand_gamma(rng, shape)/rate;
+	} else {
+		return rand_gamma(rng, shape - 1)/rate;
+	}
+}
+
 // int main(void)
 // {
-// 	initialise_rngs();
+// 	Rng rng;
+// 	initialise_rngs(&rng);
 // 	int k = 100;
 // 	int N = 100000;
 // 	double alpha = 0.5;
 // 	int i;
 // 	printf("P(a) = %f \n", logp_alpha(alpha,k,N));
 // 	for(i=0; i<N; i++) {
-// 		alpha = slice_sample_alpha(alpha,k,N,1.0);
+// 		alpha = slice_sample_alpha(&rng,alpha,k,N,1.0,NULL);
 // 		printf("alpha = %e \n", alpha);
 // 	}
 // 	return 0;
-// }
\ No newline at end of file
+// }
@@ -1,6 +1,19 @@
 #ifndef _SLICESAMPLE_H
 #define _SLICESAMPLE_H
 
+#include "../random/random.h" /* Rng */
+
+/* The concentration parameter has the (improper) Gamma-type prior p(α) ∝ α^(a-1) exp(-bα) */
+#define ALPHA_PRIOR_SHAPE -0.5 /* a */
+#define ALPHA_PRIOR_RATE 0.5 /* b */
+
+/* lgamma(α) - lgamma(N+α) at the last value returned by slice_sample_alpha */
+typedef struct AlphaCache {
+  double alpha; /* Value of α the cache refers to. Zero if nothing is cached. */
+  int N; /* Number of data points */
+  double log_gamma_ratio; /* lgamma(α) - lgamma(N+α) */
+} AlphaCache;
+
 /* Log of unnormalised posterior density for the concentration parameter */
 double logp_alpha
 (
@@ -12,10 +25,24 @@ double logp_alpha
 /* Slice sampling procedure for the concentration parameter.*/
 double slice_sample_alpha
 (
+  Rng *rng, /* Random number generator */
   double x0, /* Current value of alpha */
   int k, /* Number of occupied tables */
   int N, /* Number of data points */
-  double width /* Slice width */
+  double width, /* Slice width */
+  AlphaCache *cache /* Saves the density evaluation at x0 when it matches. May be NULL. */
+);
+
+/* 
+ * Auxiliary variable Gibbs update for the concentration parameter (Escobar and West, 1995).
+ * The conditional is only proper when a + k > 1, i.e. with two or more occupied tables.
+ */
+double gibbs_sample_alpha
+(
+  Rng *rng, /* Random number generator */
+  double x0, /* Current value of alpha */
+  int k, /* Number of occupied tables */
+  int N /* Number of data points */
 );
 
-#endif
\ No newline at end of file
+#endif
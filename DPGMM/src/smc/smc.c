@@ -0,0 +1,212 @@
+#include "smc.h"
+#include <math.h> // log, exp, INFINITY
+#include <stdlib.h> // calloc, realloc, free
+#include "../random/random.h" // randu
+
+
+
+
+/* Drops a particle's hold on each of its tables and frees the tables nobody else holds */
+static void release_tables(List *tables)
+{
+	LIST_FOREACH(tables, node) {
+		Table *table = node->value;
+		if(--table->refs == 0) {
+			destroy_table(table);
+		}
+	}
+	List_destroy(tables);
+}
+
+
+
+/* Creates P particles with no customers that are scored on num_threads threads */
+SMC *smc_init(const int D, Rng *rng, const int P, const int num_threads, const double ess_fraction, const double alpha, const double xi[], const double kappa, const double nu, const double psi[])
+{
+	SMC *smc = calloc(1, sizeof(SMC));
+	smc->D = D;
+	smc->rng = rng;
+	smc->P = P;
+	smc->ess_fraction = ess_fraction;
+	smc->ess = P;
+	smc->particles = calloc(P, sizeof(Particle));
+	for(int p=0; p<P; p++) {
+		smc->particles[p].cr = crp_create(D, rng, alpha, xi, kappa, nu, psi);
+		smc->particles[p].logw = -log(P);
+	}
+	smc->ancestors = calloc(P, sizeof(int));
+	smc->lists = calloc(P, sizeof(List *));
+	smc->pool = threadpool_create(num_threads);
+	return smc;
+}
+
+
+
+/* Frees the particles, their tables and the thread pool */
+void smc_destroy(SMC *smc)
+{
+	for(int p=0; p<smc->P; p++) {
+		crp_destroy(smc->particles[p].cr);
+		free(smc->particles[p].logp);
+	}
+	threadpool_destroy(smc->pool);
+	free(smc->particles);
+	free(smc->ancestors);
+	free(smc->lists);
+	free(smc);
+}
+
+
+
+/* Scores the current point against the tables of particle p. Runs on the thread pool. */
+static void score_particle(void *arg, const int p)
+{
+	SMC *smc = arg;
+	Particle *particle = &smc->particles[p];
+	int k = List_count(particle->cr->occupied_tables);
+	if(k+1 > particle->capacity) {
+		particle->capacity = 2*(k+1);
+		particle->logp = realloc(particle->logp, particle->capacity*sizeof(double));
+	}
+	particle->logZ = crp_log_predictive(particle->cr, smc->x, particle->logp);
+}
+
+
+
+/* Systematic resampling. Descendants share their ancestor's tables. */
+static void resample(SMC *smc)
+{
+	const int P = smc->P;
+	Particle *particles = smc->particles;
+
+	// Pick the ancestors using a single uniform draw
+	double u = randu(smc->rng)/P;
+	double cum_weight = exp(particles[0].logw);
+	int j = 0;
+	for(int p=0; p<P; p++) {
+		while(cum_weight < u + (double)p/P && j < P-1) {
+			cum_weight += exp(particles[++j].logw);
+		}
+		smc->ancestors[p] = j;
+	}
+
+	// Copy the table lists before any particle lets go of its own tables
+	for(int p=0; p<P; p++) {
+		List *tables = List_create();
+		LIST_FOREACH(particles[smc->ancestors[p]].cr->occupied_tables, node) {
+			Table *table = node->value;
+			table->refs++;
+			List_push(tables, table);
+		}
+		smc->lists[p] = tables;
+	}
+	for(int p=0; p<P; p++) {
+		release_tables(particles[p].cr->occupied_tables);
+		particles[p].cr->occupied_tables = smc->lists[p];
+		particles[p].logw = -log(P);
+	}
+	smc->resamples++;
+}
+
+
+
+/* Seats x in the particle using the table scores of its ancestor */
+static void seat(ChineseRestaurant *cr, const Particle *ancestor, const double *x)
+{
+	int k = List_count(cr->occupied_tables);
+	int j = crp_sample(cr->rng, ancestor->logp, k, ancestor->logZ);
+	Table *table;
+	if(j == k) { // New table
+		table = new_table(&cr->table_prior);
+		List_push(cr->occupied_tables, table);
+	} else {
+		ListNode *node = cr->occupied_tables->first;
+		while(j-- > 0) {
+			node = node->next;
+		}
+		table = node->value;
+		if(table->refs > 1) { // Copy on write
+			table->refs--;
+			table = copy_table(table);
+			node->value = table;
+		}
+	}
+	table->size += 1;
+	table_update(table, x, 1);
+	// Shared tables are scored concurrently, so they must never be stale
+	refresh_table(cr, table);
+}
+
+
+
+/* Weights the particles by the predictive probability of x, resamples if needed and seats x in every particle */
+void smc_observe(SMC *smc, const double *x)
+{
+	const int P = smc->P;
+	Particle *particles = smc->particles;
+
+	// Score the point against every particle in parallel
+	smc->x = x;
+	parallel_for(smc->pool, P, score_particle, smc);
+
+	// The incremental weight is the predictive probability of x, which does not depend on where x is seated
+	double maxlogw = -INFINITY;
+	for(int p=0; p<P; p++) {
+		particles[p].logw += crp_log_density(particles[p].cr, particles[p].logZ);
+		if(particles[p].logw > maxlogw) {
+			maxlogw = particles[p].logw;
+		}
+	}
+	double W = 0;
+	for(int p=0; p<P; p++) {
+		W += exp(particles[p].logw - maxlogw);
+	}
+	double logW = log(W) + maxlogw;
+	smc->log_evidence += logW;
+	double sum_w2 = 0;
+	for(int p=0; p<P; p++) {
+		particles[p].logw -= logW;
+		sum_w2 += exp(2*particles[p].logw);
+	}
+	smc->ess = 1/sum_w2;
+
+	// Resampling before seating keeps more distinct seatings of x
+	if(smc->ess < smc->ess_fraction*P) {
+		resample(smc);
+	} else {
+		for(int p=0; p<P; p++) {
+			smc->ancestors[p] = p;
+		}
+	}
+
+	for(int p=0; p<P; p++) {
+		seat(particles[p].cr, &particles[smc->ancestors[p]], x);
+	}
+	smc->n++;
+}
+
+
+
+/* Returns the restaurant of the particle with the largest weight */
+ChineseRestaurant *smc_map_particle(SMC *smc)
+{
+	int best = 0;
+	for(int p=1; p<smc->P; p++) {
+		if(smc->particles[p].logw > smc->particles[best].logw) {
+			best = p;
+		}
+	}
+	return smc->particles[best].cr;
+}
+
+
+
+/* Weighted average number of occupied tables */
+double smc_mean_tables(SMC *smc)
+{
+	double result = 0;
+	for(int p=0; p<smc->P; p++) {
+		result += exp(smc->particles[p].logw)*List_count(smc->particles[p].cr->occupied_tables);
+	}
+	return result;
+}
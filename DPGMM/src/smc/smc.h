@@ -0,0 +1,65 @@
+#ifndef _SMC_H
+#define _SMC_H
+
+#include "../crp.h" /* ChineseRestaurant and Table structs */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Sequential Monte Carlo for the DPGMM over a stream of points (Fearnhead, 2004).
+ *
+ * Each particle is a restaurant holding only its occupied tables, so the cost of a point
+ * does not grow with the number of points already seen. A point is weighted by its
+ * predictive probability under each particle and then seated with the CRP conditional,
+ * exactly as crp_draw would seat it. Particles are resampled when the effective sample
+ * size drops below a fraction of the number of particles.
+ *
+ * Resampled particles share their tables. Table.refs counts the particles holding a
+ * table, and a shared table is copied before a customer is seated at it. Because a
+ * table can sit in several lists, the id and node fields of particle tables are unused.
+ *
+ * Scoring is spread over a thread pool. Seating uses the global random number
+ * generator and the reference counts, so it runs on the calling thread.
+ */
+
+/* A weighted restaurant */
+typedef struct Particle {
+	ChineseRestaurant *cr; /* Occupied tables of this particle. The empty list is unused. */
+	double logw; /* Normalised log importance weight */
+	double *logp; /* crp_log_predictive scores of the current point */
+	int capacity; /* Allocated length of logp */
+	double logZ; /* Log normalising constant of logp */
+} Particle;
+
+/* Particle filter */
+typedef struct SMC {
+	int D; /* Dimensionality of data */
+	Rng *rng; /* Random number generator shared by the particles. Not owned. */
+	int P; /* Number of particles */
+	Particle *particles;
+	double ess_fraction; /* Resample when the effective sample size falls below ess_fraction*P */
+	long n; /* Number of points seen */
+	double log_evidence; /* Estimate of the log marginal likelihood of the points seen */
+	double ess; /* Effective sample size after the last point was weighted */
+	int resamples; /* Number of resampling steps */
+	int *ancestors; /* Particle each particle descends from in the current step */
+	List **lists; /* Scratch table lists used while resampling */
+	const double *x; /* Point being scored */
+	ThreadPool *pool;
+} SMC;
+
+/* Creates P particles with no customers that are scored on num_threads threads */
+SMC *smc_init(const int D, Rng *rng, const int P, const int num_threads, const double ess_fraction, const double alpha, const double xi[], const double kappa, const double nu, const double psi[]);
+
+/* Frees the particles, their tables and the thread pool */
+void smc_destroy(SMC *smc);
+
+/* Weights the particles by the predictive probability of x, resamples if needed and seats x in every particle */
+void smc_observe(SMC *smc, const double *x);
+
+/* Returns the restaurant of the particle with the largest weight */
+ChineseRestaurant *smc_map_particle(SMC *smc);
+
+/* Weighted average number of occupied tables */
+double smc_mean_tables(SMC *smc);
+
+#endif
@@ -0,0 +1,105 @@
+#include "threadpool.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // calloc, exit
+
+
+
+/* Runs tasks until none are left to hand out. Called and returns with the mutex held. */
+static void run_tasks(ThreadPool *pool)
+{
+	while(pool->next < pool->n) {
+		int index = pool->next++;
+		pthread_mutex_unlock(&pool->mutex);
+		pool->task(pool->arg, index);
+		pthread_mutex_lock(&pool->mutex);
+		if(--pool->remaining == 0) {
+			pthread_cond_broadcast(&pool->work_done);
+		}
+	}
+}
+
+
+
+/* Waits for loops to start and helps to run them */
+static void *worker(void *arg)
+{
+	ThreadPool *pool = arg;
+	pthread_mutex_lock(&pool->mutex);
+	while(1) {
+		while(!pool->shutdown && pool->next >= pool->n) {
+			pthread_cond_wait(&pool->work_ready, &pool->mutex);
+		}
+		if(pool->shutdown) {
+			break;
+		}
+		run_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+
+
+/* Starts a pool with num_threads threads in total. Values below one mean one. */
+ThreadPool *threadpool_create(const int num_threads)
+{
+	ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+	pool->num_threads = num_threads > 1 ? num_threads : 1;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_ready, NULL);
+	pthread_cond_init(&pool->work_done, NULL);
+	pool->workers = calloc(pool->num_threads, sizeof(pthread_t));
+	for(int t=0; t<pool->num_threads-1; t++) {
+		if(pthread_create(&pool->workers[t], NULL, worker, pool) != 0) {
+			fprintf(stderr, "Could not start worker thread %d.\n", t);
+			exit(1);
+		}
+	}
+	return pool;
+}
+
+
+
+/* Stops the workers and frees the pool */
+void threadpool_destroy(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->mutex);
+	for(int t=0; t<pool->num_threads-1; t++) {
+		pthread_join(pool->workers[t], NULL);
+	}
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work_ready);
+	pthread_cond_destroy(&pool->work_done);
+	free(pool->workers);
+	free(pool);
+}
+
+
+
+/* Calls task(arg, i) for i = 0,...,n-1 across the pool and returns once every call has finished */
+void parallel_for(ThreadPool *pool, const int n, void (*task)(void *arg, const int index), void *arg)
+{
+	if(pool->num_threads == 1 || n == 1) {
+		for(int i=0; i<n; i++) {
+			task(arg, i);
+		}
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	pool->task = task;
+	pool->arg = arg;
+	pool->n = n;
+	pool->next = 0;
+	pool->remaining = n;
+	pthread_cond_broadcast(&pool->work_ready);
+	run_tasks(pool);
+	while(pool->remaining > 0) {
+		pthread_cond_wait(&pool->work_done, &pool->mutex);
+	}
+	pool->n = 0;
+	pool->next = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -1,9 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h> // uint16_t, uint32_t
 #include "utils.h"
 
-/* Import data from file to 1D-array */
-void import_data(const char *filename, const int rows, const int cols, double **data)
+/* Import data from file to a row major 1D-array */
+void import_data(const char *filename, const int rows, const int cols, double *data)
 {
 	FILE *fp; // file pointer
 
@@ -15,7 +16,7 @@ void import_data(const char *filename, const int rows, const int cols, double **
 
 	for(int i=0; i<rows; i++) {
 		for(int j=0; j<cols; j++) {
-			fscanf(fp, "%lf%*[, \t\n]", &data[i][j]);
+			fscanf(fp, "%lf%*[, \t\n]", &data[i*cols+j]);
 		}
 	}
 
@@ -47,6 +48,16 @@ void export_data(TYPE dtype, const void *data, const int length, const char *fil
 			fprintf(fp, "%d\t", ((int *)data)[i]);
 		}
 		break;
+	case UINT16:
+		for(int i=0; i<length; i++) {
+			fprintf(fp, "%u\t", (unsigned int)((uint16_t *)data)[i]);
+		}
+		break;
+	case UINT32:
+		for(int i=0; i<length; i++) {
+			fprintf(fp, "%u\t", (unsigned int)((uint32_t *)data)[i]);
+		}
+		break;
 	case FLOAT:
 		for(int i=0; i<length; i++) {
 			fprintf(fp, "%f\t", ((float *)data)[i]);
@@ -4,11 +4,11 @@
 #include <stdlib.h>
 
 typedef enum {
-	CHAR, INT, FLOAT, DOUBLE
+	CHAR, INT, UINT16, UINT32, FLOAT, DOUBLE
 } TYPE;
 
-/* Import data from file to 2D-array */
-void import_data(const char *filename, const int rows, const int cols, double **data);
+/* Import data from file to a row major 1D-array */
+void import_data(const char *filename, const int rows, const int cols, double *data);
 
 /* Export data from array to file */
 void export_data(TYPE dtype, const void *data, const int length, const char *filename);
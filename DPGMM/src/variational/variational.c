@@ -0,0 +1,810 @@
+#include "variational.h"
+#include <Accelerate/Accelerate.h> // cblas_daxpy, cblas_dscal, cblas_dspr, cblas_dtpsv, cblas_ddot
+#include <math.h> // log, exp, lgamma, round, M_PI, INFINITY
+#include <stdlib.h> // calloc, free
+#include <string.h> // memcpy, memset, memmove
+#include "../random/random.h" // randu
+#include "../utils/utils.h" // export_data
+
+#define RESP_THRESHOLD 1e-8 // Responsibilities below this are treated as zero
+#define PRUNE_MASS 0.5 // Components with fewer expected customers are deleted
+#define BIRTHS_PER_LAP 4 // Maximum number of components born after each lap
+#define MAX_MERGE_PAIRS 16 // Maximum number of merge candidates tracked per lap
+#define STOCHASTIC_DELAY 1.0 // Step size ρₜ = (t + delay)^(-forgetting rate)
+#define STOCHASTIC_FORGET 0.6
+
+/* Digamma function using the recurrence ψ(x) = ψ(x+1) - 1/x and an asymptotic series */
+static double digamma(double x)
+{
+	double result = 0;
+	while(x < 6) {
+		result -= 1/x;
+		x += 1;
+	}
+	double f = 1/(x*x);
+	return result + log(x) - 0.5/x - f*(1.0/12 - f*(1.0/120 - f*(1.0/252 - f*(1.0/240 - f/132))));
+}
+
+
+
+/* Logarithm of the beta function */
+static double lbeta(const double a, const double b)
+{
+	return lgamma(a) + lgamma(b) - lgamma(a + b);
+}
+
+
+
+/* Log normaliser of a NIW distribution: log[(2π/κ)^(D/2) 2^(νD/2) Γ_D(ν/2) |Ψ|^(-ν/2)] */
+static double niw_lognorm(const Table *table)
+{
+	const int D = table->D;
+	double result = 0.5*D*log(2*M_PI/table->kappa) + 0.5*table->nu*D*log(2) - table->nu*table->logdetpsi;
+	result += 0.25*D*(D-1)*log(M_PI);
+	for(int i=0; i<D; i++) {
+		result += lgamma(0.5*(table->nu - i));
+	}
+	return result;
+}
+
+
+
+/* ===== Sufficient statistics ===== */
+
+static void stats_alloc(SuffStats *s, const int Kmax, const int D)
+{
+	s->D = D;
+	s->N = calloc(Kmax, sizeof(double));
+	s->sum = calloc(Kmax*D, sizeof(double));
+	s->scatter = calloc(Kmax*D*(D+1)/2, sizeof(double));
+	s->H = calloc(Kmax, sizeof(double));
+	s->pair_H = calloc(MAX_MERGE_PAIRS, sizeof(double));
+}
+
+static void stats_free(SuffStats *s)
+{
+	free(s->N);
+	free(s->sum);
+	free(s->scatter);
+	free(s->H);
+	free(s->pair_H);
+}
+
+static void stats_zero(SuffStats *s, const int K)
+{
+	const int D = s->D;
+	memset(s->N, 0, K*sizeof(double));
+	memset(s->sum, 0, K*D*sizeof(double));
+	memset(s->scatter, 0, K*(D*(D+1)/2)*sizeof(double));
+	memset(s->H, 0, K*sizeof(double));
+	memset(s->pair_H, 0, MAX_MERGE_PAIRS*sizeof(double));
+}
+
+/* Copies the first K components of src to dst */
+static void stats_copy(SuffStats *dst, const SuffStats *src, const int K)
+{
+	const int D = dst->D;
+	memcpy(dst->N, src->N, K*sizeof(double));
+	memcpy(dst->sum, src->sum, K*D*sizeof(double));
+	memcpy(dst->scatter, src->scatter, K*(D*(D+1)/2)*sizeof(double));
+	memcpy(dst->H, src->H, K*sizeof(double));
+	memcpy(dst->pair_H, src->pair_H, MAX_MERGE_PAIRS*sizeof(double));
+}
+
+/* y = a*x + b*y for the first K components */
+static void stats_axpby(const double a, const SuffStats *x, const double b, SuffStats *y, const int K)
+{
+	const int D = y->D;
+	cblas_dscal(K, b, y->N, 1);
+	cblas_daxpy(K, a, x->N, 1, y->N, 1);
+	cblas_dscal(K*D, b, y->sum, 1);
+	cblas_daxpy(K*D, a, x->sum, 1, y->sum, 1);
+	cblas_dscal(K*D*(D+1)/2, b, y->scatter, 1);
+	cblas_daxpy(K*D*(D+1)/2, a, x->scatter, 1, y->scatter, 1);
+	cblas_dscal(K, b, y->H, 1);
+	cblas_daxpy(K, a, x->H, 1, y->H, 1);
+	cblas_dscal(MAX_MERGE_PAIRS, b, y->pair_H, 1);
+	cblas_daxpy(MAX_MERGE_PAIRS, a, x->pair_H, 1, y->pair_H, 1);
+}
+
+/* Adds the statistics of component k to component j. The entropy of j becomes that of merge
+ * pair p, or the sum of both entropies (an upper bound) if p is negative. */
+static void stats_merge(SuffStats *s, const int j, const int k, const int p)
+{
+	const int D = s->D;
+	s->N[j] += s->N[k];
+	cblas_daxpy(D, 1.0, &s->sum[k*D], 1, &s->sum[j*D], 1);
+	cblas_daxpy(D*(D+1)/2, 1.0, &s->scatter[k*D*(D+1)/2], 1, &s->scatter[j*D*(D+1)/2], 1);
+	s->H[j] = p >= 0 ? s->pair_H[p] : s->H[j] + s->H[k];
+}
+
+/* Removes the components whose keep flag is zero, preserving the order of the rest */
+static void stats_compact(SuffStats *s, const int *keep, const int K)
+{
+	const int D = s->D;
+	const int P = D*(D+1)/2;
+	int m = 0;
+	for(int k=0; k<K; k++) {
+		if(keep[k]) {
+			s->N[m] = s->N[k];
+			s->H[m] = s->H[k];
+			memmove(&s->sum[m*D], &s->sum[k*D], D*sizeof(double));
+			memmove(&s->scatter[m*P], &s->scatter[k*P], P*sizeof(double));
+			m++;
+		}
+	}
+}
+
+/* Reorders the components so that component k moves to position perm[k] */
+static void stats_permute(SuffStats *s, const int *perm, const int K)
+{
+	const int D = s->D;
+	const int P = D*(D+1)/2;
+	double *counts = malloc(K*sizeof(double));
+	double *H = malloc(K*sizeof(double));
+	double *sum = malloc(K*D*sizeof(double));
+	double *scatter = malloc(K*P*sizeof(double));
+	for(int k=0; k<K; k++) {
+		counts[perm[k]] = s->N[k];
+		H[perm[k]] = s->H[k];
+		memcpy(&sum[perm[k]*D], &s->sum[k*D], D*sizeof(double));
+		memcpy(&scatter[perm[k]*P], &s->scatter[k*P], P*sizeof(double));
+	}
+	memcpy(s->N, counts, K*sizeof(double));
+	memcpy(s->H, H, K*sizeof(double));
+	memcpy(s->sum, sum, K*D*sizeof(double));
+	memcpy(s->scatter, scatter, K*P*sizeof(double));
+	free(counts);
+	free(H);
+	free(sum);
+	free(scatter);
+}
+
+/* Adds a customer to component k with weight w */
+static void stats_add(SuffStats *s, const int k, const double *x, const double w)
+{
+	const int D = s->D;
+	s->N[k] += w;
+	cblas_daxpy(D, w, x, 1, &s->sum[k*D], 1);
+	cblas_dspr(CblasColMajor, CblasUpper, D, w, x, 1, &s->scatter[k*D*(D+1)/2]);
+}
+
+
+
+/* ===== Global parameters ===== */
+
+/* Expected log stick weights given the counts of the first K components */
+static double stick_bound(const double *counts, const int K, const double alpha)
+{
+	double result = 0;
+	double remaining = 0;
+	for(int k=K-1; k>=0; k--) {
+		result += lbeta(1 + counts[k], alpha + remaining) - lbeta(1, alpha);
+		remaining += counts[k];
+	}
+	return result;
+}
+
+
+
+/* Sets the global variational parameters from the global statistics */
+static void update_global(Variational *vb)
+{
+	const int D = vb->D;
+	SuffStats *s = &vb->global;
+	const int P = D*(D+1)/2;
+
+	// Components
+	for(int k=0; k<vb->K; k++) {
+		Table *table = &vb->components[k];
+		niw_posterior(&vb->prior, vb->prior_scatter, s->N[k], &s->sum[k*D], &s->scatter[k*P], table);
+		table->size = (unsigned int)round(s->N[k]);
+		vb->logZ[k] = niw_lognorm(table);
+		// E[log|Λ|]/2 - (D/2)log(2π) - D/(2κ) for Λ ~ W(Ψ⁻¹, ν)
+		double Elogdet = D*log(2) - 2*table->logdetpsi;
+		for(int i=0; i<D; i++) {
+			Elogdet += digamma(0.5*(table->nu - i));
+		}
+		vb->Elogdet[k] = 0.5*Elogdet - 0.5*D*log(2*M_PI) - 0.5*D/table->kappa;
+	}
+
+	// Sticks: aₖ = 1 + Nₖ and bₖ = α + Σⱼ₍>ₖ₎ Nⱼ
+	double remaining = 0;
+	for(int k=vb->K-1; k>=0; k--) {
+		vb->a[k] = 1 + s->N[k];
+		vb->b[k] = vb->alpha + remaining;
+		remaining += s->N[k];
+	}
+
+	// E[log πₖ] = E[log vₖ] + Σⱼ₍<ₖ₎ E[log(1-vⱼ)]
+	double Elog1mv = 0;
+	for(int k=0; k<vb->K; k++) {
+		double digamma_ab = digamma(vb->a[k] + vb->b[k]);
+		vb->Elogpi[k] = digamma(vb->a[k]) - digamma_ab + Elog1mv;
+		Elog1mv += digamma(vb->b[k]) - digamma_ab;
+	}
+}
+
+
+
+/* Evidence lower bound for the current global statistics */
+double variational_elbo(Variational *vb)
+{
+	const int D = vb->D;
+	SuffStats *s = &vb->global;
+	const double logZ0 = niw_lognorm(&vb->prior);
+	double result = stick_bound(s->N, vb->K, vb->alpha);
+	for(int k=0; k<vb->K; k++) {
+		result += vb->logZ[k] - logZ0 - 0.5*D*log(2*M_PI)*s->N[k] + s->H[k];
+	}
+	return result;
+}
+
+
+
+/* ===== Local step ===== */
+
+/* Computes the responsibilities of a customer, adds them to the statistics and returns the log evidence */
+static double local_step(Variational *vb, const int customer_index, SuffStats *s)
+{
+	const int D = vb->D;
+	const double *x = vb->customers[customer_index];
+	double r[vb->K];
+	double z[D];
+	double maxr = -INFINITY;
+	for(int k=0; k<vb->K; k++) {
+		Table *table = &vb->components[k];
+		memcpy(z, x, D*sizeof(double));
+		cblas_daxpy(D, -1.0, table->xi, 1, z, 1);
+		cblas_dtpsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, D, table->psi, z, 1);
+		r[k] = vb->Elogpi[k] + vb->Elogdet[k] - 0.5*table->nu*cblas_ddot(D, z, 1, z, 1);
+		if(r[k] > maxr) {
+			maxr = r[k];
+		}
+	}
+	double Z = 0;
+	for(int k=0; k<vb->K; k++) {
+		r[k] = exp(r[k] - maxr);
+		Z += r[k];
+	}
+	for(int k=0; k<vb->K; k++) {
+		r[k] /= Z;
+		if(r[k] > RESP_THRESHOLD) {
+			stats_add(s, k, x, r[k]);
+			s->H[k] -= r[k]*log(r[k]);
+		}
+	}
+	for(int p=0; p<vb->num_pairs; p++) {
+		double rp = r[vb->pairs[p][0]] + r[vb->pairs[p][1]];
+		if(rp > RESP_THRESHOLD) {
+			s->pair_H[p] -= rp*log(rp);
+		}
+	}
+	return log(Z) + maxr;
+}
+
+
+
+/* Remembers the worst explained customers of the lap as birth candidates */
+static void track_worst(Variational *vb, const int customer_index, const double logp)
+{
+	int i = vb->num_worst < BIRTHS_PER_LAP ? vb->num_worst++ : BIRTHS_PER_LAP;
+	// Insertion into the list sorted by increasing log evidence
+	while(i > 0 && logp < vb->worst_logp[i-1]) {
+		if(i < BIRTHS_PER_LAP) {
+			vb->worst[i] = vb->worst[i-1];
+			vb->worst_logp[i] = vb->worst_logp[i-1];
+		}
+		i--;
+	}
+	if(i < BIRTHS_PER_LAP) {
+		vb->worst[i] = customer_index;
+		vb->worst_logp[i] = logp;
+	}
+}
+
+
+
+/* ===== Birth, merge and delete moves ===== */
+
+/* Removes the components whose keep flag is zero from every set of statistics */
+static void delete_components(Variational *vb, const int *keep)
+{
+	stats_compact(&vb->global, keep, vb->K);
+	if(vb->mode == MEMOIZED) {
+		for(int b=0; b<vb->B; b++) {
+			stats_compact(&vb->batches[b], keep, vb->K);
+		}
+	}
+	int K = 0;
+	for(int k=0; k<vb->K; k++) {
+		K += keep[k];
+	}
+	vb->K = K;
+}
+
+
+
+/* Squared Mahalanobis distance from component j to the location of component k under the expected precision νΨ⁻¹ of j */
+static double component_distance(Variational *vb, const int j, const int k)
+{
+	const int D = vb->D;
+	Table *table = &vb->components[j];
+	double z[D];
+	memcpy(z, vb->components[k].xi, D*sizeof(double));
+	cblas_daxpy(D, -1.0, table->xi, 1, z, 1);
+	cblas_dtpsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, D, table->psi, z, 1);
+	return table->nu*cblas_ddot(D, z, 1, z, 1);
+}
+
+
+
+/* Folds every component whose keep flag is zero into its nearest kept component */
+static void fold_components(Variational *vb, int *keep)
+{
+	int kept[vb->K];
+	int num_kept = 0;
+	for(int k=0; k<vb->K; k++) {
+		if(keep[k]) {
+			kept[num_kept++] = k;
+		}
+	}
+	if(num_kept == 0) { // Always keep the largest component
+		keep[0] = 1;
+		kept[num_kept++] = 0;
+	}
+	for(int k=0; k<vb->K; k++) {
+		if(keep[k]) {
+			continue;
+		}
+		int j = kept[0];
+		for(int i=1; i<num_kept; i++) {
+			if(component_distance(vb, k, kept[i]) < component_distance(vb, k, j)) {
+				j = kept[i];
+			}
+		}
+		stats_merge(&vb->global, j, k, -1);
+		if(vb->mode == MEMOIZED) {
+			for(int b=0; b<vb->B; b++) {
+				stats_merge(&vb->batches[b], j, k, -1);
+			}
+		}
+	}
+	delete_components(vb, keep);
+}
+
+
+
+/* Greedily merges candidate pairs whenever this increases the ELBO */
+static void merge_components(Variational *vb)
+{
+	const int D = vb->D;
+	SuffStats *s = &vb->global;
+	const int P = D*(D+1)/2;
+	const double logZ0 = niw_lognorm(&vb->prior);
+	int keep[vb->K];
+	int touched[vb->K];
+	double counts[vb->K];
+	for(int k=0; k<vb->K; k++) {
+		keep[k] = 1;
+		touched[k] = 0;
+	}
+	Table merged = {0};
+	merged.D = D;
+	merged.xi = calloc(D, sizeof(double));
+	merged.psi = calloc(P, sizeof(double));
+	double sum[D];
+	double scatter[P];
+
+	for(int p=0; p<vb->num_pairs; p++) {
+		int j = vb->pairs[p][0];
+		int k = vb->pairs[p][1];
+		if(touched[j] || touched[k]) {
+			continue;
+		}
+		// Component j absorbs component k
+		memcpy(sum, &s->sum[j*D], D*sizeof(double));
+		cblas_daxpy(D, 1.0, &s->sum[k*D], 1, sum, 1);
+		memcpy(scatter, &s->scatter[j*P], P*sizeof(double));
+		cblas_daxpy(P, 1.0, &s->scatter[k*P], 1, scatter, 1);
+		niw_posterior(&vb->prior, vb->prior_scatter, s->N[j] + s->N[k], sum, scatter, &merged);
+
+		// Change in the stick-breaking bound with component k removed
+		int m = 0;
+		for(int i=0; i<vb->K; i++) {
+			if(keep[i] && i != k) {
+				counts[m++] = i == j ? s->N[j] + s->N[k] : s->N[i];
+			}
+		}
+		double gain = stick_bound(counts, m, vb->alpha);
+		m = 0;
+		for(int i=0; i<vb->K; i++) {
+			if(keep[i]) {
+				counts[m++] = s->N[i];
+			}
+		}
+		gain -= stick_bound(counts, m, vb->alpha);
+		gain += niw_lognorm(&merged) - vb->logZ[j] - vb->logZ[k] + logZ0;
+		gain += s->pair_H[p] - s->H[j] - s->H[k];
+
+		if(gain > 0) {
+			stats_merge(s, j, k, p);
+			if(vb->mode == MEMOIZED) {
+				for(int b=0; b<vb->B; b++) {
+					stats_merge(&vb->batches[b], j, k, p);
+				}
+			}
+			vb->logZ[j] = niw_lognorm(&merged);
+			keep[k] = 0;
+			touched[j] = touched[k] = 1;
+		}
+	}
+	free(merged.xi);
+	free(merged.psi);
+	delete_components(vb, keep);
+}
+
+
+
+/* Folds the components that have lost (almost) all of their customers into their neighbours */
+static void prune_components(Variational *vb)
+{
+	int keep[vb->K];
+	for(int k=0; k<vb->K; k++) {
+		keep[k] = vb->global.N[k] >= PRUNE_MASS;
+	}
+	fold_components(vb, keep);
+}
+
+
+
+/* Saves the statistics before births are proposed, so that a rejection can undo the whole lap */
+static void save_components(Variational *vb)
+{
+	vb->saved_K = vb->K;
+	stats_copy(&vb->saved_global, &vb->global, vb->K);
+	for(int b=0; b<vb->B; b++) {
+		stats_copy(&vb->saved_batches[b], &vb->batches[b], vb->K);
+	}
+}
+
+
+
+/* Restores the statistics saved before the births of this lap. The merge candidates refer to
+ * the born components and are dropped. */
+static void reject_births(Variational *vb)
+{
+	vb->K = vb->saved_K;
+	stats_copy(&vb->global, &vb->saved_global, vb->K);
+	for(int b=0; b<vb->B; b++) {
+		stats_copy(&vb->batches[b], &vb->saved_batches[b], vb->K);
+	}
+	vb->num_pairs = 0;
+}
+
+
+
+/* Sorts the components by decreasing expected count, which tightens the stick-breaking bound */
+static void sort_components(Variational *vb)
+{
+	int order[vb->K];
+	int perm[vb->K];
+	for(int k=0; k<vb->K; k++) {
+		order[k] = k;
+	}
+	for(int k=1; k<vb->K; k++) { // Insertion sort, K is small
+		int i = k;
+		while(i > 0 && vb->global.N[order[i-1]] < vb->global.N[order[i]]) {
+			int tmp = order[i];
+			order[i] = order[i-1];
+			order[i-1] = tmp;
+			i--;
+		}
+	}
+	for(int k=0; k<vb->K; k++) {
+		perm[order[k]] = k;
+	}
+	stats_permute(&vb->global, perm, vb->K);
+	if(vb->mode == MEMOIZED) {
+		for(int b=0; b<vb->B; b++) {
+			stats_permute(&vb->batches[b], perm, vb->K);
+		}
+	}
+}
+
+
+
+/* Creates new components at the worst explained customers of the last lap */
+static void birth_components(Variational *vb)
+{
+	const int D = vb->D;
+	// Births only enter the global statistics. They are dropped again once the next lap
+	// has assigned the new components their share of every batch.
+	vb->first_born = vb->K;
+	for(int i=0; i<vb->num_worst && vb->K < vb->Kmax; i++) {
+		int k = vb->K++;
+		vb->global.N[k] = 0;
+		vb->global.H[k] = 0;
+		memset(&vb->global.sum[k*D], 0, D*sizeof(double));
+		memset(&vb->global.scatter[k*D*(D+1)/2], 0, (D*(D+1)/2)*sizeof(double));
+		stats_add(&vb->global, k, vb->customers[vb->worst[i]], 1.0);
+		if(vb->mode == MEMOIZED) {
+			for(int b=0; b<vb->B; b++) {
+				vb->batches[b].N[k] = 0;
+				vb->batches[b].H[k] = 0;
+				memset(&vb->batches[b].sum[k*D], 0, D*sizeof(double));
+				memset(&vb->batches[b].scatter[k*D*(D+1)/2], 0, (D*(D+1)/2)*sizeof(double));
+			}
+		}
+	}
+	vb->num_worst = 0;
+}
+
+
+
+/* Chooses the merge candidates for the next lap: each component paired with its nearest neighbour */
+static void choose_merge_pairs(Variational *vb)
+{
+	double dist[vb->K];
+	int nearest[vb->K];
+	for(int j=0; j<vb->K; j++) {
+		dist[j] = INFINITY;
+		nearest[j] = -1;
+		for(int k=0; k<vb->K; k++) {
+			double d = k != j ? component_distance(vb, j, k) : INFINITY;
+			if(d < dist[j]) {
+				dist[j] = d;
+				nearest[j] = k;
+			}
+		}
+	}
+	// Keep the closest pairs, listing each pair once with the earlier (larger) component first
+	vb->num_pairs = 0;
+	while(vb->num_pairs < MAX_MERGE_PAIRS) {
+		int best = -1;
+		for(int j=0; j<vb->K; j++) {
+			if(nearest[j] >= 0 && (best < 0 || dist[j] < dist[best])) {
+				best = j;
+			}
+		}
+		if(best < 0) {
+			break;
+		}
+		int partner = nearest[best];
+		nearest[best] = -1;
+		if(nearest[partner] == best) { // Mutual nearest neighbours give the same pair
+			nearest[partner] = -1;
+		}
+		vb->pairs[vb->num_pairs][0] = best < partner ? best : partner;
+		vb->pairs[vb->num_pairs][1] = best < partner ? partner : best;
+		vb->num_pairs++;
+	}
+}
+
+
+
+/* ===== Inference ===== */
+
+/* Creates a variational DPGMM for a copy of the N by D data array (row major) with K0 components seeded at random customers */
+Variational *variational_init(const double *data, const int N, const int D, Rng *rng, const VariationalMode mode, const int B, const int K0, const int Kmax, const double alpha, const double xi[], const double kappa, const double nu, const double psi[])
+{
+	Variational *vb = calloc(1, sizeof(Variational));
+	vb->N = N;
+	vb->D = D;
+	vb->customers = calloc(N, sizeof(double *));
+	for(int i=0; i<N; i++) {
+		vb->customers[i] = calloc(D, sizeof(double));
+		memcpy(vb->customers[i], &data[i*D], D*sizeof(double));
+	}
+	vb->rng = rng;
+	vb->mode = mode;
+	vb->B = B;
+	vb->Kmax = Kmax;
+	vb->alpha = alpha;
+
+	// Prior hyperparameters
+	vb->prior.D = D;
+	vb->prior.xi = calloc(D, sizeof(double));
+	memcpy(vb->prior.xi, xi, D*sizeof(double));
+	vb->prior.kappa = kappa;
+	vb->prior.nu = nu;
+	vb->prior.psi = calloc(D*(D+1)/2, sizeof(double));
+	memcpy(vb->prior.psi, psi, (D*(D+1)/2)*sizeof(double));
+	vb->prior.logdetpsi = logdet(D, psi);
+	vb->prior_scatter = calloc(D*(D+1)/2, sizeof(double));
+	niw_scatter(&vb->prior, vb->prior_scatter);
+
+	// Components
+	vb->components = calloc(Kmax, sizeof(Table));
+	for(int k=0; k<Kmax; k++) {
+		vb->components[k].D = D;
+		vb->components[k].xi = calloc(D, sizeof(double));
+		vb->components[k].psi = calloc(D*(D+1)/2, sizeof(double));
+	}
+	vb->logZ = calloc(Kmax, sizeof(double));
+	vb->a = calloc(Kmax, sizeof(double));
+	vb->b = calloc(Kmax, sizeof(double));
+	vb->Elogpi = calloc(Kmax, sizeof(double));
+	vb->Elogdet = calloc(Kmax, sizeof(double));
+
+	// Statistics
+	stats_alloc(&vb->global, Kmax, D);
+	if(mode == MEMOIZED) {
+		vb->batches = calloc(B, sizeof(SuffStats));
+		vb->saved_batches = calloc(B, sizeof(SuffStats));
+		for(int b=0; b<B; b++) {
+			stats_alloc(&vb->batches[b], Kmax, D);
+			stats_alloc(&vb->saved_batches[b], Kmax, D);
+		}
+		stats_alloc(&vb->saved_global, Kmax, D);
+	} else {
+		stats_alloc(&vb->local, Kmax, D);
+	}
+	vb->pairs = calloc(MAX_MERGE_PAIRS, sizeof(int[2]));
+	vb->worst = calloc(BIRTHS_PER_LAP, sizeof(int));
+	vb->worst_logp = calloc(BIRTHS_PER_LAP, sizeof(double));
+
+	// Seed the components at random customers. Like births, the seeds only enter the global
+	// statistics and are dropped after the first lap.
+	vb->K = K0 < Kmax ? K0 : Kmax;
+	for(int k=0; k<vb->K; k++) {
+		stats_add(&vb->global, k, vb->customers[(int)(N*randu(rng))], 1.0);
+	}
+	vb->elbo = -INFINITY;
+	update_global(vb);
+	return vb;
+}
+
+
+
+/* Frees the model */
+void variational_destroy(Variational *vb)
+{
+	for(int i=0; i<vb->N; i++) {
+		free(vb->customers[i]);
+	}
+	free(vb->customers);
+	free(vb->prior.xi);
+	free(vb->prior.psi);
+	free(vb->prior_scatter);
+	for(int k=0; k<vb->Kmax; k++) {
+		free(vb->components[k].xi);
+		free(vb->components[k].psi);
+	}
+	free(vb->components);
+	free(vb->logZ);
+	free(vb->a);
+	free(vb->b);
+	free(vb->Elogpi);
+	free(vb->Elogdet);
+	stats_free(&vb->global);
+	if(vb->mode == MEMOIZED) {
+		for(int b=0; b<vb->B; b++) {
+			stats_free(&vb->batches[b]);
+			stats_free(&vb->saved_batches[b]);
+		}
+		free(vb->batches);
+		free(vb->saved_batches);
+		stats_free(&vb->saved_global);
+	} else {
+		stats_free(&vb->local);
+	}
+	free(vb->pairs);
+	free(vb->worst);
+	free(vb->worst_logp);
+	free(vb);
+}
+
+
+
+/* Performs one pass through the data followed by the birth, merge and delete moves */
+void variational_lap(Variational *vb)
+{
+	const int N = vb->N;
+	if(vb->mode == MEMOIZED) {
+		// Propose new components at the worst explained customers of the previous lap,
+		// unless the previous proposals were rejected
+		if(vb->births_rejected) {
+			vb->births_rejected = 0;
+			vb->num_worst = 0;
+		}
+		if(vb->num_worst > 0) {
+			save_components(vb);
+		}
+		birth_components(vb);
+		update_global(vb);
+		choose_merge_pairs(vb);
+
+		for(int b=0; b<vb->B; b++) {
+			// Swap the cached statistics of the batch for freshly computed ones
+			SuffStats *batch = &vb->batches[b];
+			stats_axpby(-1.0, batch, 1.0, &vb->global, vb->K);
+			stats_zero(batch, vb->K);
+			for(int i=b*N/vb->B; i<(b+1)*N/vb->B; i++) {
+				track_worst(vb, i, local_step(vb, i, batch));
+			}
+			stats_axpby(1.0, batch, 1.0, &vb->global, vb->K);
+			update_global(vb);
+		}
+		// Resum the batches. This clears rounding error and the births of the previous lap.
+		stats_zero(&vb->global, vb->K);
+		for(int b=0; b<vb->B; b++) {
+			stats_axpby(1.0, &vb->batches[b], 1.0, &vb->global, vb->K);
+		}
+	} else {
+		const int M = N/vb->B > 0 ? N/vb->B : 1; // Minibatch size
+		for(int b=0; b<vb->B; b++) {
+			stats_zero(&vb->local, vb->K);
+			for(int m=0; m<M; m++) {
+				int i = (int)(N*randu(vb->rng));
+				local_step(vb, i, &vb->local);
+			}
+			// Natural gradient step: the global statistics are the natural parameters less the prior
+			double rho = pow(vb->steps++ + STOCHASTIC_DELAY, -STOCHASTIC_FORGET);
+			stats_axpby(rho*N/M, &vb->local, 1 - rho, &vb->global, vb->K);
+			update_global(vb);
+		}
+	}
+	update_global(vb);
+
+	// Adapt the truncation level
+	if(vb->mode == MEMOIZED) {
+		// Births survive only if the lap they took part in increased the ELBO. Otherwise the
+		// state before the births is restored, and its ELBO is the previous one.
+		if(vb->first_born < vb->K && variational_elbo(vb) < vb->elbo) {
+			reject_births(vb);
+			update_global(vb);
+			vb->births_rejected = 1;
+		}
+		merge_components(vb);
+	}
+	prune_components(vb);
+	sort_components(vb);
+	update_global(vb);
+	vb->elbo = variational_elbo(vb);
+	vb->laps++;
+}
+
+
+
+/* Log posterior predictive density of a point */
+double variational_log_predictive(Variational *vb, const double *x)
+{
+	// Mixture of the Student-t predictives with weights E[πₖ], plus the prior predictive for the remaining mass
+	double logp[vb->K+1];
+	double log_remaining = 0;
+	double maxlogp = -INFINITY;
+	for(int k=0; k<vb->K; k++) {
+		logp[k] = log(vb->a[k]/(vb->a[k] + vb->b[k])) + log_remaining + log_likelihood(&vb->components[k], x);
+		log_remaining += log(vb->b[k]/(vb->a[k] + vb->b[k]));
+	}
+	logp[vb->K] = log_remaining + log_likelihood(&vb->prior, x);
+	for(int k=0; k<=vb->K; k++) {
+		if(logp[k] > maxlogp) {
+			maxlogp = logp[k];
+		}
+	}
+	double Z = 0;
+	for(int k=0; k<=vb->K; k++) {
+		Z += exp(logp[k] - maxlogp);
+	}
+	return log(Z) + maxlogp;
+}
+
+
+
+/* Appends the components to the same output files as the Gibbs sampler */
+void variational_export(Variational *vb)
+{
+	const int D = vb->D;
+	export_data(INT, &vb->K, 1, "output/occupied_tables.txt");
+	export_data(DOUBLE, &vb->alpha, 1, "output/alpha.txt");
+	for(int k=0; k<vb->K; k++) {
+		Table *table = &vb->components[k];
+		export_data(DOUBLE, table->xi, D, "output/xi.txt");
+		export_data(DOUBLE, table->psi, D*(D+1)/2, "output/psi.txt");
+		export_data(DOUBLE, &table->nu, 1, "output/nu.txt");
+		export_data(DOUBLE, &table->kappa, 1, "output/kappa.txt");
+		export_data(INT, &table->size, 1, "output/table_sizes.txt");
+	}
+}
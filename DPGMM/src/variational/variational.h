@@ -0,0 +1,93 @@
+#ifndef _VARIATIONAL_H
+#define _VARIATIONAL_H
+
+#include "../crp.h" /* Table struct */
+
+/*
+ * Variational inference for the DPGMM using a truncated stick-breaking posterior.
+ *
+ * The sticks have q(vₖ) = Beta(aₖ, bₖ) and the components q(θₖ) = NIW(ξₖ, κₖ, νₖ, Ψₖ).
+ * The NIW hyperparameters are kept in Table structs using the same conventions as the
+ * Gibbs sampler, so components can be scored with log_likelihood and exported as tables.
+ *
+ * MEMOIZED splits the data into fixed batches and caches the expected sufficient
+ * statistics of each batch, so that every batch visit is an exact coordinate ascent
+ * step (Hughes and Sudderth, 2013). A single batch gives standard full-batch updates.
+ * STOCHASTIC takes natural gradient steps using random minibatches (Hoffman et al., 2013).
+ *
+ * The truncation level adapts between laps. Components that lose their mass are folded
+ * into their neighbours. In MEMOIZED mode, where the cached statistics make the ELBO
+ * exact, new components are also born at the worst explained customers and kept only
+ * if they increase the ELBO, and pairs of components are merged whenever this
+ * increases the ELBO.
+ */
+
+typedef enum {
+	MEMOIZED, STOCHASTIC
+} VariationalMode;
+
+/* Expected sufficient statistics of each component */
+typedef struct SuffStats {
+	int D; /* Dimensionality of data */
+	double *N; /* Expected number of customers */
+	double *sum; /* Expected sum of the customers (Kmax by D) */
+	double *scatter; /* Expected sum of outer products (Kmax by D(D+1)/2, packed upper triangular) */
+	double *H; /* Entropy of the responsibilities: -Σ r log r */
+	double *pair_H; /* Entropy of the summed responsibilities of each merge candidate */
+} SuffStats;
+
+/* Variational DPGMM */
+typedef struct Variational {
+	int N; /* Number of customers */
+	int D; /* Dimensionality of data */
+	double **customers; /* Customers stored as an N by D array. Owned by the model. */
+	Rng *rng; /* Random number generator. Not owned. */
+	VariationalMode mode;
+	int K; /* Number of active components (truncation level) */
+	int Kmax; /* Largest truncation level allowed */
+	int B; /* Number of batches. In STOCHASTIC mode the minibatches hold N/B customers. */
+	double alpha; /* Concentration parameter (fixed) */
+	Table prior; /* Prior NIW hyperparameters */
+	double *prior_scatter; /* Ψ + κξξ' for the prior hyperparameters */
+	Table *components; /* NIW posterior of each component. size holds the rounded expected count. */
+	double *logZ; /* Log normaliser of each component's NIW posterior */
+	double *a, *b; /* Beta posterior of each stick */
+	double *Elogpi; /* Expected log mixture weights */
+	double *Elogdet; /* Constant part of the expected log likelihood of each component */
+	SuffStats global; /* Statistics summed over all customers */
+	SuffStats *batches; /* Cached statistics of each batch (MEMOIZED only) */
+	SuffStats local; /* Scratch statistics for a minibatch (STOCHASTIC only) */
+	int saved_K; /* Number of components before the births of the current lap */
+	SuffStats saved_global; /* Global statistics before the births of the current lap (MEMOIZED only) */
+	SuffStats *saved_batches; /* Batch statistics before the births of the current lap (MEMOIZED only) */
+	int num_pairs; /* Number of merge candidates */
+	int (*pairs)[2]; /* Merge candidates for the current lap */
+	int num_worst; /* Number of birth candidates */
+	int *worst; /* Worst explained customers in the current lap */
+	double *worst_logp; /* Log evidence of the worst explained customers */
+	long steps; /* Number of stochastic steps taken */
+	int first_born; /* Index of the first component born at the start of the lap */
+	int births_rejected; /* Nonzero if the components born in the last lap were rejected */
+	int laps; /* Number of completed passes through the data */
+	double elbo; /* Evidence lower bound after the last lap */
+} Variational;
+
+/* Creates a variational DPGMM for a copy of the N by D data array (row major) with K0 components seeded at random customers */
+Variational *variational_init(const double *data, const int N, const int D, Rng *rng, const VariationalMode mode, const int B, const int K0, const int Kmax, const double alpha, const double xi[], const double kappa, const double nu, const double psi[]);
+
+/* Frees the model */
+void variational_destroy(Variational *vb);
+
+/* Performs one pass through the data followed by the birth, merge and delete moves */
+void variational_lap(Variational *vb);
+
+/* Evidence lower bound for the current global statistics */
+double variational_elbo(Variational *vb);
+
+/* Log posterior predictive density of a point */
+double variational_log_predictive(Variational *vb, const double *x);
+
+/* Appends the components to the same output files as the Gibbs sampler */
+void variational_export(Variational *vb);
+
+#endif
@@ -0,0 +1,69 @@
+#include "src/variational/variational.h" // variational_init, variational_lap, variational_export
+#include "src/random/random.h" // initialise_rngs
+#include "src/utils/utils.h" // import_data, export_data
+#include "src/crp.h" // linspace
+#include <math.h> // exp
+#include <stdio.h> // printf
+#include <stdlib.h> // calloc, free
+
+#define MODE MEMOIZED // MEMOIZED or STOCHASTIC
+#define BATCHES 4 // Number of memoized batches, or N/BATCHES customers per stochastic minibatch
+#define LAPS 100 // Number of passes through the data
+#define INITIAL_COMPONENTS 10 // Components seeded at random customers
+#define MAX_COMPONENTS 100 // Largest truncation level
+
+int main(int argc, char *argv[])
+{
+	const int N = 272; // Number of data points
+	const int D = 2; // Dimensionality of data.
+
+	// Seeds rng with system time
+	Rng rng;
+	initialise_rngs(&rng);
+
+	// Component hyperparameters
+	double xi[] = {0.,0.};
+	double psi[] = {1., 0.,1.};
+	double kappa = 0.0001;
+	double nu = 2.;
+
+	// Concentration parameter
+	double alpha = 1.0;
+
+	// Import data
+	double *data = calloc(N*D, sizeof(double));
+	import_data(argv[1], N, D, data);
+
+	// Fit the variational posterior
+	Variational *vb = variational_init(data, N, D, &rng, MODE, BATCHES, INITIAL_COMPONENTS, MAX_COMPONENTS, alpha, xi, kappa, nu, psi);
+	free(data);
+	for(int i=0; i<LAPS; i++) {
+		variational_lap(vb);
+		printf("Lap %d: ELBO = %f, K = %d, alpha = %f\n", i+1, vb->elbo, vb->K, vb->alpha);
+	}
+	variational_export(vb);
+
+	// Evaluate the predictive posterior on the same mesh grid as the Gibbs sampler
+	printf("Evaluating posterior predictive distribution on meshgrid.\n");
+	int nx = 500;
+	int ny = 500;
+	double xgrid[nx];
+	double ygrid[ny];
+	double output[nx];
+	double x[2];
+	linspace(0,7, nx, xgrid);
+	linspace(40, 100, ny, ygrid);
+	for(int j=0; j<ny; j++) {
+		x[1] = ygrid[j];
+		for(int i=0; i<nx; i++) {
+			x[0] = xgrid[i];
+			output[i] = exp(variational_log_predictive(vb, x));
+		}
+		export_data(DOUBLE, output, nx, "plots/post_pred_surf.txt");
+	}
+	export_data(DOUBLE, xgrid, nx, "plots/xgrid.txt");
+	export_data(DOUBLE, ygrid, ny, "plots/ygrid.txt");
+
+	printf("Complete.\n");
+	return 0;
+}
@@ -14,8 +14,24 @@ Hmin = -5.0;  	H0 = 0.0;	Hmax = 5.0; # Strength of external magnetic field
 fps = 30 # Frames per second
 spf = 1000 # Metropolis steps per frame update
 
+# Set native to True to simulate with the native engine in its own process (make frames).
+# It sweeps continuously and update shows its newest frame, so drawing never pauses it.
+native = False
+sweeps_per_frame = 1 # Sweeps between the frames published by the native engine
+
+# Set extension to True to simulate with the native engine in this process (make python).
+# It has the interface of IsingModel, and update runs the same single spin steps.
+extension = False
+
 # Initialise Ising model
-model = IsingModel(D, T0, J0, H0)
+if native:
+	from FrameRing import RingModel
+	model = RingModel(D, T0, J0, H0, sweeps_per_frame)
+elif extension:
+	from NativeIsing import IsingModel as NativeModel
+	model = NativeModel(D, T0, J0, H0)
+else:
+	model = IsingModel(D, T0, J0, H0)
 
 # Initialise animation
 fig, ax = plt.subplots()
@@ -56,4 +72,6 @@ t1 = time()
 interval = 1000 * (1./fps) - (t1 - t0)
 
 ani = animation.FuncAnimation(fig, animate, frames=300, interval=interval, blit=False, init_func=init)
-plt.show()
\ No newline at end of file
+plt.show()
+if native:
+	model.close()
\ No newline at end of file
@@ -0,0 +1,125 @@
+import mmap
+import os
+import subprocess
+import time
+import numpy as np
+
+# Layout of src/frames/frames.h
+HEADER = np.dtype([('magic', '<u4'), ('version', '<u4'), ('D', '<u4'), ('slots', '<u4'),
+	('slot_bytes', '<u8'), ('latest', '<u8'), ('stop', '<u8'), ('parameter_sequence', '<u8'),
+	('T', '<f8'), ('J', '<f8'), ('H', '<f8'), ('padding', 'u1', 56)])
+SLOT = np.dtype([('sequence', '<u8'), ('sweep', '<u8'), ('T', '<f8'), ('J', '<f8'), ('H', '<f8'),
+	('E', '<f8'), ('M', '<f8'), ('padding', 'u1', 8)])
+MAGIC = 0x52465349
+
+class FrameRing:
+	'''
+	Viewer of the frame ring written by the native frames program
+	'''
+	def __init__(self, path, timeout=10.0):
+		# Wait for the simulation to create the file and write its header
+		deadline = time.time() + timeout
+		while not (os.path.exists(path) and os.path.getsize(path) >= HEADER.itemsize):
+			if time.time() > deadline:
+				raise IOError('No frame ring at ' + path)
+			time.sleep(0.01)
+		with open(path, 'r+b') as f:
+			self.map = mmap.mmap(f.fileno(), 0)
+		self.header = np.frombuffer(self.map, HEADER, 1)[0]
+		while self.header['magic'] != MAGIC:
+			if time.time() > deadline:
+				raise IOError('No frame ring at ' + path)
+			time.sleep(0.01)
+		self.D = int(self.header['D'])
+		self.row_bytes = (self.D + 7) // 8
+		self.parameter_sequence = int(self.header['parameter_sequence'])
+
+	def latest(self):
+		'''
+		Newest frame as a grid of ±1 spins, with its slot header, or None before the first frame
+		'''
+		while True:
+			latest = int(self.header['latest'])
+			if latest == 0:
+				return None
+			offset = HEADER.itemsize + ((latest - 1) % int(self.header['slots']))*int(self.header['slot_bytes'])
+			slot = np.frombuffer(self.map, SLOT, 1, offset)[0]
+			before = int(slot['sequence'])
+			if before != 2*latest:
+				continue
+			info = slot.copy()
+			bits = np.frombuffer(self.map, np.uint8, self.D*self.row_bytes, offset + SLOT.itemsize).copy()
+			# Accept the copy only if the slot was not rewritten meanwhile
+			if int(slot['sequence']) == before:
+				grid = 1 - 2*np.unpackbits(bits.reshape(self.D, self.row_bytes), axis=1)[:, :self.D].astype(np.int8)
+				return grid, info
+
+	def set_parameters(self, T, J, H):
+		'''
+		Asks the simulation to continue at T, J and H
+		'''
+		self.parameter_sequence += 1 # Odd while writing
+		self.header['parameter_sequence'] = self.parameter_sequence
+		self.header['T'] = T
+		self.header['J'] = J
+		self.header['H'] = H
+		self.parameter_sequence += 1
+		self.header['parameter_sequence'] = self.parameter_sequence
+
+	def stop(self):
+		'''
+		Asks the simulation to exit
+		'''
+		self.header['stop'] = 1
+
+class RingModel:
+	'''
+	Stand-in for IsingModel backed by the native frames program running in its own process
+	'''
+	def __init__(self, D, T, J, H, sweeps_per_frame=1, path='/tmp/ising.frames'):
+		self.D = D
+		self.T = T
+		self.J = J
+		self.H = H
+		if os.path.exists(path):
+			os.remove(path)
+		self.process = subprocess.Popen(['./frames', str(D), str(T), str(J), str(H), str(sweeps_per_frame), '0', 'ring', path])
+		self.ring = FrameRing(path)
+		while self.ring.latest() is None:
+			time.sleep(0.001)
+		self.update()
+
+	def update(self, steps=1):
+		'''
+		Shows the newest frame. The simulation runs on regardless, so steps is ignored.
+		'''
+		self.grid, frame = self.ring.latest()
+		self.E = frame['E']
+
+	def set_T(self, T):
+		'''
+		Sets the temperature to T
+		'''
+		self.T = T
+		self.ring.set_parameters(self.T, self.J, self.H)
+
+	def set_J(self, J):
+		'''
+		Sets the strength of pairwise interaction to J
+		'''
+		self.J = J
+		self.ring.set_parameters(self.T, self.J, self.H)
+
+	def set_H(self, H):
+		'''
+		Sets the strength of external magnetic field to H
+		'''
+		self.H = H
+		self.ring.set_parameters(self.T, self.J, self.H)
+
+	def close(self):
+		'''
+		Stops the simulation
+		'''
+		self.ring.stop()
+		self.process.wait()
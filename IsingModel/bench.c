@@ -0,0 +1,254 @@
+#include "src/ising/ising.h" // ising_create, ising_align, ising_sweep, ising_update, ising_energy, ising_destroy, ISING_TC_PER_J
+#include "src/cluster/cluster.h" // clusters_create, wolff_update, wolff_burn_in, swendsen_wang_sweep, clusters_destroy
+#include "src/nfold/nfold.h" // nfold_create, nfold_advance, nfold_destroy
+#include "src/multispin/multispin.h" // multispin_create, multispin_recount, multispin_sweep, multispin_energy, multispin_destroy
+#include "src/replicas/replicas.h" // replicas_create, replicas_sweep, replicas_measure, replicas_destroy, REPLICAS
+#include "src/autocorr/autocorr.h" // integrated_autocorrelation
+#include <stdio.h> // printf, fprintf, fflush
+#include <stdlib.h> // atof, atoi, malloc, calloc, free, exit
+#include <string.h> // memset
+#include <time.h> // clock_gettime
+
+#define SEED 12345 // Key of every lattice, so that runs can be compared
+#define J 1.0 // Strength of pairwise interaction
+#define H 0.0 // Strength of external magnetic field
+#define THROUGHPUT_T 2.269 // Temperature of the throughput measurements, close to critical
+#define WARMUP_SWEEPS 20 // Sweeps before each throughput measurement
+#define AUTOCORR_D 64 // Side length of the lattices of the autocorrelation measurements
+#define AUTOCORR_THREADS 4 // Threads of the autocorrelation measurements
+#define BURNIN_FRACTION 0.1 // Fraction of the sweeps left out of the autocorrelation times
+
+static const int sizes[] = {64, 256, 1024}; // Side lengths of the throughput measurements
+static const int thread_counts[] = {1, 2, 4}; // Threads of the throughput measurements of the threaded kernels
+static const double temperatures[] = {2.0, 2.269, 2.6}; // Temperatures of the autocorrelation measurements
+
+/* Update kernels compared */
+enum Kernel {SINGLE, CHECKERBOARD, MULTISPIN, REPLICA, WOLFF, SW, NFOLD, NUM_KERNELS};
+static const char *kernel_names[NUM_KERNELS] = {"single", "checkerboard", "multispin", "replicas", "wolff", "sw", "nfold"};
+static const int kernel_threaded[NUM_KERNELS] = {0, 1, 1, 1, 0, 1, 0}; // Whether a kernel uses the thread pool
+
+/* Lattice updated by one kernel */
+typedef struct Bench {
+	enum Kernel kernel;
+	int D;
+	Ising *model;
+	Clusters *clusters;
+	NFold *nf;
+	Multispin *multispin;
+	Replicas *replicas;
+	long wolff_per_sweep; /* Wolff clusters per sweep, fixed by bench_warm */
+} Bench;
+
+
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Creates the lattice of a kernel, from random spins or with every spin up */
+static Bench *bench_create(const enum Kernel kernel, const int D, const double T, const int threads, const int ordered)
+{
+	Bench *bench = calloc(1, sizeof(Bench));
+	bench->kernel = kernel;
+	bench->D = D;
+	bench->wolff_per_sweep = 1;
+	if(kernel == MULTISPIN) {
+		bench->multispin = multispin_create(D, T, J, H, SEED, threads);
+		if(ordered) {
+			memset(bench->multispin->grid, 0xff, (size_t)D*bench->multispin->W*sizeof(uint64_t));
+			multispin_recount(bench->multispin);
+		}
+	} else if(kernel == REPLICA) {
+		bench->replicas = replicas_create(D, T, J, H, SEED, threads);
+		if(ordered) {
+			memset(bench->replicas->grid, 0xff, (size_t)D*D*sizeof(uint64_t));
+		}
+	} else {
+		bench->model = ising_create(D, T, J, H, SEED, threads);
+		if(ordered) {
+			ising_align(bench->model, 1);
+		}
+		if(kernel == WOLFF || kernel == SW) {
+			bench->clusters = clusters_create(bench->model);
+		} else if(kernel == NFOLD) {
+			bench->nf = nfold_create(bench->model);
+		}
+	}
+	return bench;
+}
+
+
+
+/* Frees the lattice */
+static void bench_destroy(Bench *bench)
+{
+	if(bench->multispin != NULL) {
+		multispin_destroy(bench->multispin);
+	}
+	if(bench->replicas != NULL) {
+		replicas_destroy(bench->replicas);
+	}
+	if(bench->clusters != NULL) {
+		clusters_destroy(bench->clusters);
+	}
+	if(bench->nf != NULL) {
+		nfold_destroy(bench->nf);
+	}
+	if(bench->model != NULL) {
+		ising_destroy(bench->model);
+	}
+	free(bench);
+}
+
+
+
+/* Runs one sweep of the kernel: D² single spin steps, one unit of n-fold time, or Wolff clusters worth about D² sites */
+static void bench_sweep(Bench *bench)
+{
+	switch(bench->kernel) {
+	case SINGLE: ising_update(bench->model, (long)bench->D*bench->D); break;
+	case CHECKERBOARD: ising_sweep(bench->model, 1); break;
+	case MULTISPIN: multispin_sweep(bench->multispin, 1); break;
+	case REPLICA: replicas_sweep(bench->replicas, 1); break;
+	case WOLFF: wolff_update(bench->clusters, bench->wolff_per_sweep); break;
+	case SW: swendsen_wang_sweep(bench->clusters, 1); break;
+	case NFOLD: nfold_advance(bench->nf, 1.0); break;
+	default: break;
+	}
+}
+
+
+
+/* Runs sweeps to bring the lattice to equilibrium, fixing the clusters per Wolff sweep */
+static void bench_warm(Bench *bench, const int sweeps)
+{
+	for(int sweep=0; sweep<sweeps; sweep++) {
+		if(bench->kernel == WOLFF) {
+			bench->wolff_per_sweep = wolff_burn_in(bench->clusters, sweep, sweeps);
+		} else {
+			bench_sweep(bench);
+		}
+	}
+}
+
+
+
+/* Energy and |M| per site, averaged over the replicas of the replica kernel */
+static void bench_measure(Bench *bench, double *E, double *absM)
+{
+	const double N = (double)bench->D*bench->D;
+	if(bench->kernel == REPLICA) {
+		int64_t bonds_r[REPLICAS], M_r[REPLICAS];
+		replicas_measure(bench->replicas, bonds_r, M_r);
+		*E = *absM = 0;
+		for(int r=0; r<REPLICAS; r++) {
+			*E += (-J*bonds_r[r] - H*M_r[r])/(N*REPLICAS);
+			*absM += (M_r[r] < 0 ? -M_r[r] : M_r[r])/(N*REPLICAS);
+		}
+	} else if(bench->kernel == MULTISPIN) {
+		*E = multispin_energy(bench->multispin)/N;
+		*absM = (bench->multispin->M < 0 ? -bench->multispin->M : bench->multispin->M)/N;
+	} else {
+		*E = ising_energy(bench->model)/N;
+		*absM = (bench->model->M < 0 ? -bench->model->M : bench->model->M)/N;
+	}
+}
+
+
+
+/* Sweeps the kernel for at least the given time and prints its sweeps and spin updates per second */
+static void throughput(const enum Kernel kernel, const int D, const int threads, const double seconds)
+{
+	Bench *bench = bench_create(kernel, D, THROUGHPUT_T, threads, 0);
+	bench_warm(bench, WARMUP_SWEEPS);
+	uint64_t flipped = kernel == WOLFF ? bench->clusters->wolff_sites : 0;
+	long sweeps = 0;
+	double start = now(), elapsed;
+	do {
+		bench_sweep(bench);
+		sweeps++;
+		elapsed = now() - start;
+	} while(elapsed < seconds);
+	// A Wolff sweep covers the sites of its clusters rather than exactly D² of them
+	double updates = kernel == WOLFF ? (double)(bench->clusters->wolff_sites - flipped) : (double)sweeps*D*D;
+	if(kernel == REPLICA) {
+		updates *= REPLICAS;
+	}
+	printf("%s\t%d\t%d\t%.1f\t%.3e\n", kernel_names[kernel], D, threads, sweeps/elapsed, updates/elapsed);
+	fflush(stdout);
+	bench_destroy(bench);
+}
+
+
+
+/*
+ * Measures the integrated autocorrelation times of E and |M| of the kernel at T, and the independent
+ * samples they leave per second. Below T_c the lattice starts ordered: a random lattice coarsens over
+ * a number of sweeps that grows like D², which a burn-in of a fixed fraction of the sweeps does not cover.
+ */
+static void autocorrelation(const enum Kernel kernel, const double T, const int sweeps)
+{
+	Bench *bench = bench_create(kernel, AUTOCORR_D, T, AUTOCORR_THREADS, T < ISING_TC_PER_J*J);
+	int burnin = (int)(BURNIN_FRACTION*sweeps);
+	bench_warm(bench, burnin);
+	const int n = sweeps - burnin;
+	double *E = malloc(n*sizeof(double));
+	double *absM = malloc(n*sizeof(double));
+	double seconds = 0;
+	for(int i=0; i<n; i++) {
+		double start = now();
+		bench_sweep(bench);
+		seconds += now() - start;
+		bench_measure(bench, &E[i], &absM[i]);
+	}
+	double tau_E = integrated_autocorrelation(E, n, NULL);
+	double tau_M = integrated_autocorrelation(absM, n, NULL);
+	// The replicas are independent chains, each with the autocorrelation time of their average
+	const int chains = kernel == REPLICA ? REPLICAS : 1;
+	printf("%s\t%.3f\t%.2f\t%.2f\t%.1f\t%.1f\n", kernel_names[kernel], T, tau_E, tau_M, chains*n/seconds/(2*tau_E), chains*n/seconds/(2*tau_M));
+	fflush(stdout);
+	free(E);
+	free(absM);
+	bench_destroy(bench);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : 0.5; // Time of each throughput measurement
+	const int sweeps = argc > 2 ? atoi(argv[2]) : 20000; // Sweeps of each autocorrelation measurement
+	if(seconds <= 0 || sweeps < 100) {
+		fprintf(stderr, "Usage: %s [seconds per throughput measurement] [sweeps per autocorrelation measurement, at least 100]\n", argv[0]);
+		exit(1);
+	}
+
+	printf("Throughput at T = %.3f, J = %g, H = %g\n", THROUGHPUT_T, J, H);
+	printf("kernel\tD\tthreads\tsweeps/s\tupdates/s\n");
+	for(int kernel=0; kernel<NUM_KERNELS; kernel++) {
+		for(unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+			for(unsigned t=0; t<sizeof(thread_counts)/sizeof(thread_counts[0]); t++) {
+				if(t > 0 && !kernel_threaded[kernel]) {
+					break;
+				}
+				throughput(kernel, sizes[s], kernel_threaded[kernel] ? thread_counts[t] : 1, seconds);
+			}
+		}
+	}
+
+	printf("\nAutocorrelation times in sweeps on %d x %d with %d threads, over %d sweeps\n", AUTOCORR_D, AUTOCORR_D, AUTOCORR_THREADS, sweeps);
+	printf("Below T_c = %.6f the lattices start ordered, above it from random spins. The first %d sweeps are left out.\n", ISING_TC_PER_J*J, (int)(BURNIN_FRACTION*sweeps));
+	printf("kernel\tT\ttau_E\ttau_|M|\tsamples/s(E)\tsamples/s(|M|)\n");
+	for(unsigned i=0; i<sizeof(temperatures)/sizeof(temperatures[0]); i++) {
+		for(int kernel=0; kernel<NUM_KERNELS; kernel++) {
+			autocorrelation(kernel, temperatures[i], sweeps);
+		}
+	}
+	return 0;
+}
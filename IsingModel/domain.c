@@ -0,0 +1,69 @@
+#include "src/domain/domain.h" // domain_create, domain_sweep, domain_energy, domain_gather, domain_destroy
+#include "src/ising/ising.h" // ising_create, ising_sweep, ising_energy, ising_destroy
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // atoi, atof, malloc, free, exit
+#include <string.h> // strcmp, memcmp
+#include <time.h> // time, clock_gettime
+
+#define REPORT_INTERVAL 100 // Sweeps between printed observables
+#define CHECK_SIZE 1024 // Largest lattice compared with a single process run
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 8) {
+		fprintf(stderr, "Usage: %s D T J H sweeps Px Py [shm|sockets]\n", argv[0]);
+		exit(1);
+	}
+	const int D = atoi(argv[1]); // Side length of square lattice
+	const double T = atof(argv[2]); // Temperature
+	const double J = atof(argv[3]); // Strength of pairwise interaction
+	const double H = atof(argv[4]); // Strength of external magnetic field
+	const int sweeps = atoi(argv[5]);
+	const int Px = atoi(argv[6]); // Tiles across
+	const int Py = atoi(argv[7]); // Tiles down
+	const char *transport = argc > 8 ? argv[8] : "shm";
+	if(strcmp(transport, "shm") != 0 && strcmp(transport, "sockets") != 0) {
+		fprintf(stderr, "Unknown transport %s\n", transport);
+		exit(1);
+	}
+	const double N = (double)D*D;
+	const uint64_t seed = (uint64_t)time(NULL);
+
+	Domain *domain = domain_create(D, T, J, H, seed, Px, Py, strcmp(transport, "shm") == 0 ? DOMAIN_SHARED_MEMORY : DOMAIN_SOCKETS);
+	printf("sweep\tE/N\tM/N\n");
+	double start = now();
+	for(int sweep=0; sweep<sweeps; sweep+=REPORT_INTERVAL) {
+		int n = sweeps - sweep < REPORT_INTERVAL ? sweeps - sweep : REPORT_INTERVAL;
+		domain_sweep(domain, n);
+		printf("%d\t%f\t%f\n", sweep + n, domain_energy(domain)/N, domain->M/N);
+	}
+	double seconds = now() - start;
+	printf("%d sweeps of %d x %d in %d x %d tiles over %s in %.3f s: %.1f sweeps/s, %.3g spin updates/s\n", sweeps, D, D, Px, Py, transport, seconds, sweeps/seconds, sweeps*N/seconds);
+
+	// The decomposed run should reproduce the single process engine exactly
+	if(D <= CHECK_SIZE) {
+		int8_t *grid = malloc((size_t)D*D);
+		domain_gather(domain, grid);
+		Ising *model = ising_create(D, T, J, H, seed, 1);
+		ising_sweep(model, sweeps);
+		if(memcmp(grid, model->grid, (size_t)D*D) != 0 || model->bonds != domain->bonds || model->M != domain->M) {
+			fprintf(stderr, "The decomposed lattice differs from the single process one\n");
+			exit(1);
+		}
+		printf("Matches ising_sweep with the same seed.\n");
+		ising_destroy(model);
+		free(grid);
+	}
+	domain_destroy(domain);
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "src/frames/frames.h" // frames_create, frames_publish, frames_parameters, frames_pack, frames_write_pbm, frames_close
+#include "src/ising/ising.h" // ising_create, ising_sweep, ising_set_T, ising_set_J, ising_set_H, ising_destroy
+#include <stdio.h> // printf, fprintf, fopen, fclose, stdout
+#include <stdlib.h> // atoi, atof, atol, malloc, free, exit
+#include <string.h> // strcmp
+#include <time.h> // time, clock_gettime
+
+#define THREADS 4 // Number of threads sweeping the lattice
+#define SLOTS 8 // Frames kept in the ring
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 9 || (strcmp(argv[7], "ring") != 0 && strcmp(argv[7], "pbm") != 0)) {
+		fprintf(stderr, "Usage: %s D T J H sweeps_per_frame frames ring|pbm path\n", argv[0]);
+		fprintf(stderr, "Zero frames runs until a viewer stops the ring. A pbm path of - writes to standard output.\n");
+		exit(1);
+	}
+	const int D = atoi(argv[1]); // Side length of square lattice
+	const double T = atof(argv[2]); // Temperature
+	const double J = atof(argv[3]); // Strength of pairwise interaction
+	const double H = atof(argv[4]); // Strength of external magnetic field
+	const int sweeps_per_frame = atoi(argv[5]);
+	const long frames = atol(argv[6]);
+	const int headless = strcmp(argv[7], "pbm") == 0;
+	const char *path = argv[8];
+
+	Ising *model = ising_create(D, T, J, H, (uint64_t)time(NULL), THREADS);
+	FrameRing *ring = NULL;
+	FILE *fp = NULL;
+	uint8_t *bits = NULL;
+	if(headless) {
+		fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+		if(fp == NULL) {
+			fprintf(stderr, "Cannot open %s\n", path);
+			exit(1);
+		}
+		bits = malloc((size_t)D*((D + 7)/8));
+	} else {
+		ring = frames_create(path, D, SLOTS);
+	}
+
+	// The simulation never waits for a viewer. Viewers sample whichever frame is newest.
+	double start = now();
+	uint64_t sweep = 0;
+	long frame;
+	for(frame=0; frames == 0 || frame < frames; frame++) {
+		if(headless) {
+			frames_pack(model, bits);
+			frames_write_pbm(fp, bits, D);
+		} else {
+			double new_T, new_J, new_H;
+			if(frames_parameters(ring, &new_T, &new_J, &new_H)) {
+				ising_set_T(model, new_T);
+				ising_set_J(model, new_J);
+				ising_set_H(model, new_H);
+			}
+			frames_publish(ring, model, sweep);
+			if(__atomic_load_n(&ring->header->stop, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+		}
+		ising_sweep(model, sweeps_per_frame);
+		sweep += sweeps_per_frame;
+	}
+	double seconds = now() - start;
+	fprintf(stderr, "%ld frames of %d x %d, %d sweeps apart, in %.3f s: %.1f frames/s\n", frame, D, D, sweeps_per_frame, seconds, frame/seconds);
+
+	if(headless) {
+		if(fp != stdout) {
+			fclose(fp);
+		}
+		free(bits);
+	} else {
+		frames_close(ring);
+	}
+	ising_destroy(model);
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include "src/ising/ising.h" // ising_create, ising_sweep, ising_energy, ising_recount, ising_destroy
+#include "src/cluster/cluster.h" // clusters_create, wolff_update, wolff_burn_in, swendsen_wang_sweep, clusters_destroy
+#include "src/nfold/nfold.h" // nfold_create, nfold_advance, nfold_destroy
+#include "src/multispin/multispin.h" // multispin_create, multispin_sweep, multispin_energy, multispin_recount, multispin_destroy
+#include "src/replicas/replicas.h" // replicas_create, replicas_sweep, replicas_measure, replicas_destroy, REPLICAS
+#include "src/autocorr/autocorr.h" // integrated_autocorrelation
+#include "src/histogram/histogram.h" // histogram_create, histogram_add, histogram_write, histogram_destroy
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // atoi, atof, malloc, free, exit
+#include <string.h> // strcmp
+#include <time.h> // time, clock_gettime
+
+#define THREADS 4 // Number of threads sweeping the lattice
+#define REPORT_INTERVAL 100 // Sweeps between printed observables
+#define BURNIN_FRACTION 0.1 // Fraction of the sweeps left out of the autocorrelation times
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 6) {
+		fprintf(stderr, "Usage: %s D T J H sweeps [metropolis|wolff|sw|nfold|multispin|replicas] [histogram]\n", argv[0]);
+		exit(1);
+	}
+	const int D = atoi(argv[1]); // Side length of square lattice
+	const double T = atof(argv[2]); // Temperature
+	const double J = atof(argv[3]); // Strength of pairwise interaction
+	const double H = atof(argv[4]); // Strength of external magnetic field
+	const int sweeps = atoi(argv[5]);
+	const char *algorithm = argc > 6 ? argv[6] : "metropolis";
+	const char *histogram_file = argc > 7 ? argv[7] : NULL; // Where to write the histogram of the sweeps after burn-in
+	const double N = (double)D*D;
+	if(strcmp(algorithm, "metropolis") != 0 && strcmp(algorithm, "wolff") != 0 && strcmp(algorithm, "sw") != 0 && strcmp(algorithm, "nfold") != 0 && strcmp(algorithm, "multispin") != 0 && strcmp(algorithm, "replicas") != 0) {
+		fprintf(stderr, "Unknown algorithm %s\n", algorithm);
+		exit(1);
+	}
+
+	// The multi-spin coded lattices replace the byte per spin lattice rather than sharing it
+	const int packed = strcmp(algorithm, "multispin") == 0;
+	const int ensemble = strcmp(algorithm, "replicas") == 0;
+	const int chains = ensemble ? REPLICAS : 1; // Independent Markov chains sampled
+	Ising *model = NULL;
+	Clusters *clusters = NULL;
+	NFold *nf = NULL;
+	Multispin *multispin = NULL;
+	Replicas *replicas = NULL;
+	if(packed) {
+		multispin = multispin_create(D, T, J, H, (uint64_t)time(NULL), THREADS);
+	} else if(ensemble) {
+		replicas = replicas_create(D, T, J, H, (uint64_t)time(NULL), THREADS);
+	} else {
+		model = ising_create(D, T, J, H, (uint64_t)time(NULL), THREADS);
+		clusters = clusters_create(model);
+		nf = nfold_create(model);
+	}
+	double *E = malloc(sweeps*sizeof(double));
+	double *absM = malloc(sweeps*sizeof(double));
+	int burnin = (int)(BURNIN_FRACTION*sweeps);
+	Histogram *histogram = histogram_file != NULL ? histogram_create(D, T, J, H) : NULL;
+	long wolff_per_sweep = 1; // Clusters per sweep, fixed by the burn-in
+	if(ensemble) {
+		printf("Observables are averaged over %d replicas.\n", REPLICAS);
+	}
+	printf("sweep\tE/N\tM/N\n");
+	double seconds = 0;
+	for(int sweep=0; sweep<sweeps; sweep++) {
+		double start = now();
+		if(strcmp(algorithm, "wolff") == 0) {
+			if(sweep < burnin) {
+				wolff_per_sweep = wolff_burn_in(clusters, sweep, burnin);
+			} else {
+				wolff_update(clusters, wolff_per_sweep);
+			}
+		} else if(strcmp(algorithm, "sw") == 0) {
+			swendsen_wang_sweep(clusters, 1);
+		} else if(strcmp(algorithm, "nfold") == 0) {
+			nfold_advance(nf, 1.0); // One sweep of continuous time
+		} else if(packed) {
+			multispin_sweep(multispin, 1);
+		} else if(ensemble) {
+			replicas_sweep(replicas, 1);
+		} else {
+			ising_sweep(model, 1);
+		}
+		seconds += now() - start;
+		double M;
+		if(ensemble) {
+			int64_t bonds_r[REPLICAS], M_r[REPLICAS];
+			replicas_measure(replicas, bonds_r, M_r);
+			E[sweep] = absM[sweep] = M = 0;
+			for(int r=0; r<REPLICAS; r++) {
+				E[sweep] += (-J*bonds_r[r] - H*M_r[r])/(N*REPLICAS);
+				absM[sweep] += (M_r[r] < 0 ? -M_r[r] : M_r[r])/(N*REPLICAS);
+				M += (double)M_r[r]/REPLICAS;
+				if(histogram != NULL && sweep >= burnin) {
+					histogram_add(histogram, bonds_r[r], M_r[r]);
+				}
+			}
+		} else {
+			M = packed ? multispin->M : model->M;
+			if(histogram != NULL && sweep >= burnin) {
+				histogram_add(histogram, packed ? multispin->bonds : model->bonds, packed ? multispin->M : model->M);
+			}
+			E[sweep] = (packed ? multispin_energy(multispin) : ising_energy(model))/N;
+			absM[sweep] = (M < 0 ? -M : M)/N;
+		}
+		if((sweep+1) % REPORT_INTERVAL == 0) {
+			printf("%d\t%f\t%f\n", sweep+1, E[sweep], M/N);
+		}
+	}
+	printf("%d %s sweeps of %d x %d on %d threads in %.3f s: %.1f sweeps/s\n", sweeps, algorithm, D, D, THREADS, seconds, sweeps/seconds);
+	if(strcmp(algorithm, "wolff") == 0) {
+		printf("%ld clusters per sweep, of mean size %.1f\n", wolff_per_sweep, (double)clusters->wolff_sites/clusters->wolff_grown);
+	}
+
+	// Autocorrelation times in sweeps, and the independent samples they leave per second
+	int window_E, window_M;
+	double tau_E = integrated_autocorrelation(E + burnin, sweeps - burnin, &window_E);
+	double tau_M = integrated_autocorrelation(absM + burnin, sweeps - burnin, &window_M);
+	printf("tau_int(E) = %.2f sweeps (window %d), tau_int(|M|) = %.2f sweeps (window %d)\n", tau_E, window_E, tau_M, window_M);
+	printf("Independent samples per second: %.2f of E, %.2f of |M|\n", chains*sweeps/seconds/(2*tau_E), chains*sweeps/seconds/(2*tau_M));
+	free(E);
+	free(absM);
+	if(histogram != NULL) {
+		histogram_write(histogram, histogram_file);
+		printf("Histogram of %ld samples in %zu states written to %s\n", histogram->samples, histogram->size, histogram_file);
+		histogram_destroy(histogram);
+	}
+	if(ensemble) {
+		replicas_destroy(replicas);
+		return 0;
+	}
+
+	// The tracked energy should match a recount
+	double tracked = packed ? multispin_energy(multispin) : ising_energy(model);
+	double recounted;
+	if(packed) {
+		multispin_recount(multispin);
+		recounted = multispin_energy(multispin);
+		multispin_destroy(multispin);
+	} else {
+		ising_recount(model);
+		recounted = ising_energy(model);
+		clusters_destroy(clusters);
+		nfold_destroy(nf);
+		ising_destroy(model);
+	}
+	if(tracked != recounted) {
+		fprintf(stderr, "Tracked energy %f differs from recount %f\n", tracked, recounted);
+		exit(1);
+	}
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include "src/scan/scan.h" // scan_create, scan_run, scan_export, scan_destroy
+#include <stdio.h> // fprintf, sscanf, fopen, fclose
+#include <stdlib.h> // atoi, strtoull, malloc, free, exit
+#include <string.h> // strcmp
+#include <time.h> // time, clock_gettime
+
+#define THREADS 4 // Default number of grid points run at once
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Parses a single value or an evenly spaced range min:max:count. Returns the values and sets count. */
+static double *parse_values(const char *spec, const char *name, int *count)
+{
+	double min, max;
+	int n;
+	char extra;
+	if(sscanf(spec, "%lf:%lf:%d%c", &min, &max, &n, &extra) == 3 && n >= 1) {
+		double *values = malloc(n*sizeof(double));
+		for(int i=0; i<n; i++) {
+			values[i] = n > 1 ? min + (max - min)*i/(n - 1) : min;
+		}
+		*count = n;
+		return values;
+	}
+	if(sscanf(spec, "%lf%c", &min, &extra) == 1) {
+		double *values = malloc(sizeof(double));
+		values[0] = min;
+		*count = 1;
+		return values;
+	}
+	fprintf(stderr, "Invalid %s values %s, expected a number or min:max:count\n", name, spec);
+	exit(1);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 8) {
+		fprintf(stderr, "Usage: %s D T H J equilibration_sweeps measurement_sweeps output [seed] [threads]\n", argv[0]);
+		fprintf(stderr, "T, H and J are each a number or an evenly spaced range min:max:count. An output of - means standard output.\n");
+		fprintf(stderr, "The seed defaults to the current time and the threads to %d.\n", THREADS);
+		exit(1);
+	}
+	const int D = atoi(argv[1]); // Side length of square lattice
+	int num_T, num_H, num_J;
+	double *T = parse_values(argv[2], "T", &num_T);
+	double *H = parse_values(argv[3], "H", &num_H);
+	double *J = parse_values(argv[4], "J", &num_J);
+	const int equilibration = atoi(argv[5]);
+	const int measurement = atoi(argv[6]);
+	const uint64_t seed = argc > 8 ? strtoull(argv[8], NULL, 10) : (uint64_t)time(NULL); // Seed of the first point
+	const int threads = argc > 9 ? atoi(argv[9]) : THREADS;
+	if(D < 2 || D % 2 != 0 || equilibration < 0 || measurement < 1 || threads < 1) {
+		fprintf(stderr, "Invalid lattice size %d, sweeps %d and %d or threads %d\n", D, equilibration, measurement, threads);
+		exit(1);
+	}
+	for(int i=0; i<num_T; i++) {
+		if(T[i] <= 0) {
+			fprintf(stderr, "Invalid temperature %g\n", T[i]);
+			exit(1);
+		}
+	}
+
+	Scan *scan = scan_create(D, T, num_T, H, num_H, J, num_J, equilibration, measurement, seed, threads);
+	fprintf(stderr, "Scanning %d x %d x %d points of %d x %d on %d threads with seed %llu.\n", num_T, num_H, num_J, D, D, threads, (unsigned long long)seed);
+	double start = now();
+	scan_run(scan);
+	double seconds = now() - start;
+	double busy = 0;
+	for(int k=0; k<scan->num_points; k++) {
+		busy += scan->points[k].seconds;
+	}
+	fprintf(stderr, "Scan complete in %.3f s (%.3f s of work per point).\n", seconds, busy/scan->num_points);
+
+	FILE *fp = strcmp(argv[7], "-") == 0 ? stdout : fopen(argv[7], "w");
+	if(fp == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[7]);
+		exit(1);
+	}
+	scan_export(scan, fp);
+	if(fp != stdout) {
+		fclose(fp);
+	}
+	scan_destroy(scan);
+	free(T);
+	free(H);
+	free(J);
+	return 0;
+}
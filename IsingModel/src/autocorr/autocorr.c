@@ -0,0 +1,35 @@
+#include "autocorr.h"
+#include <stddef.h> // NULL
+
+
+
+/* Integrated autocorrelation time of x[0],...,x[n-1]. Sets window to the window used if it is not NULL. */
+double integrated_autocorrelation(const double *x, const int n, int *window)
+{
+	double mean = 0;
+	for(int i=0; i<n; i++) {
+		mean += x[i];
+	}
+	mean /= n;
+	double c0 = 0;
+	for(int i=0; i<n; i++) {
+		c0 += (x[i] - mean)*(x[i] - mean);
+	}
+	double tau = 0.5;
+	int W = 0;
+	if(c0 > 0) {
+		// Add lags until the window is wide enough, or the series runs out
+		while(W < n/2 && W < AUTOCORR_C*tau) {
+			W++;
+			double c = 0;
+			for(int i=0; i<n-W; i++) {
+				c += (x[i] - mean)*(x[i+W] - mean);
+			}
+			tau += c/c0;
+		}
+	}
+	if(window != NULL) {
+		*window = W;
+	}
+	return tau;
+}
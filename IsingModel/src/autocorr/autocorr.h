@@ -0,0 +1,15 @@
+#ifndef _AUTOCORR_H
+#define _AUTOCORR_H
+
+/*
+ * Integrated autocorrelation time τ = 1/2 + Σₜ ρ(t) of a time series, summed over the
+ * self-consistent window of Sokal (1997): the smallest W with W >= AUTOCORR_C τ(W).
+ * A series of n samples holds about n/(2τ) independent ones.
+ */
+
+#define AUTOCORR_C 6.0 /* Window width in units of τ */
+
+/* Integrated autocorrelation time of x[0],...,x[n-1]. Sets window to the window used if it is not NULL. */
+double integrated_autocorrelation(const double *x, const int n, int *window);
+
+#endif
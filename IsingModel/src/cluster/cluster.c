@@ -0,0 +1,378 @@
+#include "cluster.h"
+#include <math.h> // exp, fabs
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memset
+#include "../random/philox.h" // philox_fill
+
+
+
+/* Allocates the workspace for a model */
+Clusters *clusters_create(Ising *model)
+{
+	const size_t N = (size_t)model->D*model->D;
+	Clusters *clusters = calloc(1, sizeof(Clusters));
+	clusters->model = model;
+	clusters->stack = malloc(N*sizeof(int));
+	clusters->stamp = calloc(N, sizeof(uint32_t));
+	clusters->parent = malloc(N*sizeof(int32_t));
+	clusters->size = malloc(N*sizeof(int32_t));
+	clusters->mag = malloc(N*sizeof(int32_t));
+	clusters->first = malloc(N*sizeof(int32_t));
+	clusters->flip = malloc(N);
+	clusters->boundary = malloc((size_t)model->num_tasks*model->D);
+	clusters->task_bonds = calloc(model->num_tasks, sizeof(int64_t));
+	clusters->task_M = calloc(model->num_tasks, sizeof(int64_t));
+	return clusters;
+}
+
+
+
+/* Frees the workspace. The model is left untouched. */
+void clusters_destroy(Clusters *clusters)
+{
+	free(clusters->stack);
+	free(clusters->stamp);
+	free(clusters->parent);
+	free(clusters->size);
+	free(clusters->mag);
+	free(clusters->first);
+	free(clusters->flip);
+	free(clusters->boundary);
+	free(clusters->task_bonds);
+	free(clusters->task_M);
+	free(clusters);
+}
+
+
+
+/* Sets the probability of freezing a satisfied bond for the current T and J */
+static void update_bond_threshold(Clusters *clusters)
+{
+	const Ising *model = clusters->model;
+	double p = model->T > 0 ? 1 - exp(-2*fabs(model->J)/model->T) : 1.0;
+	clusters->bond_threshold = p >= 1 ? ISING_ALWAYS : (uint32_t)(p*2147483648.0);
+}
+
+
+
+/* Next random number of the current Wolff cluster */
+static uint32_t wolff_random(Clusters *clusters)
+{
+	if(clusters->random_index == 64) {
+		philox_fill(clusters->model->seed, (uint32_t)clusters->wolff_clusters, 0, ising_stream(ISING_STREAM_WOLFF, clusters->wolff_clusters), clusters->random_block, clusters->random, 16);
+		clusters->random_block += 16;
+		clusters->random_index = 0;
+	}
+	return clusters->random[clusters->random_index++];
+}
+
+
+
+/* Grows and flips one Wolff cluster, unless the field rejects the flip. Returns its size either way. */
+static int wolff_cluster(Clusters *clusters)
+{
+	Ising *model = clusters->model;
+	const int D = model->D;
+	int8_t *grid = model->grid;
+	const uint32_t bond_threshold = clusters->bond_threshold;
+	clusters->random_index = 64;
+	clusters->random_block = 0;
+	if(++clusters->current_stamp == 0) { // The stamps have wrapped around
+		memset(clusters->stamp, 0, (size_t)D*D*sizeof(uint32_t));
+		clusters->current_stamp = 1;
+	}
+	const uint32_t stamp = clusters->current_stamp;
+
+	// Each member is flipped as soon as it joins, so its original spin is minus its current one
+	int seed_site = (int)(((uint64_t)wolff_random(clusters)*((uint64_t)D*D)) >> 32);
+	int size = 1, top = 0, m = grid[seed_site];
+	clusters->stack[0] = seed_site;
+	clusters->stamp[seed_site] = stamp;
+	grid[seed_site] = -grid[seed_site];
+	while(top < size) {
+		int site = clusters->stack[top++];
+		int i = site/D, j = site % D;
+		int s = -grid[site];
+		int neighbours[4] = {((i+D-1) % D)*D + j, ((i+1) % D)*D + j, i*D + (j+D-1) % D, i*D + (j+1) % D};
+		for(int k=0; k<4; k++) {
+			int n = neighbours[k];
+			if(clusters->stamp[n] != stamp && model->J*s*grid[n] > 0 && (wolff_random(clusters) >> 1) < bond_threshold) {
+				clusters->stamp[n] = stamp;
+				clusters->stack[size++] = n;
+				m += grid[n];
+				grid[n] = -grid[n];
+			}
+		}
+	}
+
+	// Only the field can reject the flip
+	double dE = 2*model->H*m;
+	if(dE > 0 && !(model->T > 0 && (wolff_random(clusters) >> 1) < exp(-dE/model->T)*2147483648.0)) {
+		for(int c=0; c<size; c++) {
+			grid[clusters->stack[c]] = -grid[clusters->stack[c]];
+		}
+		clusters->wolff_clusters++;
+		return size;
+	}
+
+	// Only the bonds leaving the cluster change
+	int64_t bonds = 0;
+	for(int c=0; c<size; c++) {
+		int site = clusters->stack[c];
+		int i = site/D, j = site % D;
+		int neighbours[4] = {((i+D-1) % D)*D + j, ((i+1) % D)*D + j, i*D + (j+D-1) % D, i*D + (j+1) % D};
+		for(int k=0; k<4; k++) {
+			if(clusters->stamp[neighbours[k]] != stamp) {
+				// From (-s)(sₙ) before the flip to s sₙ after
+				bonds += 2*grid[site]*grid[neighbours[k]];
+			}
+		}
+	}
+	model->bonds += bonds;
+	model->M -= 2*m;
+	clusters->wolff_clusters++;
+	return size;
+}
+
+
+
+/* Grows and flips n Wolff clusters */
+void wolff_update(Clusters *clusters, const long n)
+{
+	update_bond_threshold(clusters);
+	for(long c=0; c<n; c++) {
+		clusters->wolff_sites += wolff_cluster(clusters);
+	}
+	clusters->wolff_grown += n;
+}
+
+
+
+/*
+ * Performs burn-in sweep number sweep out of sweeps, growing single Wolff clusters until they
+ * cover D² sites. Returns the clusters per sweep over the second half of the burn-in so far,
+ * and resets the statistics after the last burn-in sweep.
+ */
+long wolff_burn_in(Clusters *clusters, const int sweep, const int sweeps)
+{
+	const uint64_t N = (uint64_t)clusters->model->D*clusters->model->D;
+	if(sweep == sweeps/2) {
+		clusters->wolff_grown = clusters->wolff_sites = 0;
+	}
+	uint64_t first_site = clusters->wolff_sites;
+	while(clusters->wolff_sites - first_site < N) {
+		wolff_update(clusters, 1);
+	}
+	long per_sweep = (long)((double)N*clusters->wolff_grown/clusters->wolff_sites + 0.5);
+	if(sweep == sweeps - 1) {
+		clusters->wolff_grown = clusters->wolff_sites = 0;
+	}
+	return per_sweep < 1 ? 1 : per_sweep;
+}
+
+
+
+/* Root of a site's cluster, halving the path on the way */
+static int32_t find_root(int32_t *parent, int32_t site)
+{
+	while(parent[site] != site) {
+		parent[site] = parent[parent[site]];
+		site = parent[site];
+	}
+	return site;
+}
+
+
+
+/* Root of a site's cluster, without writing to the forest */
+static int32_t read_root(const int32_t *parent, int32_t site)
+{
+	while(parent[site] != site) {
+		site = parent[site];
+	}
+	return site;
+}
+
+
+
+/* Joins the clusters of two sites, hanging the smaller under the larger */
+static void join(Clusters *clusters, int32_t a, int32_t b)
+{
+	a = find_root(clusters->parent, a);
+	b = find_root(clusters->parent, b);
+	if(a == b) {
+		return;
+	}
+	if(clusters->size[a] < clusters->size[b]) {
+		int32_t tmp = a;
+		a = b;
+		b = tmp;
+	}
+	clusters->parent[b] = a;
+	clusters->size[a] += clusters->size[b];
+	clusters->mag[a] += clusters->mag[b];
+	if(clusters->first[b] < clusters->first[a]) {
+		clusters->first[a] = clusters->first[b];
+	}
+}
+
+
+
+/* Freezes the bonds in one block of rows and joins their clusters. The bonds down to the next block are saved for later. */
+static void sw_bonds(void *arg, const int task)
+{
+	Clusters *clusters = arg;
+	const Ising *model = clusters->model;
+	const int D = model->D;
+	const int start = task*D/model->num_tasks, end = (task+1)*D/model->num_tasks;
+	const uint32_t bond_threshold = clusters->bond_threshold;
+	const double J = model->J;
+	uint32_t r[2*D]; // Right and down bond of each site of a row
+	for(int i=start; i<end; i++) {
+		for(int j=0; j<D; j++) {
+			int32_t site = i*D + j;
+			clusters->parent[site] = site;
+			clusters->size[site] = 1;
+			clusters->mag[site] = model->grid[site];
+			clusters->first[site] = site;
+		}
+	}
+	for(int i=start; i<end; i++) {
+		philox_fill(model->seed, i, (uint32_t)clusters->sw_sweeps, ising_stream(ISING_STREAM_SW_BONDS, clusters->sw_sweeps), 0, r, D/2);
+		const int8_t *row = &model->grid[(size_t)i*D];
+		const int8_t *down = &model->grid[(size_t)((i+1) % D)*D];
+		for(int j=0; j<D; j++) {
+			int right = (j+1) % D;
+			if(J*row[j]*row[right] > 0 && (r[2*j] >> 1) < bond_threshold) {
+				join(clusters, i*D + j, i*D + right);
+			}
+			int frozen = J*row[j]*down[j] > 0 && (r[2*j+1] >> 1) < bond_threshold;
+			if(i < end-1) {
+				if(frozen) {
+					join(clusters, i*D + j, (i+1)*D + j);
+				}
+			} else {
+				clusters->boundary[(size_t)task*D + j] = (uint8_t)frozen;
+			}
+		}
+	}
+}
+
+
+
+/*
+ * Chooses the flip of every cluster whose first site is in one block of rows, using
+ * the random number of that site. The roots depend on the order of the joins, and so
+ * on the number of blocks, but the first sites do not.
+ */
+static void sw_choose(void *arg, const int task)
+{
+	Clusters *clusters = arg;
+	const Ising *model = clusters->model;
+	const int D = model->D;
+	const int start = task*D/model->num_tasks, end = (task+1)*D/model->num_tasks;
+	uint32_t r[4*((D + 3)/4)];
+	for(int i=start; i<end; i++) {
+		philox_fill(model->seed, i, (uint32_t)clusters->sw_sweeps, ising_stream(ISING_STREAM_SW_FLIPS, clusters->sw_sweeps), 0, r, (D + 3)/4);
+		for(int j=0; j<D; j++) {
+			int32_t site = i*D + j;
+			int32_t root = read_root(clusters->parent, site);
+			if(clusters->first[root] == site) {
+				// Heat bath choice between the two orientations of the cluster in the field
+				double p = model->H == 0 ? 0.5 : (model->T > 0 ? 1/(1 + exp(2*model->H*clusters->mag[root]/model->T)) : (model->H*clusters->mag[root] < 0));
+				clusters->flip[root] = (r[j] >> 1) < p*2147483648.0;
+			}
+		}
+	}
+}
+
+
+
+/* Copies the flip of each cluster to its sites in one block of rows, and adds up the changes in bonds and M */
+static void sw_spread(void *arg, const int task)
+{
+	Clusters *clusters = arg;
+	const Ising *model = clusters->model;
+	const int D = model->D;
+	const int start = task*D/model->num_tasks, end = (task+1)*D/model->num_tasks;
+	for(int i=start; i<end; i++) {
+		for(int j=0; j<D; j++) {
+			int32_t site = i*D + j;
+			if(clusters->parent[site] != site) { // The roots already hold their flip, and are read by other blocks
+				clusters->flip[site] = clusters->flip[read_root(clusters->parent, site)];
+			}
+		}
+	}
+}
+
+
+
+/* Adds up the changes in bonds and M of one block of rows. A bond changes when exactly one of its sites flips. */
+static void sw_count(void *arg, const int task)
+{
+	Clusters *clusters = arg;
+	const Ising *model = clusters->model;
+	const int D = model->D;
+	const int start = task*D/model->num_tasks, end = (task+1)*D/model->num_tasks;
+	int64_t bonds = 0, M = 0;
+	for(int i=start; i<end; i++) {
+		const int8_t *row = &model->grid[(size_t)i*D];
+		const int8_t *down = &model->grid[(size_t)((i+1) % D)*D];
+		const uint8_t *flip = &clusters->flip[(size_t)i*D];
+		const uint8_t *flip_down = &clusters->flip[(size_t)((i+1) % D)*D];
+		for(int j=0; j<D; j++) {
+			int right = (j+1) % D;
+			bonds -= 2*row[j]*row[right]*(flip[j] ^ flip[right]);
+			bonds -= 2*row[j]*down[j]*(flip[j] ^ flip_down[j]);
+			M -= 2*row[j]*flip[j];
+		}
+	}
+	clusters->task_bonds[task] = bonds;
+	clusters->task_M[task] = M;
+}
+
+
+
+/* Flips the sites of one block of rows */
+static void sw_apply(void *arg, const int task)
+{
+	Clusters *clusters = arg;
+	Ising *model = clusters->model;
+	const int D = model->D;
+	const size_t start = (size_t)(task*D/model->num_tasks)*D, end = (size_t)((task+1)*D/model->num_tasks)*D;
+	for(size_t site=start; site<end; site++) {
+		model->grid[site] = (int8_t)(model->grid[site]*(1 - 2*clusters->flip[site]));
+	}
+}
+
+
+
+/* Performs sweeps Swendsen-Wang sweeps */
+void swendsen_wang_sweep(Clusters *clusters, const int sweeps)
+{
+	Ising *model = clusters->model;
+	const int D = model->D;
+	update_bond_threshold(clusters);
+	for(int sweep=0; sweep<sweeps; sweep++) {
+		parallel_for(model->pool, model->num_tasks, sw_bonds, clusters);
+		// The bonds between blocks are few, so they are joined on one thread
+		for(int t=0; t<model->num_tasks; t++) {
+			int last = (t+1)*D/model->num_tasks - 1;
+			int next = (last + 1) % D;
+			for(int j=0; j<D; j++) {
+				if(clusters->boundary[(size_t)t*D + j]) {
+					join(clusters, last*D + j, next*D + j);
+				}
+			}
+		}
+		parallel_for(model->pool, model->num_tasks, sw_choose, clusters);
+		parallel_for(model->pool, model->num_tasks, sw_spread, clusters);
+		parallel_for(model->pool, model->num_tasks, sw_count, clusters);
+		parallel_for(model->pool, model->num_tasks, sw_apply, clusters);
+		for(int t=0; t<model->num_tasks; t++) {
+			model->bonds += clusters->task_bonds[t];
+			model->M += clusters->task_M[t];
+		}
+		clusters->sw_sweeps++;
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef _CLUSTER_H
+#define _CLUSTER_H
+
+#include <stdint.h> /* int32_t, uint8_t, uint32_t, uint64_t */
+#include "../ising/ising.h" /* Ising */
+
+/*
+ * Cluster updates of the Fortuin-Kasteleyn representation of an Ising model, which
+ * beat critical slowing down near the critical temperature.
+ *
+ * Every satisfied bond (J sᵢsⱼ > 0) is frozen with probability 1 - exp(-2|J|/T), and
+ * the clusters of frozen bonds are flipped as a whole, so the same code handles J < 0.
+ * A field H is accounted for when a cluster is flipped: a Wolff cluster with total
+ * spin m is flipped with the Metropolis probability min(1, exp(-2Hm/T)), and each
+ * Swendsen-Wang cluster takes its orientation from the heat bath probability
+ * 1/(1 + exp(2Hm/T)) of flipping.
+ *
+ * wolff_update grows a given number of single clusters from random sites. Measuring
+ * after a fixed number of clusters matters: stopping once the clusters add up to a
+ * given number of sites biases the measurements, by 2% in |M| at T = 1.8, H = -0.1.
+ * wolff_burn_in does stop at D² sites, while a random lattice orders and the clusters
+ * grow by orders of magnitude. The second half of the burn-in fixes the number of
+ * clusters per sweep of the measurements, and the statistics are then reset to cover
+ * only those.
+ *
+ * swendsen_wang_sweep labels the clusters of the whole lattice with a union-find
+ * forest: each block of rows of the model's thread pool joins the bonds inside it,
+ * the bonds between blocks are joined afterwards, and the blocks then choose the
+ * flips of their clusters in parallel. The random numbers of a bond or a
+ * cluster depend only on its position, so both updates give the same lattice for any
+ * number of threads.
+ */
+
+/* Workspace of the cluster updates of a model */
+typedef struct Clusters {
+	Ising *model; /* Model being updated. Not owned. */
+	int *stack; /* Sites of the Wolff cluster being grown */
+	uint32_t *stamp; /* Number of the last Wolff cluster that reached each site */
+	uint32_t current_stamp; /* Stamp of the cluster being grown */
+	uint64_t wolff_clusters; /* Number of Wolff clusters grown so far. Names their random number streams. */
+	uint64_t wolff_grown; /* Number of Wolff clusters grown since burn-in */
+	uint64_t wolff_sites; /* Total size of the Wolff clusters grown since burn-in */
+	int random_index; /* Next unused entry of random */
+	uint32_t random_block; /* Next block of the stream of the current Wolff cluster */
+	uint32_t random[64]; /* Random numbers of the current Wolff cluster */
+	int32_t *parent; /* Union-find forest of the Swendsen-Wang clusters */
+	int32_t *size; /* Number of sites below each root */
+	int32_t *mag; /* Total spin below each root */
+	int32_t *first; /* Lowest site below each root */
+	uint8_t *flip; /* Whether each site flips */
+	uint8_t *boundary; /* Frozen bonds from the last row of each block of rows to the next row */
+	uint64_t sw_sweeps; /* Number of Swendsen-Wang sweeps so far */
+	uint32_t bond_threshold; /* A satisfied bond freezes when a 31-bit uniform integer is below this */
+	int64_t *task_bonds, *task_M; /* Change in bonds and M from each block of rows */
+} Clusters;
+
+/* Allocates the workspace for a model */
+Clusters *clusters_create(Ising *model);
+
+/* Frees the workspace. The model is left untouched. */
+void clusters_destroy(Clusters *clusters);
+
+/* Grows and flips n Wolff clusters */
+void wolff_update(Clusters *clusters, const long n);
+
+/* Performs burn-in sweep number sweep out of sweeps and returns the clusters per sweep so far */
+long wolff_burn_in(Clusters *clusters, const int sweep, const int sweeps);
+
+/* Performs sweeps Swendsen-Wang sweeps */
+void swendsen_wang_sweep(Clusters *clusters, const int sweeps);
+
+#endif
@@ -0,0 +1,528 @@
+#include "domain.h"
+#include <errno.h> // errno, EINTR, EAGAIN, EWOULDBLOCK
+#include <fcntl.h> // fcntl, F_SETFL, O_NONBLOCK
+#include <poll.h> // poll, POLLIN, POLLOUT
+#include <sched.h> // sched_yield
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc, calloc, free, exit
+#include <string.h> // memcpy
+#include <sys/mman.h> // mmap, munmap
+#include <sys/socket.h> // socketpair
+#include <sys/wait.h> // waitpid
+#include <unistd.h> // fork, read, write, close, _exit
+#include "../ising/ising.h" // ising_acceptance, ising_stream, ISING_STREAM_INIT, ISING_STREAM_CHECKERBOARD
+#include "../random/philox.h" // philox_fill
+
+#define UP 0 // Directions in which the edges are sent
+#define DOWN 1
+#define LEFT 2
+#define RIGHT 3
+
+enum {COMMAND_SWEEP, COMMAND_PARAMETERS, COMMAND_GATHER, COMMAND_QUIT};
+
+/* Message from the coordinator to a worker */
+typedef struct Command {
+	int type; /* One of the COMMAND_ values */
+	int sweeps; /* Sweeps to perform, for COMMAND_SWEEP */
+	double T, J, H; /* New parameters, for COMMAND_PARAMETERS */
+} Command;
+
+/* Answer of a worker to every command */
+typedef struct Reply {
+	int64_t bonds; /* Bonds counted from the sites of the tile */
+	int64_t M; /* Magnetisation of the tile */
+} Reply;
+
+/* Counter of the workers that have reached a barrier, in the shared mapping */
+typedef struct Barrier {
+	int count; /* Workers waiting at the current barrier */
+	int generation; /* Number of barriers passed */
+} Barrier;
+
+/* State of a worker process, which owns one tile */
+typedef struct Worker {
+	const Domain *domain;
+	int index; /* Number of the tile, ty*Px + tx */
+	int h, w; /* Rows and columns of the tile */
+	int i0, j0; /* Global position of the top left site of the tile */
+	int neighbour[4]; /* Workers owning the tiles above, below, left and right */
+	int8_t *tile; /* Spins of the tile and its halo, (h+2) x (w+2) row major */
+	uint8_t *edge; /* Buffers for the four edges sent and the four received, edge_length each, for DOMAIN_SOCKETS */
+	uint64_t seed; /* Key of the random number generator */
+	uint64_t half_sweeps; /* Number of checkerboard half sweeps so far */
+	uint32_t threshold[10]; /* Acceptance thresholds, indexed as in ising_acceptance */
+	int64_t bonds, M; /* Bonds counted from the sites of the tile, and their magnetisation */
+	int command; /* Worker's end of its command socket */
+	int (*halo)[2]; /* Socket pair of each worker and direction, for DOMAIN_SOCKETS */
+	Barrier *barrier; /* Barrier in the shared mapping, for DOMAIN_SHARED_MEMORY */
+	uint8_t *edges; /* Edges of every worker in the shared mapping, for DOMAIN_SHARED_MEMORY */
+	int edge_length; /* Space for each edge in the shared mapping and the buffers */
+} Worker;
+
+
+
+/* Reads exactly size bytes, or exits if the other end has gone */
+static void read_all(const int fd, void *buffer, const size_t size)
+{
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = read(fd, (char *)buffer + done, size - done);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			fprintf(stderr, "Lost the connection to a domain process\n");
+			exit(1);
+		}
+		done += n;
+	}
+}
+
+
+
+/* Writes exactly size bytes, or exits if the other end has gone */
+static void write_all(const int fd, const void *buffer, const size_t size)
+{
+	size_t done = 0;
+	while(done < size) {
+		ssize_t n = write(fd, (const char *)buffer + done, size - done);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			fprintf(stderr, "Lost the connection to a domain process\n");
+			exit(1);
+		}
+		done += n;
+	}
+}
+
+
+
+/* Waits until every worker has reached the barrier */
+static void barrier_wait(Barrier *barrier, const int P)
+{
+	int generation = __atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE);
+	if(__atomic_add_fetch(&barrier->count, 1, __ATOMIC_ACQ_REL) == P) {
+		__atomic_store_n(&barrier->count, 0, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&barrier->generation, 1, __ATOMIC_RELEASE);
+		return;
+	}
+	while(__atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE) == generation) {
+		sched_yield();
+	}
+}
+
+
+
+/* Copies the edge of the tile sent in a direction into the buffer, and returns its length */
+static int pack_edge(const Worker *worker, const int direction, uint8_t *buffer)
+{
+	const int h = worker->h, w = worker->w, stride = w + 2;
+	if(direction == UP || direction == DOWN) {
+		memcpy(buffer, &worker->tile[(direction == UP ? 1 : h)*stride + 1], w);
+		return w;
+	}
+	for(int i=1; i<=h; i++) {
+		buffer[i-1] = (uint8_t)worker->tile[i*stride + (direction == LEFT ? 1 : w)];
+	}
+	return h;
+}
+
+
+
+/* Copies an edge that a neighbour sent in a direction into the halo on the opposite side */
+static void unpack_halo(Worker *worker, const int direction, const uint8_t *buffer)
+{
+	const int h = worker->h, w = worker->w, stride = w + 2;
+	if(direction == UP || direction == DOWN) {
+		memcpy(&worker->tile[(direction == UP ? h + 1 : 0)*stride + 1], buffer, w);
+		return;
+	}
+	for(int i=1; i<=h; i++) {
+		worker->tile[i*stride + (direction == LEFT ? w + 1 : 0)] = (int8_t)buffer[i-1];
+	}
+}
+
+
+
+/* Fills the halo of the tile with the edges of its neighbours */
+static void exchange(Worker *worker)
+{
+	const int P = worker->domain->P;
+	const int from[4] = {worker->neighbour[DOWN], worker->neighbour[UP], worker->neighbour[RIGHT], worker->neighbour[LEFT]}; // Sender of the edge sent in each direction
+	if(worker->domain->transport == DOMAIN_SHARED_MEMORY) {
+		for(int d=0; d<4; d++) {
+			pack_edge(worker, d, &worker->edges[(size_t)(4*worker->index + d)*worker->edge_length]);
+		}
+		barrier_wait(worker->barrier, P);
+		for(int d=0; d<4; d++) {
+			unpack_halo(worker, d, &worker->edges[(size_t)(4*from[d] + d)*worker->edge_length]);
+		}
+		// No edge may be overwritten before every neighbour has read it
+		barrier_wait(worker->barrier, P);
+	} else {
+		// The sockets are non-blocking and the edges are sent while the halo is received,
+		// so an edge does not have to fit in a socket buffer
+		struct pollfd fds[8];
+		size_t length[8], done[8] = {0};
+		for(int d=0; d<4; d++) {
+			length[d] = pack_edge(worker, d, &worker->edge[(size_t)d*worker->edge_length]);
+			length[4 + d] = d == UP || d == DOWN ? worker->w : worker->h;
+			fds[d].fd = worker->halo[4*worker->index + d][0];
+			fds[d].events = POLLOUT;
+			fds[4 + d].fd = worker->halo[4*from[d] + d][1];
+			fds[4 + d].events = POLLIN;
+		}
+		int pending = 8;
+		while(pending > 0) {
+			if(poll(fds, 8, -1) < 0) {
+				if(errno == EINTR) {
+					continue;
+				}
+				fprintf(stderr, "Cannot wait for the halo exchange\n");
+				exit(1);
+			}
+			for(int k=0; k<8; k++) {
+				if(fds[k].fd < 0 || fds[k].revents == 0) {
+					continue;
+				}
+				uint8_t *buffer = &worker->edge[(size_t)k*worker->edge_length] + done[k];
+				ssize_t n = k < 4 ? write(fds[k].fd, buffer, length[k] - done[k]) : read(fds[k].fd, buffer, length[k] - done[k]);
+				if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+					continue;
+				}
+				if(n <= 0) {
+					fprintf(stderr, "Lost the connection to a domain process\n");
+					exit(1);
+				}
+				done[k] += n;
+				if(done[k] == length[k]) {
+					fds[k].fd = -1; // Ignored by poll from now on
+					pending--;
+				}
+			}
+		}
+		for(int d=0; d<4; d++) {
+			unpack_halo(worker, d, &worker->edge[(size_t)(4 + d)*worker->edge_length]);
+		}
+	}
+}
+
+
+
+/* Updates the sites of the current colour in the tile, with the random numbers ising_sweep uses for them */
+static void half_sweep(Worker *worker)
+{
+	const int h = worker->h, w = worker->w, stride = w + 2;
+	const int colour = worker->half_sweeps & 1;
+	const int offset = (worker->j0/2) % 4; // Position of the tile's first number in its block
+	const int blocks = (offset + w/2 + 3)/4;
+	uint32_t r[4*blocks];
+	uint32_t threshold[10]; // A local copy, which the writes to the spins cannot alias
+	memcpy(threshold, worker->threshold, sizeof(threshold));
+	int64_t bonds = 0, M = 0;
+	for(int li=1; li<=h; li++) {
+		const int i = worker->i0 + li - 1;
+		const int first = (i + colour) & 1; // Column of the first site of the colour, in the tile since j0 is even
+		philox_fill(worker->seed, i, (uint32_t)worker->half_sweeps, ising_stream(ISING_STREAM_CHECKERBOARD, worker->half_sweeps), (worker->j0/2)/4, r, blocks);
+		int8_t *row = &worker->tile[li*stride];
+		const int8_t *up = row - stride, *down = row + stride;
+		int32_t row_bonds = 0, row_M = 0;
+		for(int m=0; m<w/2; m++) {
+			int j = 1 + first + 2*m;
+			int s = row[j];
+			int n = up[j] + down[j] + row[j-1] + row[j+1];
+			int flip = (r[offset + m] >> 1) < threshold[5*(s > 0) + ((n + 4) >> 1)];
+			row[j] = (int8_t)(s - 2*s*flip);
+			row_bonds -= 2*s*n*flip;
+			row_M -= 2*s*flip;
+		}
+		bonds += row_bonds;
+		M += row_M;
+	}
+	worker->bonds += bonds;
+	worker->M += M;
+	worker->half_sweeps++;
+}
+
+
+
+/* Body of a worker process: sets up the tile and serves commands until told to quit */
+static void run_worker(Worker *worker)
+{
+	const Domain *domain = worker->domain;
+	const int h = worker->h, w = worker->w, stride = w + 2;
+	worker->tile = calloc((size_t)(h + 2)*stride, 1);
+	worker->edge = malloc((size_t)8*worker->edge_length);
+	ising_acceptance(domain->T, domain->J, domain->H, worker->threshold);
+
+	// The initial state of ising_create
+	const int blocks = (worker->j0 % 4 + w + 3)/4;
+	uint32_t r[4*blocks];
+	for(int li=1; li<=h; li++) {
+		philox_fill(worker->seed, worker->i0 + li - 1, 0, ising_stream(ISING_STREAM_INIT, 0), worker->j0/4, r, blocks);
+		for(int lj=1; lj<=w; lj++) {
+			worker->tile[li*stride + lj] = r[worker->j0 % 4 + lj - 1] >> 31 ? 1 : -1;
+		}
+	}
+	exchange(worker);
+	for(int li=1; li<=h; li++) {
+		for(int lj=1; lj<=w; lj++) {
+			// Each pair is counted once, from its upper or left site
+			int s = worker->tile[li*stride + lj];
+			worker->bonds += s*(worker->tile[(li+1)*stride + lj] + worker->tile[li*stride + lj + 1]);
+			worker->M += s;
+		}
+	}
+
+	while(1) {
+		Command command;
+		read_all(worker->command, &command, sizeof(Command));
+		if(command.type == COMMAND_QUIT) {
+			_exit(0);
+		} else if(command.type == COMMAND_SWEEP) {
+			for(int half=0; half<2*command.sweeps; half++) {
+				half_sweep(worker);
+				exchange(worker);
+			}
+		} else if(command.type == COMMAND_PARAMETERS) {
+			ising_acceptance(command.T, command.J, command.H, worker->threshold);
+		}
+		Reply reply = {worker->bonds, worker->M};
+		write_all(worker->command, &reply, sizeof(Reply));
+		if(command.type == COMMAND_GATHER) {
+			for(int li=1; li<=h; li++) {
+				write_all(worker->command, &worker->tile[li*stride + 1], w);
+			}
+		}
+	}
+}
+
+
+
+/* Sends a command to every worker and adds up their replies */
+static void broadcast(Domain *domain, const Command *command)
+{
+	for(int p=0; p<domain->P; p++) {
+		write_all(domain->commands[p], command, sizeof(Command));
+	}
+	domain->bonds = domain->M = 0;
+	for(int p=0; p<domain->P; p++) {
+		Reply reply;
+		read_all(domain->commands[p], &reply, sizeof(Reply));
+		domain->bonds += reply.bonds;
+		domain->M += reply.M;
+	}
+}
+
+
+
+/* Starts Px*Py workers on the lattice of ising_create(D, T, J, H, seed, ...). D must be a multiple of 2Px and 2Py. */
+Domain *domain_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int Px, const int Py, const DomainTransport transport)
+{
+	if(Px < 1 || Py < 1 || D % (2*Px) != 0 || D % (2*Py) != 0) {
+		fprintf(stderr, "The side length %d must split into an even number of rows and columns for each of %d x %d tiles.\n", D, Px, Py);
+		exit(1);
+	}
+	Domain *domain = calloc(1, sizeof(Domain));
+	domain->D = D;
+	domain->Px = Px;
+	domain->Py = Py;
+	domain->P = Px*Py;
+	domain->transport = transport;
+	domain->T = T;
+	domain->J = J;
+	domain->H = H;
+	domain->pids = malloc(domain->P*sizeof(pid_t));
+	domain->commands = malloc(domain->P*sizeof(int));
+
+	// The channels are made before forking, so that every worker inherits them
+	const int h = D/Py, w = D/Px;
+	const int edge_length = ((h > w ? h : w) + 63)/64*64;
+	int (*halo)[2] = NULL;
+	Barrier *barrier = NULL;
+	uint8_t *edges = NULL;
+	if(transport == DOMAIN_SHARED_MEMORY) {
+		domain->shared_size = 64 + (size_t)4*domain->P*edge_length;
+		domain->shared = mmap(NULL, domain->shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+		if(domain->shared == MAP_FAILED) {
+			fprintf(stderr, "Cannot map %zu bytes of shared memory\n", domain->shared_size);
+			exit(1);
+		}
+		barrier = domain->shared;
+		barrier->count = barrier->generation = 0;
+		edges = (uint8_t *)domain->shared + 64;
+	} else {
+		halo = malloc(4*domain->P*sizeof(int[2]));
+		for(int k=0; k<4*domain->P; k++) {
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, halo[k]) != 0 || fcntl(halo[k][0], F_SETFL, O_NONBLOCK) != 0 || fcntl(halo[k][1], F_SETFL, O_NONBLOCK) != 0) {
+				fprintf(stderr, "Cannot create the sockets for the halo exchange\n");
+				exit(1);
+			}
+		}
+	}
+
+	for(int p=0; p<domain->P; p++) {
+		int channel[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, channel) != 0) {
+			fprintf(stderr, "Cannot create the command sockets\n");
+			exit(1);
+		}
+		fflush(NULL);
+		pid_t pid = fork();
+		if(pid < 0) {
+			fprintf(stderr, "Cannot start worker %d\n", p);
+			exit(1);
+		}
+		if(pid == 0) {
+			close(channel[0]);
+			int tx = p % Px, ty = p / Px;
+			Worker worker = {0};
+			worker.domain = domain;
+			worker.index = p;
+			worker.h = h;
+			worker.w = w;
+			worker.i0 = ty*h;
+			worker.j0 = tx*w;
+			worker.neighbour[UP] = ((ty + Py - 1) % Py)*Px + tx;
+			worker.neighbour[DOWN] = ((ty + 1) % Py)*Px + tx;
+			worker.neighbour[LEFT] = ty*Px + (tx + Px - 1) % Px;
+			worker.neighbour[RIGHT] = ty*Px + (tx + 1) % Px;
+			worker.seed = seed;
+			worker.command = channel[1];
+			worker.halo = halo;
+			worker.barrier = barrier;
+			worker.edges = edges;
+			worker.edge_length = edge_length;
+			// Close the sockets of the other workers, so that a worker sees the end of a socket
+			// as soon as the processes that use it have gone
+			for(int q=0; q<p; q++) {
+				close(domain->commands[q]);
+			}
+			if(halo != NULL) {
+				const int from[4] = {worker.neighbour[DOWN], worker.neighbour[UP], worker.neighbour[RIGHT], worker.neighbour[LEFT]};
+				for(int k=0; k<4*domain->P; k++) {
+					if(k/4 != p) {
+						close(halo[k][0]);
+					}
+					if(k/4 != from[k % 4]) {
+						close(halo[k][1]);
+					}
+				}
+			}
+			run_worker(&worker);
+		}
+		close(channel[1]);
+		domain->pids[p] = pid;
+		domain->commands[p] = channel[0];
+	}
+
+	// Only the workers use the halo sockets
+	if(halo != NULL) {
+		for(int k=0; k<4*domain->P; k++) {
+			close(halo[k][0]);
+			close(halo[k][1]);
+		}
+		free(halo);
+	}
+
+	// The workers count their tiles once they are set up
+	Command command = {COMMAND_PARAMETERS, 0, T, J, H};
+	broadcast(domain, &command);
+	return domain;
+}
+
+
+
+/* Stops the workers and frees the domain */
+void domain_destroy(Domain *domain)
+{
+	Command command = {COMMAND_QUIT, 0, 0, 0, 0};
+	for(int p=0; p<domain->P; p++) {
+		write_all(domain->commands[p], &command, sizeof(Command));
+	}
+	for(int p=0; p<domain->P; p++) {
+		waitpid(domain->pids[p], NULL, 0);
+		close(domain->commands[p]);
+	}
+	if(domain->shared != NULL) {
+		munmap(domain->shared, domain->shared_size);
+	}
+	free(domain->pids);
+	free(domain->commands);
+	free(domain);
+}
+
+
+
+/* Sends the current parameters to the workers */
+static void send_parameters(Domain *domain)
+{
+	Command command = {COMMAND_PARAMETERS, 0, domain->T, domain->J, domain->H};
+	broadcast(domain, &command);
+}
+
+
+
+/* Sets the temperature to T */
+void domain_set_T(Domain *domain, const double T)
+{
+	domain->T = T;
+	send_parameters(domain);
+}
+
+
+
+/* Sets the strength of pairwise interaction to J */
+void domain_set_J(Domain *domain, const double J)
+{
+	domain->J = J;
+	send_parameters(domain);
+}
+
+
+
+/* Sets the strength of external magnetic field to H */
+void domain_set_H(Domain *domain, const double H)
+{
+	domain->H = H;
+	send_parameters(domain);
+}
+
+
+
+/* Total energy of the current configuration */
+double domain_energy(const Domain *domain)
+{
+	return -domain->J*domain->bonds - domain->H*domain->M;
+}
+
+
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void domain_sweep(Domain *domain, const int sweeps)
+{
+	Command command = {COMMAND_SWEEP, sweeps, 0, 0, 0};
+	broadcast(domain, &command);
+}
+
+
+
+/* Copies the whole lattice from the workers into a row major grid of ±1 spins */
+void domain_gather(Domain *domain, int8_t *grid)
+{
+	const int D = domain->D, h = D/domain->Py, w = D/domain->Px;
+	Command command = {COMMAND_GATHER, 0, 0, 0, 0};
+	for(int p=0; p<domain->P; p++) {
+		write_all(domain->commands[p], &command, sizeof(Command));
+	}
+	for(int p=0; p<domain->P; p++) {
+		Reply reply;
+		read_all(domain->commands[p], &reply, sizeof(Reply));
+		int i0 = (p / domain->Px)*h, j0 = (p % domain->Px)*w;
+		for(int i=0; i<h; i++) {
+			read_all(domain->commands[p], &grid[(size_t)(i0 + i)*D + j0], w);
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#ifndef _DOMAIN_H
+#define _DOMAIN_H
+
+#include <stdint.h> /* int8_t, int64_t, uint64_t */
+#include <sys/types.h> /* pid_t */
+
+/*
+ * Checkerboard Metropolis sweeps of one Ising lattice split over worker processes.
+ *
+ * The torus is cut into Px x Py tiles and each tile is owned by its own forked worker.
+ * A worker keeps its tile with a halo of one row and one column on every side, which
+ * hold copies of the neighbouring tiles' edges. A half sweep only reads sites of the
+ * other colour, so the workers update their tiles independently and then exchange
+ * their edges before the next half sweep. The edges go through one of two transports:
+ *
+ *  - DOMAIN_SHARED_MEMORY: every worker writes its four edges into a mapping shared by
+ *    all workers and, after a barrier, copies its neighbours' edges into its halo. A
+ *    second barrier keeps the edges from being overwritten before they have been read.
+ *  - DOMAIN_SOCKETS: every worker writes its edges to Unix socket pairs, one per worker
+ *    and direction, and reads its halo from those of its neighbours. The sockets are
+ *    non-blocking and a worker polls them to send and receive at the same time, so an
+ *    edge may be larger than the socket buffer.
+ *
+ * The coordinator, the calling process, sends commands to the workers over a socket
+ * pair each. The workers track the change in the bond sum and magnetisation of their
+ * tiles, counting the bonds across tile edges on the side of the flipped site. Each
+ * command is answered with these partial sums, which the coordinator adds up.
+ *
+ * The random numbers of a site are those that ising_sweep would use for it, and the
+ * initial state is that of ising_create. A decomposed run therefore gives the same
+ * lattice as a single process model with the same seed, for any number of tiles.
+ */
+
+typedef enum DomainTransport {DOMAIN_SHARED_MEMORY, DOMAIN_SOCKETS} DomainTransport;
+
+typedef struct Domain {
+	int D; /* Height and width of the square lattice */
+	int Px, Py; /* Number of tiles across and down */
+	int P; /* Number of workers, Px*Py */
+	DomainTransport transport; /* How the workers exchange their edges */
+	double T; /* Temperature */
+	double J; /* Strength of pairwise interaction */
+	double H; /* Strength of external magnetic field */
+	int64_t bonds; /* Σ<ij> sᵢsⱼ over nearest neighbour pairs, after the last command */
+	int64_t M; /* Magnetisation Σᵢ sᵢ, after the last command */
+	pid_t *pids; /* Process of each worker */
+	int *commands; /* Coordinator's end of the command socket of each worker */
+	void *shared; /* Mapping shared with the workers, for DOMAIN_SHARED_MEMORY */
+	size_t shared_size; /* Length of the shared mapping */
+} Domain;
+
+/* Starts Px*Py workers on the lattice of ising_create(D, T, J, H, seed, ...). D must be a multiple of 2Px and 2Py. */
+Domain *domain_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int Px, const int Py, const DomainTransport transport);
+
+/* Stops the workers and frees the domain */
+void domain_destroy(Domain *domain);
+
+/* Sets the temperature to T */
+void domain_set_T(Domain *domain, const double T);
+
+/* Sets the strength of pairwise interaction to J */
+void domain_set_J(Domain *domain, const double J);
+
+/* Sets the strength of external magnetic field to H */
+void domain_set_H(Domain *domain, const double H);
+
+/* Total energy of the current configuration */
+double domain_energy(const Domain *domain);
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void domain_sweep(Domain *domain, const int sweeps);
+
+/* Copies the whole lattice from the workers into a row major grid of ±1 spins */
+void domain_gather(Domain *domain, int8_t *grid);
+
+#endif
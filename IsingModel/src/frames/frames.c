@@ -0,0 +1,169 @@
+#include "frames.h"
+#include <fcntl.h> // open, O_RDWR, O_CREAT, O_TRUNC
+#include <stdlib.h> // calloc, free, exit
+#include <string.h> // memcpy, memset
+#include <sys/mman.h> // mmap, munmap
+#include <unistd.h> // ftruncate, close
+
+#define SLOT_ALIGNMENT 64 // Slots start on cache line boundaries
+
+
+
+/* Packed spins of a slot */
+static inline uint8_t *slot_bits(FrameSlot *slot)
+{
+	return (uint8_t *)(slot + 1);
+}
+
+
+
+/* Slot of the ring holding frame f */
+static inline FrameSlot *frame_slot(const FrameRing *ring, const uint64_t f)
+{
+	return (FrameSlot *)((uint8_t *)ring->header + sizeof(FrameHeader) + (f % ring->header->slots)*ring->header->slot_bytes);
+}
+
+
+
+/* Creates the file at path, sized for slots frames of a D x D lattice, and maps it */
+FrameRing *frames_create(const char *path, const int D, const int slots)
+{
+	const uint64_t frame_bytes = (uint64_t)D*((D + 7)/8);
+	const uint64_t slot_bytes = (sizeof(FrameSlot) + frame_bytes + SLOT_ALIGNMENT - 1)/SLOT_ALIGNMENT*SLOT_ALIGNMENT;
+	const size_t size = sizeof(FrameHeader) + slots*slot_bytes;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || ftruncate(fd, size) != 0) {
+		fprintf(stderr, "Cannot create the frame ring %s\n", path);
+		exit(1);
+	}
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map the frame ring %s\n", path);
+		exit(1);
+	}
+	FrameRing *ring = calloc(1, sizeof(FrameRing));
+	ring->header = map;
+	ring->size = size;
+	memset(ring->header, 0, sizeof(FrameHeader));
+	ring->header->version = FRAMES_VERSION;
+	ring->header->D = D;
+	ring->header->slots = slots;
+	ring->header->slot_bytes = slot_bytes;
+	// A viewer checks the magic number last, so it never sees a half written header
+	__atomic_store_n(&ring->header->magic, FRAMES_MAGIC, __ATOMIC_RELEASE);
+	return ring;
+}
+
+
+
+/* Unmaps the ring. The file is left in place. */
+void frames_close(FrameRing *ring)
+{
+	munmap(ring->header, ring->size);
+	free(ring);
+}
+
+
+
+/* Packs the spins of a model one bit per site, in the layout of a frame */
+void frames_pack(const Ising *model, uint8_t *bits)
+{
+	const int D = model->D, row_bytes = (D + 7)/8;
+	for(int i=0; i<D; i++) {
+		const int8_t *row = &model->grid[(size_t)i*D];
+		uint8_t *out = &bits[(size_t)i*row_bytes];
+		for(int b=0; b<D/8; b++) {
+			uint8_t byte = 0;
+			for(int k=0; k<8; k++) {
+				byte |= (uint8_t)(row[8*b + k] < 0) << (7 - k);
+			}
+			out[b] = byte;
+		}
+		if(D % 8 != 0) {
+			uint8_t byte = 0;
+			for(int k=0; k<D%8; k++) {
+				byte |= (uint8_t)(row[8*(D/8) + k] < 0) << (7 - k);
+			}
+			out[D/8] = byte;
+		}
+	}
+}
+
+
+
+/* Writes a snapshot of the model after sweep sweeps into the next slot */
+void frames_publish(FrameRing *ring, const Ising *model, const uint64_t sweep)
+{
+	FrameHeader *header = ring->header;
+	const uint64_t f = header->latest; // Only this process writes latest
+	FrameSlot *slot = frame_slot(ring, f);
+	__atomic_store_n(&slot->sequence, 2*f + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->sweep = sweep;
+	slot->T = model->T;
+	slot->J = model->J;
+	slot->H = model->H;
+	slot->E = ising_energy(model);
+	slot->M = (double)model->M;
+	frames_pack(model, slot_bits(slot));
+	__atomic_store_n(&slot->sequence, 2*f + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->latest, f + 1, __ATOMIC_RELEASE);
+}
+
+
+
+/* Copies the newest frame into slot and bits. Returns 0 if no frame has been written yet. */
+int frames_latest(const FrameRing *ring, FrameSlot *slot, uint8_t *bits)
+{
+	const uint64_t frame_bytes = (uint64_t)ring->header->D*((ring->header->D + 7)/8);
+	while(1) {
+		uint64_t latest = __atomic_load_n(&ring->header->latest, __ATOMIC_ACQUIRE);
+		if(latest == 0) {
+			return 0;
+		}
+		FrameSlot *shared = frame_slot(ring, latest - 1);
+		uint64_t before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+		if(before != 2*latest) { // Already being overwritten
+			continue;
+		}
+		memcpy(slot, shared, sizeof(FrameSlot));
+		memcpy(bits, slot_bits(shared), frame_bytes);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before) {
+			slot->sequence = before;
+			return 1;
+		}
+	}
+}
+
+
+
+/* Sets T, J and H to the parameters a viewer has asked for and returns 1, or returns 0 if there are no new ones */
+int frames_parameters(FrameRing *ring, double *T, double *J, double *H)
+{
+	FrameHeader *header = ring->header;
+	uint64_t before = __atomic_load_n(&header->parameter_sequence, __ATOMIC_ACQUIRE);
+	if(before % 2 != 0 || before == ring->applied_parameters) {
+		return 0;
+	}
+	double new_T = header->T, new_J = header->J, new_H = header->H;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if(__atomic_load_n(&header->parameter_sequence, __ATOMIC_RELAXED) != before) { // Torn. Try again on the next frame.
+		return 0;
+	}
+	ring->applied_parameters = before;
+	*T = new_T;
+	*J = new_J;
+	*H = new_H;
+	return 1;
+}
+
+
+
+/* Writes packed spins as a binary PBM image, which can be appended to a stream of them */
+void frames_write_pbm(FILE *fp, const uint8_t *bits, const int D)
+{
+	fprintf(fp, "P4\n%d %d\n", D, D);
+	fwrite(bits, 1, (size_t)D*((D + 7)/8), fp);
+}
@@ -0,0 +1,82 @@
+#ifndef _FRAMES_H
+#define _FRAMES_H
+
+#include <stdint.h> /* uint8_t, uint32_t, uint64_t */
+#include <stdio.h> /* FILE */
+#include "../ising/ising.h" /* Ising */
+
+/*
+ * Ring of lattice snapshots in a shared file mapping, written by a simulation and read
+ * by any number of viewers, such as Animation.py, without locks.
+ *
+ * The file starts with a FrameHeader, followed by slots frames of FrameSlot plus the
+ * spins packed one bit per site, D rows of (D+7)/8 bytes each with the first column in
+ * the most significant bit. Up spins are 0 and down spins 1, so that a frame is also
+ * the raster of a binary PBM image.
+ *
+ * Every slot is a seqlock: the writer makes its sequence odd, writes the frame and
+ * then sets it to 2(f+1) for frame f, before announcing the frame in latest. A reader
+ * copies the newest frame and accepts the copy if the sequence was 2(f+1) both before
+ * and after. The writer never waits for a reader, and a reader only retries when the
+ * writer has lapped the whole ring during the copy.
+ *
+ * The parameter channel runs the other way. A viewer makes parameter_sequence odd,
+ * writes T, J and H, and makes it even again. The simulation picks up the new values
+ * when it sees an even sequence that differs from the last one it applied.
+ */
+
+#define FRAMES_MAGIC 0x52465349U /* "ISFR" in little endian byte order */
+#define FRAMES_VERSION 1
+
+/* Start of the file. The fields that change are only accessed atomically. */
+typedef struct FrameHeader {
+	uint32_t magic; /* FRAMES_MAGIC */
+	uint32_t version; /* FRAMES_VERSION */
+	uint32_t D; /* Height and width of the lattice */
+	uint32_t slots; /* Number of frames in the ring */
+	uint64_t slot_bytes; /* Distance between consecutive slots */
+	uint64_t latest; /* Number of frames written. Frame latest-1 is the newest. */
+	uint64_t stop; /* Set to nonzero by a viewer to stop the simulation */
+	uint64_t parameter_sequence; /* Odd while a viewer writes T, J and H */
+	double T, J, H; /* Parameters requested by a viewer */
+	uint8_t padding[56];
+} FrameHeader;
+
+/* Start of every slot, followed by the packed spins */
+typedef struct FrameSlot {
+	uint64_t sequence; /* Odd while the slot is written, 2(f+1) once it holds frame f */
+	uint64_t sweep; /* Sweeps performed before the frame was taken */
+	double T, J, H; /* Parameters of the model */
+	double E, M; /* Energy and magnetisation */
+	uint8_t padding[8];
+} FrameSlot;
+
+/* A ring mapped into the current process */
+typedef struct FrameRing {
+	FrameHeader *header; /* The mapped file */
+	size_t size; /* Length of the mapping */
+	uint64_t applied_parameters; /* Last parameter sequence applied by the writer */
+} FrameRing;
+
+/* Creates the file at path, sized for slots frames of a D x D lattice, and maps it */
+FrameRing *frames_create(const char *path, const int D, const int slots);
+
+/* Unmaps the ring. The file is left in place. */
+void frames_close(FrameRing *ring);
+
+/* Packs the spins of a model one bit per site, in the layout of a frame */
+void frames_pack(const Ising *model, uint8_t *bits);
+
+/* Writes a snapshot of the model after sweep sweeps into the next slot */
+void frames_publish(FrameRing *ring, const Ising *model, const uint64_t sweep);
+
+/* Copies the newest frame into slot and bits. Returns 0 if no frame has been written yet. */
+int frames_latest(const FrameRing *ring, FrameSlot *slot, uint8_t *bits);
+
+/* Sets T, J and H to the parameters a viewer has asked for and returns 1, or returns 0 if there are no new ones */
+int frames_parameters(FrameRing *ring, double *T, double *J, double *H);
+
+/* Writes packed spins as a binary PBM image, which can be appended to a stream of them */
+void frames_write_pbm(FILE *fp, const uint8_t *bits, const int D);
+
+#endif
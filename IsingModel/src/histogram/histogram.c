@@ -0,0 +1,168 @@
+#include "histogram.h"
+#include <stdio.h> // fopen, fscanf, fprintf, fclose
+#include <stdlib.h> // calloc, free, exit
+
+#define INITIAL_CAPACITY 1024 // Entries of a new table
+#define MAX_LOAD 0.5 // Largest fraction of occupied entries before the table grows
+
+
+
+/* Table position of a pair, from a multiplicative hash */
+static inline size_t slot_of(const uint64_t key, const size_t capacity)
+{
+	return (size_t)((key*0x9E3779B97F4A7C15ULL) >> 17) & (capacity - 1);
+}
+
+
+
+/* Pair packed into a key */
+static inline uint64_t pack_key(const int64_t bonds, const int64_t M)
+{
+	return (uint64_t)(uint32_t)(int32_t)bonds << 32 | (uint32_t)(int32_t)M;
+}
+
+
+
+/* Adds count samples of a key, without growing the table */
+static void insert(Histogram *histogram, const uint64_t key, const long count)
+{
+	size_t k = slot_of(key, histogram->capacity);
+	while(histogram->counts[k] > 0 && histogram->keys[k] != key) {
+		k = (k + 1) & (histogram->capacity - 1);
+	}
+	if(histogram->counts[k] == 0) {
+		histogram->keys[k] = key;
+		histogram->size++;
+	}
+	histogram->counts[k] += count;
+}
+
+
+
+/* Doubles the table */
+static void grow(Histogram *histogram)
+{
+	size_t old_capacity = histogram->capacity;
+	uint64_t *old_keys = histogram->keys;
+	long *old_counts = histogram->counts;
+	histogram->capacity *= 2;
+	histogram->size = 0;
+	histogram->keys = calloc(histogram->capacity, sizeof(uint64_t));
+	histogram->counts = calloc(histogram->capacity, sizeof(long));
+	for(size_t k=0; k<old_capacity; k++) {
+		if(old_counts[k] > 0) {
+			insert(histogram, old_keys[k], old_counts[k]);
+		}
+	}
+	free(old_keys);
+	free(old_counts);
+}
+
+
+
+/* Creates an empty histogram for a run on a D x D lattice at T, J and H */
+Histogram *histogram_create(const int D, const double T, const double J, const double H)
+{
+	Histogram *histogram = calloc(1, sizeof(Histogram));
+	histogram->D = D;
+	histogram->T = T;
+	histogram->J = J;
+	histogram->H = H;
+	histogram->capacity = INITIAL_CAPACITY;
+	histogram->keys = calloc(histogram->capacity, sizeof(uint64_t));
+	histogram->counts = calloc(histogram->capacity, sizeof(long));
+	return histogram;
+}
+
+
+
+/* Frees the histogram */
+void histogram_destroy(Histogram *histogram)
+{
+	free(histogram->keys);
+	free(histogram->counts);
+	free(histogram);
+}
+
+
+
+/* Adds a sample with the given bond sum and magnetisation */
+void histogram_add(Histogram *histogram, const int64_t bonds, const int64_t M)
+{
+	if(histogram->size + 1 > MAX_LOAD*histogram->capacity) {
+		grow(histogram);
+	}
+	insert(histogram, pack_key(bonds, M), 1);
+	histogram->samples++;
+}
+
+
+
+/* Reads the pair held by entry k of the table. Returns 0 for an empty entry. */
+int histogram_entry(const Histogram *histogram, const size_t k, int64_t *bonds, int64_t *M, long *count)
+{
+	if(histogram->counts[k] == 0) {
+		return 0;
+	}
+	*bonds = (int32_t)(uint32_t)(histogram->keys[k] >> 32);
+	*M = (int32_t)(uint32_t)histogram->keys[k];
+	*count = histogram->counts[k];
+	return 1;
+}
+
+
+
+/* Writes the histogram to a file */
+void histogram_write(const Histogram *histogram, const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	if(fp == NULL) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		exit(1);
+	}
+	fprintf(fp, "# D %d T %.17g J %.17g H %.17g samples %ld\n", histogram->D, histogram->T, histogram->J, histogram->H, histogram->samples);
+	fprintf(fp, "# bonds\tM\tcount\n");
+	int64_t bonds, M;
+	long count;
+	for(size_t k=0; k<histogram->capacity; k++) {
+		if(histogram_entry(histogram, k, &bonds, &M, &count)) {
+			fprintf(fp, "%lld\t%lld\t%ld\n", (long long)bonds, (long long)M, count);
+		}
+	}
+	fclose(fp);
+}
+
+
+
+/* Reads a histogram written by histogram_write */
+Histogram *histogram_read(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if(fp == NULL) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		exit(1);
+	}
+	int D;
+	double T, J, H;
+	long samples;
+	if(fscanf(fp, "# D %d T %lf J %lf H %lf samples %ld # bonds M count", &D, &T, &J, &H, &samples) != 5) {
+		fprintf(stderr, "%s is not a histogram\n", path);
+		exit(1);
+	}
+	Histogram *histogram = histogram_create(D, T, J, H);
+	long long bonds, M;
+	long count;
+	while(fscanf(fp, "%lld %lld %ld", &bonds, &M, &count) == 3) {
+		if(histogram->size + 1 > MAX_LOAD*histogram->capacity) {
+			grow(histogram);
+		}
+		insert(histogram, pack_key(bonds, M), count);
+		histogram->samples += count;
+	}
+	fclose(fp);
+	if(histogram->samples != samples) {
+		fprintf(stderr, "%s holds %ld samples instead of %ld\n", path, histogram->samples, samples);
+		exit(1);
+	}
+	return histogram;
+}
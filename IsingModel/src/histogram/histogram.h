@@ -0,0 +1,47 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* int64_t, uint64_t */
+
+/*
+ * Joint histogram of the bond sum and magnetisation visited by a run.
+ *
+ * The pair (bonds, M) determines E = -J bonds - H M as well as |M| and M², so the
+ * histogram of a run at T, J and H can be reweighted to other temperatures without
+ * binning errors. Only the pairs that occur are stored, in an open addressing hash
+ * table, which stays small since a run visits a narrow band of both.
+ *
+ * A histogram is written as a text file: a header line with the parameters of the
+ * run, then one line per pair with its count.
+ */
+
+typedef struct Histogram {
+	int D; /* Side length of the lattice */
+	double T, J, H; /* Parameters of the run */
+	long samples; /* Number of samples added */
+	size_t size; /* Number of distinct pairs */
+	size_t capacity; /* Length of the table, a power of two */
+	uint64_t *keys; /* Pair of each entry, bonds in the high word and M in the low word */
+	long *counts; /* Number of samples of each entry, zero for an empty one */
+} Histogram;
+
+/* Creates an empty histogram for a run on a D x D lattice at T, J and H */
+Histogram *histogram_create(const int D, const double T, const double J, const double H);
+
+/* Frees the histogram */
+void histogram_destroy(Histogram *histogram);
+
+/* Adds a sample with the given bond sum and magnetisation */
+void histogram_add(Histogram *histogram, const int64_t bonds, const int64_t M);
+
+/* Reads the pair held by entry k of the table. Returns 0 for an empty entry. */
+int histogram_entry(const Histogram *histogram, const size_t k, int64_t *bonds, int64_t *M, long *count);
+
+/* Writes the histogram to a file */
+void histogram_write(const Histogram *histogram, const char *path);
+
+/* Reads a histogram written by histogram_write */
+Histogram *histogram_read(const char *path);
+
+#endif
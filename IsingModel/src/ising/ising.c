@@ -0,0 +1,250 @@
+#include "ising.h"
+#include <math.h> // exp
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc, calloc, free, exit
+#include <string.h> // memcpy, memset
+#include "../random/philox.h" // philox_fill
+
+#define TASKS_PER_THREAD 4 // Blocks of rows per thread in a half sweep, to even out the load
+
+
+
+/* Tabulates the acceptance thresholds of the ten (s, n) pairs at T, J and H */
+void ising_acceptance(const double T, const double J, const double H, uint32_t threshold[10])
+{
+	for(int index=0; index<10; index++) {
+		int s = index >= 5 ? 1 : -1;
+		int n = 2*(index % 5) - 4;
+		double dE = 2.0*s*(J*n + H);
+		// If dE <= 0 then flip it. Otherwise flip it with probability exp(-dE/T).
+		double p = dE <= 0 ? 1.0 : (T > 0 ? exp(-dE/T) : 0.0);
+		threshold[index] = p >= 1 ? ISING_ALWAYS : (uint32_t)(p*2147483648.0);
+	}
+}
+
+
+
+/* Tabulates the acceptance thresholds for the current T, J and H */
+static void update_thresholds(Ising *model)
+{
+	ising_acceptance(model->T, model->J, model->H, model->threshold);
+}
+
+
+
+/* Creates a model in a random initial state, like IsingModel(D, T, J, H) */
+Ising *ising_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads)
+{
+	if(D < 2 || D % 2 != 0) {
+		fprintf(stderr, "The side length of the lattice must be even, not %d.\n", D);
+		exit(1);
+	}
+	Ising *model = calloc(1, sizeof(Ising));
+	model->D = D;
+	model->T = T;
+	model->J = J;
+	model->H = H;
+	model->seed = seed;
+	model->grid = malloc((size_t)D*D);
+	model->single_index = 3*ISING_SINGLE_BATCH;
+	update_thresholds(model);
+
+	// Start from random initial state
+	uint32_t *r = malloc(((D + 3)/4)*4*sizeof(uint32_t));
+	for(int i=0; i<D; i++) {
+		philox_fill(seed, i, 0, ising_stream(ISING_STREAM_INIT, 0), 0, r, (D + 3)/4);
+		for(int j=0; j<D; j++) {
+			model->grid[(size_t)i*D + j] = r[j] >> 31 ? 1 : -1;
+		}
+	}
+	free(r);
+	ising_recount(model);
+
+	model->pool = threadpool_create(num_threads);
+	model->num_tasks = TASKS_PER_THREAD*model->pool->num_threads < D ? TASKS_PER_THREAD*model->pool->num_threads : D;
+	model->task_bonds = calloc(model->num_tasks, sizeof(int64_t));
+	model->task_M = calloc(model->num_tasks, sizeof(int64_t));
+	return model;
+}
+
+
+
+/* Frees the model */
+void ising_destroy(Ising *model)
+{
+	threadpool_destroy(model->pool);
+	free(model->task_bonds);
+	free(model->task_M);
+	free(model->grid);
+	free(model);
+}
+
+
+
+/* Sets the temperature to T */
+void ising_set_T(Ising *model, const double T)
+{
+	model->T = T;
+	update_thresholds(model);
+}
+
+
+
+/* Sets the strength of pairwise interaction to J */
+void ising_set_J(Ising *model, const double J)
+{
+	model->J = J;
+	update_thresholds(model);
+}
+
+
+
+/* Sets the strength of external magnetic field to H */
+void ising_set_H(Ising *model, const double H)
+{
+	model->H = H;
+	update_thresholds(model);
+}
+
+
+
+/* Total energy of the current configuration */
+double ising_energy(const Ising *model)
+{
+	return -model->J*model->bonds - model->H*model->M;
+}
+
+
+
+/* Recomputes the bond sum and magnetisation, after the grid has been changed directly */
+void ising_recount(Ising *model)
+{
+	const int D = model->D;
+	int64_t bonds = 0, M = 0;
+	for(int i=0; i<D; i++) {
+		const int8_t *row = &model->grid[(size_t)i*D];
+		const int8_t *down = &model->grid[(size_t)((i+1) % D)*D];
+		for(int j=0; j<D; j++) {
+			// Each pair is counted once, from its upper or left site
+			bonds += row[j]*(down[j] + row[(j+1) % D]);
+			M += row[j];
+		}
+	}
+	model->bonds = bonds;
+	model->M = M;
+}
+
+
+
+/* Sets every spin to spin, which must be ±1 */
+void ising_align(Ising *model, const int spin)
+{
+	memset(model->grid, (int8_t)spin, (size_t)model->D*model->D);
+	ising_recount(model);
+}
+
+
+
+/* Metropolis update of one site given a 32-bit uniform integer. Adds the changes to bonds and M. */
+static inline void update_site(const Ising *model, const int i, const int j, const uint32_t r, int64_t *bonds, int64_t *M)
+{
+	const int D = model->D;
+	int8_t *grid = model->grid;
+	int s = grid[(size_t)i*D + j];
+	int n = grid[(size_t)((i+D-1) % D)*D + j] + grid[(size_t)((i+1) % D)*D + j] + grid[(size_t)i*D + (j+D-1) % D] + grid[(size_t)i*D + (j+1) % D];
+	int flip = (r >> 1) < model->threshold[5*(s > 0) + (n + 4)/2];
+	grid[(size_t)i*D + j] = (int8_t)(flip ? -s : s);
+	*bonds -= 2*s*n*flip;
+	*M -= 2*s*flip;
+}
+
+
+
+/* Updates the sites of one colour in row i, using r[k] for the kth of them */
+static void sweep_row(const Ising *model, const int i, const int colour, const uint32_t *r, int64_t *bonds, int64_t *M)
+{
+	const int D = model->D;
+	int8_t *row = &model->grid[(size_t)i*D];
+	const int8_t *up = &model->grid[(size_t)((i+D-1) % D)*D];
+	const int8_t *down = &model->grid[(size_t)((i+1) % D)*D];
+	uint32_t threshold[10]; // A local copy, which the writes to the spins cannot alias
+	memcpy(threshold, model->threshold, sizeof(threshold));
+	const int first = (i + colour) & 1; // Column of the first site of the colour
+
+	// The sites that wrap around are done separately, leaving a branch free loop
+	int start = 0, end = D/2;
+	if(first == 0) {
+		update_site(model, i, 0, r[0], bonds, M);
+		start = 1;
+	} else {
+		update_site(model, i, D-1, r[D/2-1], bonds, M);
+		end = D/2 - 1;
+	}
+	int32_t row_bonds = 0, row_M = 0;
+	for(int k=start; k<end; k++) {
+		int j = first + 2*k;
+		int s = row[j];
+		int n = up[j] + down[j] + row[j-1] + row[j+1];
+		int flip = (r[k] >> 1) < threshold[5*(s > 0) + ((n + 4) >> 1)];
+		row[j] = (int8_t)(s - 2*s*flip);
+		row_bonds -= 2*s*n*flip;
+		row_M -= 2*s*flip;
+	}
+	*bonds += row_bonds;
+	*M += row_M;
+}
+
+
+
+/* Updates the sites of the current colour in one block of rows */
+static void sweep_rows(void *arg, const int task)
+{
+	Ising *model = arg;
+	const int D = model->D;
+	const int colour = model->half_sweeps & 1;
+	const int blocks = (D/2 + 3)/4;
+	uint32_t r[4*blocks];
+	int64_t bonds = 0, M = 0;
+	for(int i=task*D/model->num_tasks; i<(task+1)*D/model->num_tasks; i++) {
+		philox_fill(model->seed, i, (uint32_t)model->half_sweeps, ising_stream(ISING_STREAM_CHECKERBOARD, model->half_sweeps), 0, r, blocks);
+		sweep_row(model, i, colour, r, &bonds, &M);
+	}
+	model->task_bonds[task] = bonds;
+	model->task_M[task] = M;
+}
+
+
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void ising_sweep(Ising *model, const int sweeps)
+{
+	for(int h=0; h<2*sweeps; h++) {
+		parallel_for(model->pool, model->num_tasks, sweep_rows, model);
+		for(int t=0; t<model->num_tasks; t++) {
+			model->bonds += model->task_bonds[t];
+			model->M += model->task_M[t];
+		}
+		model->half_sweeps++;
+	}
+}
+
+
+
+/* Performs steps single spin Metropolis steps at random sites, like IsingModel.update(steps) */
+void ising_update(Ising *model, const long steps)
+{
+	const int D = model->D;
+	for(long step=0; step<steps; step++) {
+		if(model->single_index == 3*ISING_SINGLE_BATCH) {
+			philox_fill(model->seed, 0, (uint32_t)model->single_batches, ising_stream(ISING_STREAM_SINGLE, model->single_batches), 0, model->single_random, 3*ISING_SINGLE_BATCH/4);
+			model->single_batches++;
+			model->single_index = 0;
+		}
+		const uint32_t *r = &model->single_random[model->single_index];
+		model->single_index += 3;
+		// Select a random spin
+		int i = (int)(((uint64_t)r[0]*D) >> 32);
+		int j = (int)(((uint64_t)r[1]*D) >> 32);
+		update_site(model, i, j, r[2], &model->bonds, &model->M);
+	}
+}
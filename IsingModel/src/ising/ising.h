@@ -0,0 +1,102 @@
+#ifndef _ISING_H
+#define _ISING_H
+
+#include <stdint.h> /* int8_t, int64_t, uint32_t, uint64_t */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Square lattice Ising model with periodic boundary conditions, the native
+ * counterpart of IsingModel.py.
+ *
+ * The energy is E = -J Σ<ij> sᵢsⱼ - H Σᵢ sᵢ with every nearest neighbour pair counted
+ * once, so flipping spin s with neighbour sum n changes it by 2s(Jn + H), as in
+ * IsingModel.metropolis_step. (IsingModel.energy counts every pair twice.) The model
+ * tracks the bond sum Σ<ij> sᵢsⱼ and the magnetisation Σᵢ sᵢ as integers, so the
+ * energy is exact after any number of updates and stays correct when J or H changes.
+ *
+ * ising_sweep updates the lattice in red/black checkerboard order: the sites of one
+ * colour only have neighbours of the other colour, so each half sweep updates its
+ * rows in parallel. The acceptance probabilities of the ten possible (s, n) pairs are
+ * tabulated whenever T, J or H changes, and the random numbers of each row come in
+ * bulk from a counter-based generator keyed on the seed, the row and the half sweep,
+ * which makes runs independent of the number of threads.
+ */
+
+#define ISING_STREAM_INIT 0 /* Random number streams, used as the top byte of the last counter word */
+#define ISING_STREAM_CHECKERBOARD 1
+#define ISING_STREAM_SINGLE 2
+#define ISING_STREAM_WOLFF 3
+#define ISING_STREAM_SW_BONDS 4
+#define ISING_STREAM_SW_FLIPS 5
+#define ISING_STREAM_MULTISPIN 6
+#define ISING_STREAM_MULTISPIN_EXTRA 7
+#define ISING_STREAM_REPLICAS 8
+#define ISING_STREAM_REPLICAS_EXTRA 9
+#define ISING_STREAM_REPLICAS_INIT 10
+#define ISING_STREAM_TEMPERING 11
+#define ISING_STREAM_NFOLD 12
+#define ISING_SINGLE_BATCH 256 /* Single spin steps drawn per block of random numbers */
+#define ISING_ALWAYS 0x80000000U /* Threshold of a flip that is always accepted */
+
+typedef struct Ising {
+	int D; /* Height and width of the square lattice. Must be even. */
+	double T; /* Temperature */
+	double J; /* Strength of pairwise interaction */
+	double H; /* Strength of external magnetic field */
+	int8_t *grid; /* Spins of ±1, row major */
+	int64_t bonds; /* Σ<ij> sᵢsⱼ over nearest neighbour pairs */
+	int64_t M; /* Magnetisation Σᵢ sᵢ */
+	uint64_t seed; /* Key of the random number generator */
+	uint64_t half_sweeps; /* Number of checkerboard half sweeps so far */
+	uint32_t threshold[10]; /* A flip of spin s with neighbour sum n is accepted when a 31-bit uniform integer is below threshold[5(s>0) + (n+4)/2] */
+	uint64_t single_batches; /* Number of blocks of random numbers drawn for single spin steps */
+	int single_index; /* Next unused entry of single_random */
+	uint32_t single_random[3*ISING_SINGLE_BATCH]; /* Row, column and acceptance numbers of pending single spin steps */
+	ThreadPool *pool; /* Threads for the sweeps. Owned. */
+	int num_tasks; /* Number of blocks of rows a half sweep is split into */
+	int64_t *task_bonds, *task_M; /* Change in bonds and M from each block of the current half sweep */
+} Ising;
+
+/* Critical temperature of the square lattice at H = 0 per unit |J|: 2/log(1 + √2) (Onsager) */
+#define ISING_TC_PER_J 2.269185314213022
+
+/* Counter word naming a random number stream and the high bits of a position in it */
+static inline uint32_t ising_stream(const int stream, const uint64_t position)
+{
+	return (uint32_t)stream << 24 | (uint32_t)(position >> 32 & 0xFFFFFF);
+}
+
+/* Tabulates the acceptance thresholds of the ten (s, n) pairs at T, J and H */
+void ising_acceptance(const double T, const double J, const double H, uint32_t threshold[10]);
+
+/* Creates a model in a random initial state, like IsingModel(D, T, J, H) */
+Ising *ising_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads);
+
+/* Frees the model */
+void ising_destroy(Ising *model);
+
+/* Sets the temperature to T */
+void ising_set_T(Ising *model, const double T);
+
+/* Sets the strength of pairwise interaction to J */
+void ising_set_J(Ising *model, const double J);
+
+/* Sets the strength of external magnetic field to H */
+void ising_set_H(Ising *model, const double H);
+
+/* Total energy of the current configuration */
+double ising_energy(const Ising *model);
+
+/* Recomputes the bond sum and magnetisation, after the grid has been changed directly */
+void ising_recount(Ising *model);
+
+/* Sets every spin to spin, which must be ±1 */
+void ising_align(Ising *model, const int spin);
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void ising_sweep(Ising *model, const int sweeps);
+
+/* Performs steps single spin Metropolis steps at random sites, like IsingModel.update(steps) */
+void ising_update(Ising *model, const long steps);
+
+#endif
@@ -0,0 +1,243 @@
+#include "multispin.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc, calloc, free, exit
+#include "../ising/ising.h" // ising_acceptance, ising_stream, ISING_STREAM_INIT, ISING_STREAM_MULTISPIN, ISING_ALWAYS
+#include "../random/philox.h" // philox_fill, philox_block
+
+#define TASKS_PER_THREAD 4 // Blocks of rows per thread in a half sweep, to even out the load
+#define EXTRA_BLOCKS 12 // Blocks of the stream of further planes per word, two planes each
+#define EVEN_BITS 0x5555555555555555ULL // Sites in even columns
+
+
+
+/* Tabulates the masks of the acceptance thresholds at T, J and H */
+void bit_tables(const double T, const double J, const double H, BitTables *tables)
+{
+	ising_acceptance(T, J, H, tables->threshold);
+	for(int c=0; c<10; c++) {
+		tables->always[c] = tables->threshold[c] == ISING_ALWAYS ? ~0ULL : 0;
+		tables->random[c] = tables->threshold[c] > 0 && tables->threshold[c] < ISING_ALWAYS ? ~0ULL : 0;
+		for(int p=0; p<31; p++) {
+			tables->plane[p][c] = tables->threshold[c] >> (30 - p) & 1 ? ~0ULL : 0;
+		}
+	}
+}
+
+
+
+/* Creates a model in a random initial state */
+Multispin *multispin_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads)
+{
+	if(D < 64 || D % 64 != 0) {
+		fprintf(stderr, "The side length of a multi-spin coded lattice must be a multiple of 64, not %d.\n", D);
+		exit(1);
+	}
+	Multispin *model = calloc(1, sizeof(Multispin));
+	model->D = D;
+	model->W = D/64;
+	model->T = T;
+	model->J = J;
+	model->H = H;
+	model->seed = seed;
+	model->grid = malloc((size_t)D*model->W*sizeof(uint64_t));
+	bit_tables(model->T, model->J, model->H, &model->tables);
+
+	// Start from random initial state. Each Philox block fills two words of a row.
+	const int blocks = (model->W + 1)/2;
+	uint32_t r[4*blocks];
+	for(int i=0; i<D; i++) {
+		philox_fill(seed, i, 0, ising_stream(ISING_STREAM_INIT, 0), 0, r, blocks);
+		for(int w=0; w<model->W; w++) {
+			model->grid[(size_t)i*model->W + w] = (uint64_t)r[2*w+1] << 32 | r[2*w];
+		}
+	}
+	multispin_recount(model);
+
+	model->pool = threadpool_create(num_threads);
+	model->num_tasks = TASKS_PER_THREAD*model->pool->num_threads < D ? TASKS_PER_THREAD*model->pool->num_threads : D;
+	model->task_bonds = calloc(model->num_tasks, sizeof(int64_t));
+	model->task_M = calloc(model->num_tasks, sizeof(int64_t));
+	return model;
+}
+
+
+
+/* Frees the model */
+void multispin_destroy(Multispin *model)
+{
+	threadpool_destroy(model->pool);
+	free(model->task_bonds);
+	free(model->task_M);
+	free(model->grid);
+	free(model);
+}
+
+
+
+/* Sets the temperature to T */
+void multispin_set_T(Multispin *model, const double T)
+{
+	model->T = T;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Sets the strength of pairwise interaction to J */
+void multispin_set_J(Multispin *model, const double J)
+{
+	model->J = J;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Sets the strength of external magnetic field to H */
+void multispin_set_H(Multispin *model, const double H)
+{
+	model->H = H;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Total energy of the current configuration */
+double multispin_energy(const Multispin *model)
+{
+	return -model->J*model->bonds - model->H*model->M;
+}
+
+
+
+/* Recomputes the bond sum and magnetisation, after the grid has been changed directly */
+void multispin_recount(Multispin *model)
+{
+	const int D = model->D, W = model->W;
+	int64_t bonds = 0, M = 0;
+	for(int i=0; i<D; i++) {
+		const uint64_t *row = &model->grid[(size_t)i*W];
+		const uint64_t *down = &model->grid[(size_t)((i+1) % D)*W];
+		for(int w=0; w<W; w++) {
+			// Each pair is counted once, from its upper or left site
+			uint64_t right = row[w] >> 1 | row[(w+1) % W] << 63;
+			bonds += 128 - 2*__builtin_popcountll(row[w] ^ right) - 2*__builtin_popcountll(row[w] ^ down[w]);
+			M += 2*__builtin_popcountll(row[w]) - 64;
+		}
+	}
+	model->bonds = bonds;
+	model->M = M;
+}
+
+
+
+/* Packs a row major grid of ±1 spins into the model and recounts */
+void multispin_pack(Multispin *model, const int8_t *spins)
+{
+	const size_t words = (size_t)model->D*model->W;
+	for(size_t w=0; w<words; w++) {
+		uint64_t x = 0;
+		for(int b=0; b<64; b++) {
+			x |= (uint64_t)(spins[64*w + b] > 0) << b;
+		}
+		model->grid[w] = x;
+	}
+	multispin_recount(model);
+}
+
+
+
+/* Unpacks the model into a row major grid of ±1 spins */
+void multispin_unpack(const Multispin *model, int8_t *spins)
+{
+	const size_t words = (size_t)model->D*model->W;
+	for(size_t w=0; w<words; w++) {
+		for(int b=0; b<64; b++) {
+			spins[64*w + b] = (int8_t)(2*(int)(model->grid[w] >> b & 1) - 1);
+		}
+	}
+}
+
+
+
+/* Updates the sites of the current colour in one block of rows */
+static void sweep_rows(void *arg, const int task)
+{
+	Multispin *model = arg;
+	const int D = model->D, W = model->W;
+	const int colour = model->half_sweeps & 1;
+	const uint32_t b = (uint32_t)model->half_sweeps;
+	uint32_t r[2*W*MULTISPIN_PLANES];
+	uint64_t k0[W], k1[W], k2[W], accept[W], undecided[W];
+	int64_t bonds = 0, M = 0;
+	for(int i=task*D/model->num_tasks; i<(task+1)*D/model->num_tasks; i++) {
+		uint64_t *row = &model->grid[(size_t)i*W];
+		const uint64_t *up = &model->grid[(size_t)((i+D-1) % D)*W];
+		const uint64_t *down = &model->grid[(size_t)((i+1) % D)*W];
+		const uint64_t active = (i + colour) % 2 == 0 ? EVEN_BITS : ~EVEN_BITS;
+		philox_fill(model->seed, i, b, ising_stream(ISING_STREAM_MULTISPIN, model->half_sweeps), 0, r, W*MULTISPIN_PLANES/2);
+
+		// Count the anti-aligned neighbours of every site, and settle the flips that need no comparison
+		uint64_t pending = 0;
+		for(int w=0; w<W; w++) {
+			uint64_t x = row[w];
+			uint64_t left = x << 1 | row[(w+W-1) % W] >> 63;
+			uint64_t right = x >> 1 | row[(w+1) % W] << 63;
+			bit_count(x, up[w], down[w], left, right, &k0[w], &k1[w], &k2[w]);
+			accept[w] = active & bit_select(model->tables.always, x, k0[w], k1[w], k2[w]);
+			undecided[w] = active & bit_select(model->tables.random, x, k0[w], k1[w], k2[w]);
+			pending |= undecided[w];
+		}
+
+		// Compare the uniforms with the thresholds from the most significant bit down, one plane of the row at a time
+		for(int p=0; p<MULTISPIN_PLANES && pending; p++) {
+			pending = 0;
+			for(int w=0; w<W; w++) {
+				uint64_t u = (uint64_t)r[2*(p*W + w) + 1] << 32 | r[2*(p*W + w)];
+				uint64_t bit = bit_select(model->tables.plane[p], row[w], k0[w], k1[w], k2[w]);
+				accept[w] |= undecided[w] & ~u & bit;
+				undecided[w] &= ~(u ^ bit);
+				pending |= undecided[w];
+			}
+		}
+
+		// The few words still undecided draw the remaining planes two at a time
+		for(int w=0; w<W && pending; w++) {
+			uint32_t extra[4];
+			for(int p=MULTISPIN_PLANES; p<31 && undecided[w]; p++) {
+				int q = p - MULTISPIN_PLANES;
+				if(q % 2 == 0) {
+					philox_block(model->seed, i, b, ising_stream(ISING_STREAM_MULTISPIN_EXTRA, model->half_sweeps), w*EXTRA_BLOCKS + q/2, extra);
+				}
+				uint64_t u = (uint64_t)extra[2*(q % 2) + 1] << 32 | extra[2*(q % 2)];
+				uint64_t bit = bit_select(model->tables.plane[p], row[w], k0[w], k1[w], k2[w]);
+				accept[w] |= undecided[w] & ~u & bit;
+				undecided[w] &= ~(u ^ bit);
+			}
+		}
+
+		// Flipping a site with k anti-aligned neighbours changes the bond sum by 4k - 8
+		for(int w=0; w<W; w++) {
+			uint64_t f = accept[w], x = row[w];
+			bonds += 4*(__builtin_popcountll(f & k0[w]) + 2*__builtin_popcountll(f & k1[w]) + 4*__builtin_popcountll(f & k2[w])) - 8*__builtin_popcountll(f);
+			M += 2*(__builtin_popcountll(f & ~x) - __builtin_popcountll(f & x));
+			row[w] = x ^ f;
+		}
+	}
+	model->task_bonds[task] = bonds;
+	model->task_M[task] = M;
+}
+
+
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void multispin_sweep(Multispin *model, const int sweeps)
+{
+	for(int h=0; h<2*sweeps; h++) {
+		parallel_for(model->pool, model->num_tasks, sweep_rows, model);
+		for(int t=0; t<model->num_tasks; t++) {
+			model->bonds += model->task_bonds[t];
+			model->M += model->task_M[t];
+		}
+		model->half_sweeps++;
+	}
+}
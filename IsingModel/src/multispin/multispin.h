@@ -0,0 +1,118 @@
+#ifndef _MULTISPIN_H
+#define _MULTISPIN_H
+
+#include <stdint.h> /* int8_t, int64_t, uint32_t, uint64_t */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Multi-spin coded Ising model: the lattice of src/ising/ stored with one bit per spin.
+ *
+ * Bit b of word w of row i holds the spin in column 64w + b, with 1 for +1. A half
+ * sweep updates the 32 sites of one checkerboard colour in a word at once. Each of
+ * the four neighbour words is XORed with the word to mark the anti-aligned
+ * neighbours, and a bitwise full adder counts them into three bit planes k₂k₁k₀. A
+ * site with k anti-aligned neighbours has neighbour sum n = s(4 - 2k), which together
+ * with its spin picks one of the ten acceptance thresholds of ising_acceptance.
+ *
+ * The acceptance test u < threshold is made for all sites of a word together, one
+ * bit of the 31-bit uniforms u at a time from the most significant: a bit where u and
+ * the threshold differ decides the comparison, and each plane of random bits decides
+ * about half of the sites still undecided. The first MULTISPIN_PLANES planes of a row
+ * are generated in bulk, and the rare words still undecided after them draw further
+ * planes on their own. Flips that are always or never accepted skip the comparison.
+ *
+ * The energy and magnetisation are tracked with popcounts of the flipped sites, and
+ * the random numbers are keyed on the seed, row and half sweep as in src/ising/.
+ */
+
+#define MULTISPIN_PLANES 8 /* Random bit planes generated in bulk per word */
+
+/* Acceptance thresholds of ising_acceptance spread into masks for bitwise comparisons */
+typedef struct BitTables {
+	uint32_t threshold[10]; /* Acceptance thresholds, indexed as in ising_acceptance */
+	uint64_t always[10]; /* All ones for the thresholds of flips that are always accepted */
+	uint64_t random[10]; /* All ones for the thresholds strictly between zero and ISING_ALWAYS */
+	uint64_t plane[31][10]; /* All ones where bit 30 - p of the threshold is set, for comparison p */
+} BitTables;
+
+typedef struct Multispin {
+	int D; /* Height and width of the square lattice. Must be a multiple of 64. */
+	int W; /* Words per row */
+	double T; /* Temperature */
+	double J; /* Strength of pairwise interaction */
+	double H; /* Strength of external magnetic field */
+	uint64_t *grid; /* Spins, one bit each, row major */
+	int64_t bonds; /* Σ<ij> sᵢsⱼ over nearest neighbour pairs */
+	int64_t M; /* Magnetisation Σᵢ sᵢ */
+	uint64_t seed; /* Key of the random number generator */
+	uint64_t half_sweeps; /* Number of checkerboard half sweeps so far */
+	BitTables tables; /* Acceptance thresholds as masks */
+	ThreadPool *pool; /* Threads for the sweeps. Owned. */
+	int num_tasks; /* Number of blocks of rows a half sweep is split into */
+	int64_t *task_bonds, *task_M; /* Change in bonds and M from each block of the current half sweep */
+} Multispin;
+
+/* Tabulates the masks of the acceptance thresholds at T, J and H */
+void bit_tables(const double T, const double J, const double H, BitTables *tables);
+
+/*
+ * Counts the anti-aligned neighbours of every bit of x into the bit planes of
+ * k = 4k₂ + 2k₁ + k₀ with a bitwise full adder
+ */
+static inline void bit_count(const uint64_t x, const uint64_t up, const uint64_t down, const uint64_t left, const uint64_t right, uint64_t *k0, uint64_t *k1, uint64_t *k2)
+{
+	uint64_t a1 = x ^ up, a2 = x ^ down, a3 = x ^ left, a4 = x ^ right;
+	uint64_t s12 = a1 ^ a2, c12 = a1 & a2;
+	uint64_t s34 = a3 ^ a4, c34 = a3 & a4;
+	uint64_t carry = s12 & s34, t = c12 ^ c34;
+	*k0 = s12 ^ s34;
+	*k1 = t ^ carry;
+	*k2 = (c12 & c34) | (t & carry);
+}
+
+/*
+ * Bits of a word whose entry in a table over the ten thresholds is all ones, given the
+ * spins x and the bit planes of their number of anti-aligned neighbours k. A spin s with
+ * k anti-aligned neighbours has n = s(4-2k), so its index is k for s = -1 and 9-k for s = +1.
+ */
+static inline uint64_t bit_select(const uint64_t table[10], const uint64_t x, const uint64_t k0, const uint64_t k1, const uint64_t k2)
+{
+	const uint64_t count[5] = {~k2 & ~k1 & ~k0, ~k2 & ~k1 & k0, ~k2 & k1 & ~k0, ~k2 & k1 & k0, k2};
+	uint64_t bits = 0;
+	for(int k=0; k<5; k++) {
+		bits |= count[k] & ((x & table[9-k]) | (~x & table[k]));
+	}
+	return bits;
+}
+
+/* Creates a model in a random initial state */
+Multispin *multispin_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads);
+
+/* Frees the model */
+void multispin_destroy(Multispin *model);
+
+/* Sets the temperature to T */
+void multispin_set_T(Multispin *model, const double T);
+
+/* Sets the strength of pairwise interaction to J */
+void multispin_set_J(Multispin *model, const double J);
+
+/* Sets the strength of external magnetic field to H */
+void multispin_set_H(Multispin *model, const double H);
+
+/* Total energy of the current configuration */
+double multispin_energy(const Multispin *model);
+
+/* Recomputes the bond sum and magnetisation, after the grid has been changed directly */
+void multispin_recount(Multispin *model);
+
+/* Packs a row major grid of ±1 spins into the model and recounts */
+void multispin_pack(Multispin *model, const int8_t *spins);
+
+/* Unpacks the model into a row major grid of ±1 spins */
+void multispin_unpack(const Multispin *model, int8_t *spins);
+
+/* Performs sweeps full checkerboard Metropolis sweeps */
+void multispin_sweep(Multispin *model, const int sweeps);
+
+#endif
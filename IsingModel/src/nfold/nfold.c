@@ -0,0 +1,195 @@
+#include "nfold.h"
+#include <math.h> // exp, log, INFINITY, NAN
+#include <stdlib.h> // malloc, calloc, free
+#include "../random/philox.h" // philox_fill, philox_uniform
+
+
+
+/* Class of a site, indexed as in ising_acceptance */
+static int site_class(const Ising *model, const int i, const int j)
+{
+	const int D = model->D;
+	const int8_t *grid = model->grid;
+	int n = grid[((i+D-1) % D)*D + j] + grid[((i+1) % D)*D + j] + grid[i*D + (j+D-1) % D] + grid[i*D + (j+1) % D];
+	return 5*(grid[i*D + j] > 0) + (n + 4)/2;
+}
+
+
+
+/* Sorts the sites of a model by class */
+NFold *nfold_create(Ising *model)
+{
+	const size_t N = (size_t)model->D*model->D;
+	NFold *nf = calloc(1, sizeof(NFold));
+	nf->model = model;
+	nf->class = malloc(N);
+	nf->sites = malloc(N*sizeof(int32_t));
+	nf->position = malloc(N*sizeof(int32_t));
+	nf->random_index = NFOLD_BATCH;
+	nf->T = NAN; // Compares unequal to every temperature, so the first advance computes the rates
+	nfold_recount(nf);
+	return nf;
+}
+
+
+
+/* Frees the workspace. The model is left untouched. */
+void nfold_destroy(NFold *nf)
+{
+	free(nf->class);
+	free(nf->sites);
+	free(nf->position);
+	free(nf);
+}
+
+
+
+/* Sorts the sites again, after the model has been updated by other means */
+void nfold_recount(NFold *nf)
+{
+	const int D = nf->model->D;
+	int32_t count[10] = {0};
+	for(int i=0; i<D; i++) {
+		for(int j=0; j<D; j++) {
+			nf->class[i*D + j] = (int8_t)site_class(nf->model, i, j);
+			count[nf->class[i*D + j]]++;
+		}
+	}
+	nf->start[0] = 0;
+	for(int c=0; c<10; c++) {
+		nf->start[c+1] = nf->start[c] + count[c];
+	}
+	int32_t next[10];
+	for(int c=0; c<10; c++) {
+		next[c] = nf->start[c];
+	}
+	for(int32_t site=0; site<D*D; site++) {
+		int32_t p = next[nf->class[site]]++;
+		nf->sites[p] = site;
+		nf->position[site] = p;
+	}
+}
+
+
+
+/* Swaps the entries at positions p and q of the sorted sites */
+static inline void swap_sites(NFold *nf, const int32_t p, const int32_t q)
+{
+	int32_t a = nf->sites[p], b = nf->sites[q];
+	nf->sites[p] = b;
+	nf->sites[q] = a;
+	nf->position[b] = p;
+	nf->position[a] = q;
+}
+
+
+
+/* Moves a site to another class, one segment boundary at a time */
+static void move_site(NFold *nf, const int32_t site, const int to)
+{
+	int c = nf->class[site];
+	while(c < to) { // The site becomes the first of the next segment
+		swap_sites(nf, nf->position[site], nf->start[c+1] - 1);
+		nf->start[++c]--;
+	}
+	while(c > to) { // The site becomes the last of the previous segment
+		swap_sites(nf, nf->position[site], nf->start[c]);
+		nf->start[c--]++;
+	}
+	nf->class[site] = (int8_t)to;
+}
+
+
+
+/* Recomputes the flip rates if T, J or H has changed since they were last computed */
+static void update_rates(NFold *nf)
+{
+	const Ising *model = nf->model;
+	if(nf->T == model->T && nf->J == model->J && nf->H == model->H) {
+		return;
+	}
+	nf->T = model->T;
+	nf->J = model->J;
+	nf->H = model->H;
+	for(int c=0; c<10; c++) {
+		int s = c >= 5 ? 1 : -1;
+		int n = 2*(c % 5) - 4;
+		double dE = 2.0*s*(model->J*n + model->H);
+		nf->rate[c] = dE <= 0 ? 1.0 : (model->T > 0 ? exp(-dE/model->T) : 0.0);
+	}
+}
+
+
+
+/* Sets the leaves of the tree to the total rates of the classes and sums them up the tree */
+static void update_tree(NFold *nf)
+{
+	for(int c=0; c<10; c++) {
+		nf->tree[16 + c] = (nf->start[c+1] - nf->start[c])*nf->rate[c];
+	}
+	for(int node=15; node>0; node--) {
+		nf->tree[node] = nf->tree[2*node] + nf->tree[2*node + 1];
+	}
+}
+
+
+
+/* Flips sites until the time has advanced by duration sweeps. Returns the number of flips. */
+long nfold_advance(NFold *nf, const double duration)
+{
+	Ising *model = nf->model;
+	const int D = model->D;
+	const double end = nf->time + duration;
+	long flips = 0;
+	update_rates(nf);
+	update_tree(nf);
+	while(1) {
+		if(nf->random_index == NFOLD_BATCH) {
+			philox_fill(model->seed, 0, (uint32_t)nf->batches, ising_stream(ISING_STREAM_NFOLD, nf->batches), 0, nf->random, NFOLD_BATCH);
+			nf->batches++;
+			nf->random_index = 0;
+		}
+		const uint32_t *r = &nf->random[4*nf->random_index++];
+
+		// Each site attempts one flip per sweep, so the total rate per sweep is Σ N_c w_c
+		double total = nf->tree[1];
+		double wait = total > 0 ? -log(philox_uniform(r[3]))/total : INFINITY;
+		if(nf->time + wait > end) { // The waiting time is memoryless, so the event can be dropped
+			nf->time = end;
+			break;
+		}
+		nf->time += wait;
+
+		// Descend the tree to a class with probability proportional to its total rate
+		double x = ((uint64_t)r[0] << 21 ^ r[1] >> 11)*(1.0/9007199254740992.0)*total;
+		int node = 1;
+		while(node < 16) {
+			if(x < nf->tree[2*node] || nf->tree[2*node + 1] <= 0) {
+				node = 2*node;
+			} else {
+				x -= nf->tree[2*node];
+				node = 2*node + 1;
+			}
+		}
+		int c = node - 16;
+		int32_t count = nf->start[c+1] - nf->start[c];
+		int32_t site = nf->sites[nf->start[c] + (int32_t)(((uint64_t)r[2]*count) >> 32)];
+
+		// Flip it. Its class changes spin, and the neighbour sum of each neighbour changes by -2s.
+		int i = site / D, j = site % D;
+		int s = model->grid[site];
+		int n = 2*(c % 5) - 4;
+		model->grid[site] = (int8_t)-s;
+		model->bonds -= 2*s*n;
+		model->M -= 2*s;
+		move_site(nf, site, (c + 5) % 10);
+		const int32_t neighbours[4] = {((i+D-1) % D)*D + j, ((i+1) % D)*D + j, i*D + (j+D-1) % D, i*D + (j+1) % D};
+		for(int k=0; k<4; k++) {
+			move_site(nf, neighbours[k], nf->class[neighbours[k]] - s);
+		}
+		update_tree(nf);
+		nf->events++;
+		flips++;
+	}
+	return flips;
+}
@@ -0,0 +1,424 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h> // PyObject, PyArg_ParseTupleAndKeywords, Py_BEGIN_ALLOW_THREADS, Py_buffer
+#include <stdlib.h> // malloc, free
+#include <string.h> // strcmp
+#include <time.h> // time
+#include "../ising/ising.h" // ising_create, ising_update, ising_sweep, ising_energy, ising_set_T, ising_set_J, ising_set_H, ising_destroy
+#include "../multispin/multispin.h" // multispin_create, multispin_sweep, multispin_energy, multispin_unpack, multispin_set_T, multispin_set_J, multispin_set_H, multispin_destroy
+
+/*
+ * Python extension module with the interface of IsingModel.py, backed by the native
+ * engine, so that `from NativeIsing import IsingModel` speeds up existing scripts.
+ *
+ * The model exports its lattice through the buffer protocol as a read-only D x D
+ * array of int8 spins, and the grid attribute is numpy.asarray of the model. For the
+ * byte per spin engine that array is a view of the engine's own lattice, so it follows
+ * every update without a copy. The multi-spin coded engine keeps its spins in bits, so
+ * they are unpacked into a buffer of the model whenever grid is read. Arrays from
+ * earlier reads share that buffer.
+ *
+ * update(steps) runs single spin Metropolis steps with ising_update, like
+ * IsingModel.update. The multi-spin engine has no single spin steps, so it counts the
+ * steps and runs a sweep for every D² of them. sweep(sweeps) runs checkerboard sweeps.
+ * Both release the GIL while the engine works. A model is used by one thread at a
+ * time, and calls on a model that another thread is updating raise RuntimeError.
+ *
+ * E counts every nearest neighbour pair once, as in src/ising/ising.h. IsingModel.energy
+ * counts every pair twice.
+ */
+
+typedef struct NativeModel {
+	PyObject_HEAD
+	Ising *model; /* Byte per spin engine, or NULL */
+	Multispin *multispin; /* Multi-spin coded engine, or NULL */
+	int8_t *unpacked; /* Spins of the multi-spin engine, unpacked when grid is read */
+	long pending_steps; /* Single spin steps of the multi-spin engine not yet run as a sweep */
+	int busy; /* Nonzero while a thread is updating the model without the GIL */
+} NativeModel;
+
+static PyObject *asarray; // numpy.asarray
+
+
+
+/* Raises RuntimeError and returns nonzero if the model is not initialised */
+static int check_ready(NativeModel *self)
+{
+	if(self->model == NULL && self->multispin == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "The model is not initialised");
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/* Raises RuntimeError and returns nonzero if the model is not initialised or another thread is updating it */
+static int check_busy(NativeModel *self)
+{
+	if(check_ready(self)) {
+		return 1;
+	}
+	if(self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "The model is being updated by another thread");
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/* IsingModel(D, T, J, H, seed=None, threads=1, engine='metropolis') */
+static int NativeModel_init(NativeModel *self, PyObject *args, PyObject *kwds)
+{
+	static char *keywords[] = {"D", "T", "J", "H", "seed", "threads", "engine", NULL};
+	int D, threads = 1;
+	double T, J, H;
+	PyObject *seed_object = Py_None;
+	const char *engine = "metropolis";
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "iddd|Ois", keywords, &D, &T, &J, &H, &seed_object, &threads, &engine)) {
+		return -1;
+	}
+	if(self->model != NULL || self->multispin != NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "The model is already initialised");
+		return -1;
+	}
+	uint64_t seed = (uint64_t)time(NULL);
+	if(seed_object != Py_None) {
+		seed = PyLong_AsUnsignedLongLongMask(seed_object);
+		if(PyErr_Occurred()) {
+			return -1;
+		}
+	}
+	if(strcmp(engine, "metropolis") == 0) {
+		if(D < 2 || D % 2 != 0) {
+			PyErr_Format(PyExc_ValueError, "Lattice size must be even, not %d", D);
+			return -1;
+		}
+		self->model = ising_create(D, T, J, H, seed, threads);
+	} else if(strcmp(engine, "multispin") == 0) {
+		if(D < 64 || D % 64 != 0) {
+			PyErr_Format(PyExc_ValueError, "Lattice size must be a multiple of 64, not %d", D);
+			return -1;
+		}
+		self->multispin = multispin_create(D, T, J, H, seed, threads);
+		self->unpacked = malloc((size_t)D*D);
+	} else {
+		PyErr_Format(PyExc_ValueError, "Unknown engine %s, expected metropolis or multispin", engine);
+		return -1;
+	}
+	return 0;
+}
+
+
+
+static void NativeModel_dealloc(NativeModel *self)
+{
+	if(self->model != NULL) {
+		ising_destroy(self->model);
+	}
+	if(self->multispin != NULL) {
+		multispin_destroy(self->multispin);
+	}
+	free(self->unpacked);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+
+/* Exports the lattice as a read-only D x D array of int8 spins */
+static int NativeModel_getbuffer(NativeModel *self, Py_buffer *view, int flags)
+{
+	if(self->model == NULL && self->multispin == NULL) {
+		PyErr_SetString(PyExc_BufferError, "The model is not initialised");
+		return -1;
+	}
+	if((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "The lattice is read-only, since writes would bypass the tracked energy");
+		return -1;
+	}
+	int8_t *spins;
+	int D;
+	if(self->model != NULL) {
+		spins = self->model->grid;
+		D = self->model->D;
+	} else {
+		if(self->busy) {
+			PyErr_SetString(PyExc_BufferError, "The model is being updated by another thread");
+			return -1;
+		}
+		multispin_unpack(self->multispin, self->unpacked);
+		spins = self->unpacked;
+		D = self->multispin->D;
+	}
+	// The shape and strides live in the buffer's internal field, freed by releasebuffer
+	Py_ssize_t *layout = malloc(4*sizeof(Py_ssize_t));
+	layout[0] = D;
+	layout[1] = D;
+	layout[2] = D;
+	layout[3] = 1;
+	view->buf = spins;
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->len = (Py_ssize_t)D*D;
+	view->itemsize = 1;
+	view->readonly = 1;
+	view->format = (flags & PyBUF_FORMAT) ? "b" : NULL;
+	view->ndim = 2;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? layout : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? layout + 2 : NULL;
+	view->suboffsets = NULL;
+	view->internal = layout;
+	return 0;
+}
+
+
+
+static void NativeModel_releasebuffer(NativeModel *self, Py_buffer *view)
+{
+	(void)self;
+	free(view->internal);
+}
+
+
+
+/* update(steps=1): single spin Metropolis steps, with the GIL released */
+static PyObject *NativeModel_update(NativeModel *self, PyObject *args, PyObject *kwds)
+{
+	static char *keywords[] = {"steps", NULL};
+	long steps = 1;
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|l", keywords, &steps)) {
+		return NULL;
+	}
+	if(check_busy(self)) {
+		return NULL;
+	}
+	if(steps < 0) {
+		PyErr_SetString(PyExc_ValueError, "The number of steps must not be negative");
+		return NULL;
+	}
+	self->busy = 1;
+	if(self->model != NULL) {
+		Ising *model = self->model;
+		Py_BEGIN_ALLOW_THREADS
+		ising_update(model, steps);
+		Py_END_ALLOW_THREADS
+	} else {
+		const long N = (long)self->multispin->D*self->multispin->D;
+		self->pending_steps += steps;
+		int sweeps = (int)(self->pending_steps/N);
+		self->pending_steps -= sweeps*N;
+		Multispin *multispin = self->multispin;
+		Py_BEGIN_ALLOW_THREADS
+		multispin_sweep(multispin, sweeps);
+		Py_END_ALLOW_THREADS
+	}
+	self->busy = 0;
+	Py_RETURN_NONE;
+}
+
+
+
+/* sweep(sweeps=1): checkerboard sweeps, with the GIL released */
+static PyObject *NativeModel_sweep(NativeModel *self, PyObject *args, PyObject *kwds)
+{
+	static char *keywords[] = {"sweeps", NULL};
+	int sweeps = 1;
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", keywords, &sweeps)) {
+		return NULL;
+	}
+	if(check_busy(self)) {
+		return NULL;
+	}
+	if(sweeps < 0) {
+		PyErr_SetString(PyExc_ValueError, "The number of sweeps must not be negative");
+		return NULL;
+	}
+	self->busy = 1;
+	Ising *model = self->model;
+	Multispin *multispin = self->multispin;
+	Py_BEGIN_ALLOW_THREADS
+	if(model != NULL) {
+		ising_sweep(model, sweeps);
+	} else {
+		multispin_sweep(multispin, sweeps);
+	}
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+	Py_RETURN_NONE;
+}
+
+
+
+/* Sets T, J or H of whichever engine the model uses */
+static PyObject *set_parameter(NativeModel *self, PyObject *arg, void (*set_ising)(Ising *, const double), void (*set_multispin)(Multispin *, const double))
+{
+	double value = PyFloat_AsDouble(arg);
+	if(PyErr_Occurred() || check_busy(self)) {
+		return NULL;
+	}
+	if(self->model != NULL) {
+		set_ising(self->model, value);
+	} else {
+		set_multispin(self->multispin, value);
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *NativeModel_set_T(NativeModel *self, PyObject *arg)
+{
+	if(PyFloat_AsDouble(arg) <= 0 && !PyErr_Occurred()) {
+		PyErr_SetString(PyExc_ValueError, "The temperature must be positive");
+		return NULL;
+	}
+	return set_parameter(self, arg, ising_set_T, multispin_set_T);
+}
+
+static PyObject *NativeModel_set_J(NativeModel *self, PyObject *arg)
+{
+	return set_parameter(self, arg, ising_set_J, multispin_set_J);
+}
+
+static PyObject *NativeModel_set_H(NativeModel *self, PyObject *arg)
+{
+	return set_parameter(self, arg, ising_set_H, multispin_set_H);
+}
+
+
+
+/* Attributes read from the engine */
+static PyObject *NativeModel_get_grid(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyObject_CallOneArg(asarray, (PyObject *)self);
+}
+
+static PyObject *NativeModel_get_E(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyFloat_FromDouble(self->model != NULL ? ising_energy(self->model) : multispin_energy(self->multispin));
+}
+
+static PyObject *NativeModel_get_M(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyLong_FromLongLong(self->model != NULL ? self->model->M : self->multispin->M);
+}
+
+static PyObject *NativeModel_get_D(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyLong_FromLong(self->model != NULL ? self->model->D : self->multispin->D);
+}
+
+static PyObject *NativeModel_get_T(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyFloat_FromDouble(self->model != NULL ? self->model->T : self->multispin->T);
+}
+
+static PyObject *NativeModel_get_J(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyFloat_FromDouble(self->model != NULL ? self->model->J : self->multispin->J);
+}
+
+static PyObject *NativeModel_get_H(NativeModel *self, void *closure)
+{
+	(void)closure;
+	if(check_ready(self)) {
+		return NULL;
+	}
+	return PyFloat_FromDouble(self->model != NULL ? self->model->H : self->multispin->H);
+}
+
+
+
+static PyMethodDef NativeModel_methods[] = {
+	{"update", (PyCFunction)(void (*)(void))NativeModel_update, METH_VARARGS | METH_KEYWORDS, "Performs steps single spin Metropolis steps, or sweeps worth as many with the multispin engine"},
+	{"sweep", (PyCFunction)(void (*)(void))NativeModel_sweep, METH_VARARGS | METH_KEYWORDS, "Performs checkerboard sweeps of the whole lattice"},
+	{"set_T", (PyCFunction)NativeModel_set_T, METH_O, "Sets the temperature to T"},
+	{"set_J", (PyCFunction)NativeModel_set_J, METH_O, "Sets the strength of pairwise interaction to J"},
+	{"set_H", (PyCFunction)NativeModel_set_H, METH_O, "Sets the strength of external magnetic field to H"},
+	{NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef NativeModel_getset[] = {
+	{"grid", (getter)NativeModel_get_grid, NULL, "Read-only D x D numpy array of the spins, sharing the engine's memory", NULL},
+	{"E", (getter)NativeModel_get_E, NULL, "Total energy, counting every pair once", NULL},
+	{"M", (getter)NativeModel_get_M, NULL, "Magnetisation", NULL},
+	{"D", (getter)NativeModel_get_D, NULL, "Height and width of square lattice", NULL},
+	{"T", (getter)NativeModel_get_T, NULL, "Temperature", NULL},
+	{"J", (getter)NativeModel_get_J, NULL, "Strength of pairwise interaction", NULL},
+	{"H", (getter)NativeModel_get_H, NULL, "Strength of external magnetic field", NULL},
+	{NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyBufferProcs NativeModel_buffer = {
+	(getbufferproc)NativeModel_getbuffer,
+	(releasebufferproc)NativeModel_releasebuffer
+};
+
+static PyTypeObject NativeModelType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "NativeIsing.IsingModel",
+	.tp_doc = "Square lattice Ising model with periodic boundary conditions, backed by the native engine",
+	.tp_basicsize = sizeof(NativeModel),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)NativeModel_init,
+	.tp_dealloc = (destructor)NativeModel_dealloc,
+	.tp_methods = NativeModel_methods,
+	.tp_getset = NativeModel_getset,
+	.tp_as_buffer = &NativeModel_buffer,
+};
+
+static struct PyModuleDef NativeIsing_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "NativeIsing",
+	.m_doc = "Native Ising engine with the interface of IsingModel.py",
+	.m_size = -1,
+};
+
+
+
+PyMODINIT_FUNC PyInit_NativeIsing(void)
+{
+	PyObject *numpy = PyImport_ImportModule("numpy");
+	if(numpy == NULL) {
+		return NULL;
+	}
+	asarray = PyObject_GetAttrString(numpy, "asarray");
+	Py_DECREF(numpy);
+	if(asarray == NULL || PyType_Ready(&NativeModelType) < 0) {
+		return NULL;
+	}
+	PyObject *module = PyModule_Create(&NativeIsing_module);
+	if(module == NULL) {
+		return NULL;
+	}
+	Py_INCREF(&NativeModelType);
+	if(PyModule_AddObject(module, "IsingModel", (PyObject *)&NativeModelType) < 0) {
+		Py_DECREF(&NativeModelType);
+		Py_DECREF(module);
+		return NULL;
+	}
+	return module;
+}
@@ -0,0 +1,88 @@
+#ifndef _PHILOX_H
+#define _PHILOX_H
+
+#include <stdint.h> /* uint32_t, uint64_t */
+
+/*
+ * Counter-based Philox4x32-10 generator of Salmon et al. (2011).
+ *
+ * Each random number is a function of a key (the seed) and a 128-bit counter, so the
+ * numbers for a site, a row or a sweep can be computed by whichever thread needs them,
+ * in any order, and a run gives the same result for any number of threads. The
+ * counter words are (block, a, b, c), where the caller chooses a, b and c to name the
+ * stream and every block gives four 32-bit numbers.
+ */
+
+#define PHILOX_LANES 32 /* Counters encrypted together. The loops over them vectorise. */
+#define PHILOX_ROUNDS 10
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+/* Writes the 4*blocks numbers of blocks first,...,first+blocks-1 of stream (a, b, c) to out */
+static inline void philox_fill(const uint64_t seed, const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t first, uint32_t *out, const int blocks)
+{
+	for(int i=0; i<blocks; i+=PHILOX_LANES) {
+		uint32_t c0[PHILOX_LANES], c1[PHILOX_LANES], c2[PHILOX_LANES], c3[PHILOX_LANES];
+		for(int l=0; l<PHILOX_LANES; l++) {
+			c0[l] = first + i + l;
+			c1[l] = a;
+			c2[l] = b;
+			c3[l] = c;
+		}
+		uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+		for(int r=0; r<PHILOX_ROUNDS; r++) {
+			for(int l=0; l<PHILOX_LANES; l++) {
+				uint64_t p0 = (uint64_t)PHILOX_M0*c0[l];
+				uint64_t p1 = (uint64_t)PHILOX_M1*c2[l];
+				uint32_t x0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+				uint32_t x2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+				c1[l] = (uint32_t)p1;
+				c3[l] = (uint32_t)p0;
+				c0[l] = x0;
+				c2[l] = x2;
+			}
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+		int n = blocks - i < PHILOX_LANES ? blocks - i : PHILOX_LANES;
+		for(int l=0; l<n; l++) {
+			out[4*(i+l)] = c0[l];
+			out[4*(i+l) + 1] = c1[l];
+			out[4*(i+l) + 2] = c2[l];
+			out[4*(i+l) + 3] = c3[l];
+		}
+	}
+}
+
+/* The four numbers of block first of stream (a, b, c), for when too few are needed to fill the lanes */
+static inline void philox_block(const uint64_t seed, const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t first, uint32_t out[4])
+{
+	uint32_t c0 = first, c1 = a, c2 = b, c3 = c;
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+	for(int r=0; r<PHILOX_ROUNDS; r++) {
+		uint64_t p0 = (uint64_t)PHILOX_M0*c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1*c2;
+		uint32_t x0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		uint32_t x2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = x0;
+		c2 = x2;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/* Uniform(0,1) variate from a 32-bit number */
+static inline double philox_uniform(const uint32_t x)
+{
+	return (x + 0.5)*(1.0/4294967296.0);
+}
+
+#endif
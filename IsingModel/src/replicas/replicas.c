@@ -0,0 +1,248 @@
+#include "replicas.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc, calloc, free, exit
+#include "../ising/ising.h" // ising_stream, ISING_STREAM_REPLICAS, ISING_STREAM_REPLICAS_EXTRA, ISING_STREAM_REPLICAS_INIT
+#include "../random/philox.h" // philox_fill, philox_block
+
+#define TASKS_PER_THREAD 4 // Blocks of rows per thread in a half sweep, to even out the load
+#define EXTRA_BLOCKS 10 // Blocks of the stream of further planes per site, two planes each
+
+
+
+/* Creates REPLICAS models, each in its own random initial state */
+Replicas *replicas_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads)
+{
+	if(D < 2 || D % 2 != 0) {
+		fprintf(stderr, "The side length of the lattice must be even for checkerboard sweeps, not %d.\n", D);
+		exit(1);
+	}
+	Replicas *model = calloc(1, sizeof(Replicas));
+	model->D = D;
+	model->T = T;
+	model->J = J;
+	model->H = H;
+	model->seed = seed;
+	model->grid = malloc((size_t)D*D*sizeof(uint64_t));
+	bit_tables(T, J, H, &model->tables);
+
+	// Start every replica from its own random initial state
+	uint32_t r[2*D];
+	for(int i=0; i<D; i++) {
+		philox_fill(seed, i, 0, ising_stream(ISING_STREAM_REPLICAS_INIT, 0), 0, r, D/2);
+		for(int j=0; j<D; j++) {
+			model->grid[(size_t)i*D + j] = (uint64_t)r[2*j+1] << 32 | r[2*j];
+		}
+	}
+
+	model->pool = threadpool_create(num_threads);
+	model->num_tasks = TASKS_PER_THREAD*model->pool->num_threads < D ? TASKS_PER_THREAD*model->pool->num_threads : D;
+	model->task_up = calloc((size_t)model->num_tasks*REPLICAS, sizeof(int64_t));
+	model->task_anti = calloc((size_t)model->num_tasks*REPLICAS, sizeof(int64_t));
+	return model;
+}
+
+
+
+/* Frees the models */
+void replicas_destroy(Replicas *model)
+{
+	threadpool_destroy(model->pool);
+	free(model->task_up);
+	free(model->task_anti);
+	free(model->grid);
+	free(model);
+}
+
+
+
+/* Sets the temperature of every replica to T */
+void replicas_set_T(Replicas *model, const double T)
+{
+	model->T = T;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Sets the strength of pairwise interaction of every replica to J */
+void replicas_set_J(Replicas *model, const double J)
+{
+	model->J = J;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Sets the strength of external magnetic field of every replica to H */
+void replicas_set_H(Replicas *model, const double H)
+{
+	model->H = H;
+	bit_tables(model->T, model->J, model->H, &model->tables);
+}
+
+
+
+/* Updates the sites of the current colour in one block of rows */
+static void sweep_rows(void *arg, const int task)
+{
+	Replicas *model = arg;
+	const int D = model->D, L = D/2;
+	const uint32_t b = (uint32_t)model->half_sweeps;
+	const BitTables *tables = &model->tables;
+	uint32_t r[2*L*REPLICAS_PLANES];
+	uint64_t k0[L], k1[L], k2[L], accept[L], undecided[L];
+	for(int i=task*D/model->num_tasks; i<(task+1)*D/model->num_tasks; i++) {
+		uint64_t *row = &model->grid[(size_t)i*D];
+		const uint64_t *up = &model->grid[(size_t)((i+D-1) % D)*D];
+		const uint64_t *down = &model->grid[(size_t)((i+1) % D)*D];
+		const int first = (i + model->half_sweeps) % 2; // Column of the first site of the current colour
+		philox_fill(model->seed, i, b, ising_stream(ISING_STREAM_REPLICAS, model->half_sweeps), 0, r, L*REPLICAS_PLANES/2);
+
+		// Count the anti-aligned neighbours of site j = first + 2m in every replica, and settle the flips that need no comparison
+		uint64_t pending = 0;
+		for(int m=0; m<L; m++) {
+			int j = first + 2*m;
+			uint64_t x = row[j];
+			bit_count(x, up[j], down[j], row[j == 0 ? D-1 : j-1], row[j == D-1 ? 0 : j+1], &k0[m], &k1[m], &k2[m]);
+			accept[m] = bit_select(tables->always, x, k0[m], k1[m], k2[m]);
+			undecided[m] = bit_select(tables->random, x, k0[m], k1[m], k2[m]);
+			pending |= undecided[m];
+		}
+
+		// Compare the uniforms with the thresholds from the most significant bit down, one plane of the row at a time
+		for(int p=0; p<REPLICAS_PLANES && pending; p++) {
+			pending = 0;
+			for(int m=0; m<L; m++) {
+				uint64_t u = (uint64_t)r[2*(p*L + m) + 1] << 32 | r[2*(p*L + m)];
+				uint64_t bit = bit_select(tables->plane[p], row[first + 2*m], k0[m], k1[m], k2[m]);
+				accept[m] |= undecided[m] & ~u & bit;
+				undecided[m] &= ~(u ^ bit);
+				pending |= undecided[m];
+			}
+		}
+
+		// The few sites still undecided in some replica draw the remaining planes two at a time
+		for(int m=0; m<L && pending; m++) {
+			uint32_t extra[4];
+			for(int p=REPLICAS_PLANES; p<31 && undecided[m]; p++) {
+				int q = p - REPLICAS_PLANES;
+				if(q % 2 == 0) {
+					philox_block(model->seed, i, b, ising_stream(ISING_STREAM_REPLICAS_EXTRA, model->half_sweeps), m*EXTRA_BLOCKS + q/2, extra);
+				}
+				uint64_t u = (uint64_t)extra[2*(q % 2) + 1] << 32 | extra[2*(q % 2)];
+				uint64_t bit = bit_select(tables->plane[p], row[first + 2*m], k0[m], k1[m], k2[m]);
+				accept[m] |= undecided[m] & ~u & bit;
+				undecided[m] &= ~(u ^ bit);
+			}
+		}
+
+		for(int m=0; m<L; m++) {
+			row[first + 2*m] ^= accept[m];
+		}
+	}
+}
+
+
+
+/* Performs sweeps full checkerboard Metropolis sweeps of every replica */
+void replicas_sweep(Replicas *model, const int sweeps)
+{
+	for(int h=0; h<2*sweeps; h++) {
+		parallel_for(model->pool, model->num_tasks, sweep_rows, model);
+		model->half_sweeps++;
+	}
+}
+
+
+
+/*
+ * Transposes a 64 x 64 bit matrix across its antidiagonal: bit b of word w moves to
+ * bit 63-w of word 63-b (Hacker's Delight, section 7-3)
+ */
+static void transpose(uint64_t a[64])
+{
+	uint64_t mask = 0x00000000FFFFFFFFULL;
+	for(int j=32; j!=0; j>>=1, mask ^= mask << j) {
+		for(int k=0; k<64; k=(k+j+1) & ~j) {
+			uint64_t t = (a[k] ^ (a[k+j] >> j)) & mask;
+			a[k] ^= t;
+			a[k+j] ^= t << j;
+		}
+	}
+}
+
+
+
+/* Counts the up spins and anti-aligned bonds of every replica in one block of rows */
+static void measure_rows(void *arg, const int task)
+{
+	Replicas *model = arg;
+	const int D = model->D;
+	const size_t start = (size_t)(task*D/model->num_tasks)*D, end = (size_t)((task+1)*D/model->num_tasks)*D;
+	int64_t *up = &model->task_up[task*REPLICAS], *anti = &model->task_anti[task*REPLICAS];
+	uint64_t spins[64], right[64], down[64];
+	for(int r=0; r<REPLICAS; r++) {
+		up[r] = anti[r] = 0;
+	}
+	for(size_t s=start; s<end; s+=64) {
+		// Site s + t is a bit of every replica. The transposes turn it into bit 63 - t of a word per replica, padded with zeros.
+		for(int t=0; t<64; t++) {
+			spins[t] = right[t] = down[t] = 0;
+			if(s + t < end) {
+				size_t i = (s + t)/D, j = (s + t) % D;
+				uint64_t x = model->grid[s + t];
+				spins[t] = x;
+				right[t] = x ^ model->grid[i*D + (j + 1) % D];
+				down[t] = x ^ model->grid[(i + 1) % D*D + j];
+			}
+		}
+		transpose(spins);
+		transpose(right);
+		transpose(down);
+		for(int r=0; r<REPLICAS; r++) {
+			up[r] += __builtin_popcountll(spins[63-r]);
+			anti[r] += __builtin_popcountll(right[63-r]) + __builtin_popcountll(down[63-r]);
+		}
+	}
+}
+
+
+
+/* Counts the bond sum Σ<ij> sᵢsⱼ and magnetisation of every replica */
+void replicas_measure(Replicas *model, int64_t bonds[REPLICAS], int64_t M[REPLICAS])
+{
+	const int64_t N = (int64_t)model->D*model->D;
+	parallel_for(model->pool, model->num_tasks, measure_rows, model);
+	for(int r=0; r<REPLICAS; r++) {
+		int64_t up = 0, anti = 0;
+		for(int t=0; t<model->num_tasks; t++) {
+			up += model->task_up[t*REPLICAS + r];
+			anti += model->task_anti[t*REPLICAS + r];
+		}
+		// Each of the 2N bonds is +1 unless anti-aligned
+		bonds[r] = 2*N - 2*anti;
+		M[r] = 2*up - N;
+	}
+}
+
+
+
+/* Total energy of every replica */
+void replicas_energy(Replicas *model, double E[REPLICAS])
+{
+	int64_t bonds[REPLICAS], M[REPLICAS];
+	replicas_measure(model, bonds, M);
+	for(int r=0; r<REPLICAS; r++) {
+		E[r] = -model->J*bonds[r] - model->H*M[r];
+	}
+}
+
+
+
+/* Writes the spins of one replica as ±1 into a row major grid */
+void replicas_unpack(const Replicas *model, const int replica, int8_t *spins)
+{
+	for(size_t s=0; s<(size_t)model->D*model->D; s++) {
+		spins[s] = (int8_t)(2*(int)(model->grid[s] >> replica & 1) - 1);
+	}
+}
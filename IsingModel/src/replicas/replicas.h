@@ -0,0 +1,67 @@
+#ifndef _REPLICAS_H
+#define _REPLICAS_H
+
+#include <stdint.h> /* int8_t, int64_t, uint64_t */
+#include "../multispin/multispin.h" /* BitTables */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * REPLICAS independent Ising models at the same T, J and H, stored as one word per
+ * site with bit r holding the spin of replica r.
+ *
+ * A checkerboard half sweep updates a site in every replica at once with the bitwise
+ * neighbour count and threshold comparison of src/multispin/. The bits of each random
+ * word are independent, so the replicas follow independent Metropolis chains. Since
+ * a word holds a single site, the sites of a row are handled by the same vectorisable
+ * loops as the words of a multi-spin coded row, and any even side length works.
+ *
+ * The energy and magnetisation of the replicas are not tracked through the sweeps.
+ * replicas_measure transposes blocks of 64 sites so that each word holds 64 sites of
+ * one replica, and counts its up spins and anti-aligned bonds with popcounts.
+ */
+
+#define REPLICAS 64 /* Replicas per lattice, one per bit of a word */
+#define REPLICAS_PLANES 12 /* Random bit planes generated in bulk per site */
+
+typedef struct Replicas {
+	int D; /* Height and width of the square lattice. Must be even. */
+	double T; /* Temperature */
+	double J; /* Strength of pairwise interaction */
+	double H; /* Strength of external magnetic field */
+	uint64_t *grid; /* Spins of every replica at each site, row major */
+	uint64_t seed; /* Key of the random number generator */
+	uint64_t half_sweeps; /* Number of checkerboard half sweeps so far */
+	BitTables tables; /* Acceptance thresholds as masks */
+	ThreadPool *pool; /* Threads for the sweeps and measurements. Owned. */
+	int num_tasks; /* Number of blocks of rows a half sweep is split into */
+	int64_t *task_up, *task_anti; /* Up spins and anti-aligned bonds of each replica from each block of a measurement */
+} Replicas;
+
+/* Creates REPLICAS models, each in its own random initial state */
+Replicas *replicas_create(const int D, const double T, const double J, const double H, const uint64_t seed, const int num_threads);
+
+/* Frees the models */
+void replicas_destroy(Replicas *model);
+
+/* Sets the temperature of every replica to T */
+void replicas_set_T(Replicas *model, const double T);
+
+/* Sets the strength of pairwise interaction of every replica to J */
+void replicas_set_J(Replicas *model, const double J);
+
+/* Sets the strength of external magnetic field of every replica to H */
+void replicas_set_H(Replicas *model, const double H);
+
+/* Performs sweeps full checkerboard Metropolis sweeps of every replica */
+void replicas_sweep(Replicas *model, const int sweeps);
+
+/* Counts the bond sum Σ<ij> sᵢsⱼ and magnetisation of every replica */
+void replicas_measure(Replicas *model, int64_t bonds[REPLICAS], int64_t M[REPLICAS]);
+
+/* Total energy of every replica */
+void replicas_energy(Replicas *model, double E[REPLICAS]);
+
+/* Writes the spins of one replica as ±1 into a row major grid */
+void replicas_unpack(const Replicas *model, const int replica, int8_t *spins);
+
+#endif
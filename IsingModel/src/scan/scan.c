@@ -0,0 +1,181 @@
+#include "scan.h"
+#include <math.h> // fabs
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memcpy
+#include <time.h> // clock_gettime
+#include "../ising/ising.h" // ising_create, ising_sweep, ising_energy, ising_recount, ising_align, ising_destroy, ISING_TC_PER_J
+#include "../autocorr/autocorr.h" // integrated_autocorrelation
+
+
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+/* Creates a scan over every combination of the given values of T, H and J */
+Scan *scan_create(const int D, const double *T, const int num_T, const double *H, const int num_H, const double *J, const int num_J, const int equilibration, const int measurement, const uint64_t seed, const int num_threads)
+{
+	Scan *scan = calloc(1, sizeof(Scan));
+	scan->D = D;
+	scan->num_T = num_T;
+	scan->num_H = num_H;
+	scan->num_J = num_J;
+	scan->num_points = num_T*num_H*num_J;
+	scan->equilibration = equilibration;
+	scan->measurement = measurement;
+	scan->seed = seed;
+	scan->points = calloc(scan->num_points, sizeof(ScanPoint));
+	for(int k=0; k<scan->num_points; k++) {
+		scan->points[k].T = T[k % num_T];
+		scan->points[k].H = H[k/num_T % num_H];
+		scan->points[k].J = J[k/(num_T*num_H)];
+		scan->points[k].source = SCAN_RANDOM;
+	}
+	scan->lattices = malloc((size_t)scan->num_points*D*D);
+	scan->done = calloc(scan->num_points, 1);
+	pthread_mutex_init(&scan->mutex, NULL);
+	scan->pool = threadpool_create(num_threads);
+	return scan;
+}
+
+
+
+/* Frees the scan */
+void scan_destroy(Scan *scan)
+{
+	threadpool_destroy(scan->pool);
+	pthread_mutex_destroy(&scan->mutex);
+	free(scan->points);
+	free(scan->lattices);
+	free(scan->done);
+	free(scan);
+}
+
+
+
+/*
+ * Whether a point may start from the final lattice of another. Along a line of T the
+ * lattice is annealed. Across a change of H or J it is only reused when both points
+ * are above the critical temperature and neither H nor J changes sign, since below
+ * it the lattice keeps the magnetisation of the old field and stays metastable.
+ */
+static int can_warm_start(const ScanPoint *point, const ScanPoint *from)
+{
+	if(point->H == from->H && point->J == from->J) {
+		return 1;
+	}
+	return point->H*from->H >= 0 && point->J*from->J > 0
+		&& point->T >= ISING_TC_PER_J*fabs(point->J) && from->T >= ISING_TC_PER_J*fabs(from->J);
+}
+
+
+
+/* Nearest completed point in grid steps that the point may start from, or -1 if there is none.
+ * Ties go to a point with the same H and J, and then to the lowest index. */
+static int nearest_done(Scan *scan, const int k)
+{
+	const ScanPoint *point = &scan->points[k];
+	const int kT = k % scan->num_T, kH = k/scan->num_T % scan->num_H, kJ = k/(scan->num_T*scan->num_H);
+	int nearest = -1, best_line = 0;
+	long best = 0;
+	pthread_mutex_lock(&scan->mutex);
+	for(int i=0; i<scan->num_points; i++) {
+		const ScanPoint *from = &scan->points[i];
+		if(!scan->done[i] || !can_warm_start(point, from)) {
+			continue;
+		}
+		long dT = i % scan->num_T - kT, dH = i/scan->num_T % scan->num_H - kH, dJ = i/(scan->num_T*scan->num_H) - kJ;
+		long distance = dT*dT + dH*dH + dJ*dJ;
+		int line = dH == 0 && dJ == 0;
+		if(nearest < 0 || distance < best || (distance == best && line && !best_line)) {
+			nearest = i;
+			best = distance;
+			best_line = line;
+		}
+	}
+	pthread_mutex_unlock(&scan->mutex);
+	return nearest;
+}
+
+
+
+/* Equilibrates and measures one point */
+static void run_point(void *arg, const int k)
+{
+	Scan *scan = arg;
+	ScanPoint *point = &scan->points[k];
+	const int D = scan->D;
+	const double N = (double)D*D;
+	double start = now();
+
+	Ising *model = ising_create(D, point->T, point->J, point->H, scan->seed + k, 1);
+	point->source = nearest_done(scan, k);
+	if(point->source >= 0) {
+		// A completed lattice is never written again, so it can be read without the lock
+		memcpy(model->grid, &scan->lattices[(size_t)point->source*D*D], (size_t)D*D);
+		ising_recount(model);
+	} else if(point->J > 0 && point->T < ISING_TC_PER_J*point->J) {
+		// Random spins below the critical temperature coarsen slowly, so start ordered along the field
+		ising_align(model, point->H < 0 ? -1 : 1);
+		point->source = SCAN_ALIGNED;
+	}
+	ising_sweep(model, scan->equilibration);
+
+	double *E = malloc(scan->measurement*sizeof(double));
+	double *absM = malloc(scan->measurement*sizeof(double));
+	double sum_E = 0, sum_E2 = 0, sum_M = 0, sum_M2 = 0;
+	for(int i=0; i<scan->measurement; i++) {
+		ising_sweep(model, 1);
+		double e = ising_energy(model), m = model->M < 0 ? -model->M : model->M;
+		sum_E += e;
+		sum_E2 += e*e;
+		sum_M += m;
+		sum_M2 += m*m;
+		E[i] = e;
+		absM[i] = m;
+	}
+	const double n = scan->measurement;
+	point->E = sum_E/n/N;
+	point->C = (sum_E2/n - (sum_E/n)*(sum_E/n))/(point->T*point->T)/N;
+	point->absM = sum_M/n/N;
+	point->chi = (sum_M2/n - (sum_M/n)*(sum_M/n))/point->T/N;
+	point->tau_E = integrated_autocorrelation(E, scan->measurement, NULL);
+	point->tau_M = integrated_autocorrelation(absM, scan->measurement, NULL);
+	free(E);
+	free(absM);
+
+	memcpy(&scan->lattices[(size_t)k*D*D], model->grid, (size_t)D*D);
+	ising_destroy(model);
+	point->seconds = now() - start;
+	pthread_mutex_lock(&scan->mutex);
+	scan->done[k] = 1;
+	pthread_mutex_unlock(&scan->mutex);
+}
+
+
+
+/* Runs every point of the grid */
+void scan_run(Scan *scan)
+{
+	parallel_for_stealing(scan->pool, scan->num_points, run_point, scan);
+}
+
+
+
+/* Writes one line per point, with a column per parameter and observable */
+void scan_export(const Scan *scan, FILE *fp)
+{
+	fprintf(fp, "# D = %d, %d equilibration and %d measurement sweeps per point, seed %llu\n", scan->D, scan->equilibration, scan->measurement, (unsigned long long)scan->seed);
+	fprintf(fp, "T\tH\tJ\tE/N\tC/N\t|M|/N\tchi/N\ttau_E\ttau_|M|\tsource\tseconds\n");
+	for(int k=0; k<scan->num_points; k++) {
+		const ScanPoint *point = &scan->points[k];
+		fprintf(fp, "%f\t%f\t%f\t%f\t%f\t%f\t%f\t%.2f\t%.2f\t%d\t%.3f\n", point->T, point->H, point->J,
+			point->E, point->C, point->absM, point->chi, point->tau_E, point->tau_M, point->source, point->seconds);
+	}
+}
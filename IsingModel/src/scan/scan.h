@@ -0,0 +1,73 @@
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include <pthread.h> /* pthread_mutex_t */
+#include <stdint.h> /* int8_t, uint8_t, uint64_t */
+#include <stdio.h> /* FILE */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Equilibrium observables over a grid of temperatures, fields and interactions, such
+ * as the slider ranges of Animation.py.
+ *
+ * Every point of the grid is an independent run: a lattice of side D is swept with
+ * checkerboard sweeps for the equilibration budget, then measured after every sweep
+ * of the measurement budget. The points run on a pool with parallel_for_stealing, one
+ * lattice per thread. They are numbered with T varying fastest, then H, then J, so each
+ * thread mostly walks along lines of increasing T.
+ *
+ * A point starts from a copy of the final lattice of the nearest completed point,
+ * measured in grid steps, rather than from random spins. Along a line this anneals
+ * the lattice from the previous temperature, which shortens the equilibration near
+ * and below the critical temperature, so ties go to the points with the same H and J.
+ * Below the critical temperature a lattice keeps the magnetisation of its field, so
+ * a lattice is only reused across a change of H or J when both points are above it
+ * and neither H nor J changes sign. A point with no such completed point starts from
+ * spins aligned with the field if it is ferromagnetic and below the critical
+ * temperature, and from random spins otherwise. The final lattice of every point is
+ * kept, which takes D² bytes each.
+ *
+ * Point k is seeded with seed + k, but which point it warm starts from depends on the
+ * order in which the threads complete them, so the source of every point is recorded
+ * alongside its observables.
+ */
+
+#define SCAN_RANDOM -1 /* Source of a point started from random spins */
+#define SCAN_ALIGNED -2 /* Source of a point started from spins aligned with the field */
+
+/* Parameters and observables of one point of the grid */
+typedef struct ScanPoint {
+	double T, H, J; /* Parameters */
+	int source; /* Point whose lattice this one started from, or SCAN_RANDOM or SCAN_ALIGNED */
+	double E, C, absM, chi; /* E/N, C/N, |M|/N and χ/N averaged over the measurement sweeps */
+	double tau_E, tau_M; /* Integrated autocorrelation times of E and |M| in sweeps */
+	double seconds; /* Time spent on the point */
+} ScanPoint;
+
+typedef struct Scan {
+	int D; /* Side length of every lattice */
+	int num_T, num_H, num_J; /* Number of values of each parameter */
+	int num_points; /* num_T num_H num_J */
+	ScanPoint *points; /* Points, with T varying fastest and J slowest */
+	int equilibration; /* Sweeps before measuring each point */
+	int measurement; /* Sweeps measured at each point */
+	uint64_t seed; /* Seed of the first point */
+	int8_t *lattices; /* Final lattice of each completed point, D² spins each */
+	uint8_t *done; /* Whether each point is complete */
+	pthread_mutex_t mutex; /* Guards done */
+	ThreadPool *pool; /* Threads for the points. Owned. */
+} Scan;
+
+/* Creates a scan over every combination of the given values of T, H and J */
+Scan *scan_create(const int D, const double *T, const int num_T, const double *H, const int num_H, const double *J, const int num_J, const int equilibration, const int measurement, const uint64_t seed, const int num_threads);
+
+/* Frees the scan */
+void scan_destroy(Scan *scan);
+
+/* Runs every point of the grid */
+void scan_run(Scan *scan);
+
+/* Writes one line per point, with a column per parameter and observable */
+void scan_export(const Scan *scan, FILE *fp);
+
+#endif
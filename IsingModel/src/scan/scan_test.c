@@ -0,0 +1,76 @@
+#include "minunit.h"
+#include "scan.h"
+#include <math.h>
+
+#define D 32
+#define EQUILIBRATION 1000
+#define MEASUREMENT 2000
+#define SEED 7
+#define TOLERANCE 0.02 // Largest difference in E/N and |M|/N between a warm and a cold start
+
+static const double T[] = {1.2, 1.4, 1.6, 1.8};
+static const double H[] = {-0.1, 0.1};
+static const double J[] = {1.0};
+static Scan *scan = NULL;
+
+
+char *test_run()
+{
+    scan = scan_create(D, T, 4, H, 2, J, 1, EQUILIBRATION, MEASUREMENT, SEED, 1);
+    mu_assert(scan != NULL, "Failed to create scan.");
+    scan_run(scan);
+
+    return NULL;
+}
+
+
+char *test_sources()
+{
+    // Below the critical temperature a lattice must not be reused across a change of H
+    for(int k=0; k<scan->num_points; k++) {
+        int source = scan->points[k].source;
+        mu_assert(source == SCAN_ALIGNED || (source >= 0 && scan->points[source].H == scan->points[k].H),
+            "Point warm started across a change of H below the critical temperature.");
+    }
+
+    return NULL;
+}
+
+
+char *test_warm_matches_cold()
+{
+    for(int k=0; k<scan->num_points; k++) {
+        const ScanPoint *warm = &scan->points[k];
+        if(warm->source < 0) {
+            continue;
+        }
+        Scan *cold = scan_create(D, &warm->T, 1, &warm->H, 1, &warm->J, 1, EQUILIBRATION, MEASUREMENT, SEED + k, 1);
+        scan_run(cold);
+        double dE = fabs(cold->points[0].E - warm->E), dM = fabs(cold->points[0].absM - warm->absM);
+        scan_destroy(cold);
+        mu_assert(dE < TOLERANCE, "Warm started E/N differs from a cold start.");
+        mu_assert(dM < TOLERANCE, "Warm started |M|/N differs from a cold start.");
+    }
+
+    return NULL;
+}
+
+
+char *test_destroy()
+{
+    scan_destroy(scan);
+
+    return NULL;
+}
+
+char *all_tests() {
+    mu_suite_start();
+    mu_run_test(test_run);
+    mu_run_test(test_sources);
+    mu_run_test(test_warm_matches_cold);
+    mu_run_test(test_destroy);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,189 @@
+#include "tempering.h"
+#include <math.h> // exp, log, pow
+#include <stdlib.h> // malloc, calloc, free, exit
+#include "../random/philox.h" // philox_block, philox_uniform
+
+
+
+/* Creates R lattices of side D at temperatures spaced geometrically from T_min to T_max */
+Tempering *tempering_create(const int D, const int R, const double T_min, const double T_max, const double J, const double H, const int sweeps_per_round, const uint64_t seed, const int num_threads)
+{
+	if(R < 2 || !(0 < T_min && T_min < T_max)) {
+		fprintf(stderr, "Parallel tempering needs at least two temperatures with 0 < T_min < T_max.\n");
+		exit(1);
+	}
+	Tempering *pt = calloc(1, sizeof(Tempering));
+	pt->D = D;
+	pt->R = R;
+	pt->sweeps_per_round = sweeps_per_round;
+	pt->seed = seed;
+	pt->T = malloc(R*sizeof(double));
+	pt->models = malloc(R*sizeof(Ising *));
+	pt->model_at = malloc(R*sizeof(int));
+	pt->direction = calloc(R, sizeof(int));
+	pt->attempts = calloc(R, sizeof(long));
+	pt->accepts = calloc(R, sizeof(long));
+	pt->stats = calloc(R, sizeof(TemperatureStats));
+	for(int k=0; k<R; k++) {
+		pt->T[k] = T_min*pow(T_max/T_min, (double)k/(R-1));
+		// Each lattice is swept by a single thread, and the lattices share the pool
+		pt->models[k] = ising_create(D, pt->T[k], J, H, seed + k, 1);
+		pt->model_at[k] = k;
+	}
+	pt->pool = threadpool_create(num_threads);
+	return pt;
+}
+
+
+
+/* Frees the lattices */
+void tempering_destroy(Tempering *pt)
+{
+	threadpool_destroy(pt->pool);
+	for(int k=0; k<pt->R; k++) {
+		ising_destroy(pt->models[k]);
+	}
+	free(pt->T);
+	free(pt->models);
+	free(pt->model_at);
+	free(pt->direction);
+	free(pt->attempts);
+	free(pt->accepts);
+	free(pt->stats);
+	free(pt);
+}
+
+
+
+/* Clears the observables, swap counts and round trips */
+void tempering_reset(Tempering *pt)
+{
+	for(int k=0; k<pt->R; k++) {
+		pt->direction[k] = 0;
+		pt->attempts[k] = pt->accepts[k] = 0;
+		pt->stats[k] = (TemperatureStats){0, 0, 0, 0, 0};
+	}
+	pt->round_trips = 0;
+}
+
+
+
+/* Sweeps one lattice */
+static void sweep_model(void *arg, const int index)
+{
+	Tempering *pt = arg;
+	ising_sweep(pt->models[index], pt->sweeps_per_round);
+}
+
+
+
+/* Proposes swaps between the even or odd pairs of neighbouring temperatures */
+static void propose_swaps(Tempering *pt)
+{
+	for(int k=pt->rounds % 2; k+1<pt->R; k+=2) {
+		Ising *cold = pt->models[pt->model_at[k]];
+		Ising *hot = pt->models[pt->model_at[k+1]];
+		double delta = (1/pt->T[k] - 1/pt->T[k+1])*(ising_energy(cold) - ising_energy(hot));
+		uint32_t r[4];
+		philox_block(pt->seed, (uint32_t)pt->rounds, k, ising_stream(ISING_STREAM_TEMPERING, pt->rounds), 0, r);
+		pt->attempts[k]++;
+		if(delta >= 0 || philox_uniform(r[0]) < exp(delta)) {
+			pt->accepts[k]++;
+			int swap = pt->model_at[k];
+			pt->model_at[k] = pt->model_at[k+1];
+			pt->model_at[k+1] = swap;
+			ising_set_T(pt->models[pt->model_at[k]], pt->T[k]);
+			ising_set_T(pt->models[pt->model_at[k+1]], pt->T[k+1]);
+		}
+	}
+
+	// A round trip ends when a lattice returns to the bottom of the ladder after reaching the top
+	int bottom = pt->model_at[0], top = pt->model_at[pt->R-1];
+	if(pt->direction[bottom] == -1) {
+		pt->round_trips++;
+	}
+	pt->direction[bottom] = 1;
+	if(pt->direction[top] == 1) {
+		pt->direction[top] = -1;
+	}
+}
+
+
+
+/* One round of sweeps and swaps, followed by the measurements */
+static void round_step(Tempering *pt)
+{
+	parallel_for(pt->pool, pt->R, sweep_model, pt);
+	propose_swaps(pt);
+	pt->rounds++;
+	for(int k=0; k<pt->R; k++) {
+		const Ising *model = pt->models[pt->model_at[k]];
+		double E = ising_energy(model), M = (double)model->M;
+		TemperatureStats *stats = &pt->stats[k];
+		stats->samples++;
+		stats->E += E;
+		stats->E2 += E*E;
+		stats->absM += fabs(M);
+		stats->M2 += M*M;
+	}
+}
+
+
+
+/* Runs rounds of sweeps and swaps, measuring the observables at every temperature */
+void tempering_run(Tempering *pt, const long rounds)
+{
+	for(long n=0; n<rounds; n++) {
+		round_step(pt);
+	}
+}
+
+
+
+/* Runs rounds of sweeps and swaps, moving the inner temperatures after every window of rounds. Clears the statistics. */
+void tempering_adapt(Tempering *pt, const long rounds, const int window)
+{
+	const int R = pt->R;
+	double gap[R-1];
+	for(long n=0; n<rounds; n+=window) {
+		tempering_reset(pt);
+		tempering_run(pt, window);
+
+		// Scale each gap in β by exp(aₖ - ā), then restore the span of the ladder
+		double mean_rate = 0;
+		for(int k=0; k+1<R; k++) {
+			mean_rate += pt->attempts[k] > 0 ? (double)pt->accepts[k]/pt->attempts[k]/(R-1) : 0;
+		}
+		double span = 1/pt->T[0] - 1/pt->T[R-1], total = 0;
+		for(int k=0; k+1<R; k++) {
+			double rate = pt->attempts[k] > 0 ? (double)pt->accepts[k]/pt->attempts[k] : mean_rate;
+			gap[k] = (1/pt->T[k] - 1/pt->T[k+1])*exp(rate - mean_rate);
+			total += gap[k];
+		}
+		double beta = 1/pt->T[0];
+		for(int k=1; k+1<R; k++) {
+			beta -= gap[k-1]*span/total;
+			pt->T[k] = 1/beta;
+			ising_set_T(pt->models[pt->model_at[k]], pt->T[k]);
+		}
+	}
+	tempering_reset(pt);
+}
+
+
+
+/* Writes T, E/N, C/N, |M|/N, χ/N and the swap rate to the next temperature, one line per temperature */
+void tempering_export(const Tempering *pt, FILE *fp)
+{
+	const double N = (double)pt->D*pt->D;
+	fprintf(fp, "# T\tE/N\tC/N\t|M|/N\tchi/N\tswap_rate\n");
+	for(int k=0; k<pt->R; k++) {
+		const TemperatureStats *stats = &pt->stats[k];
+		double n = stats->samples > 0 ? stats->samples : 1;
+		double E = stats->E/n, absM = stats->absM/n;
+		double C = (stats->E2/n - E*E)/(pt->T[k]*pt->T[k]);
+		double chi = (stats->M2/n - absM*absM)/pt->T[k];
+		double rate = k+1 < pt->R && pt->attempts[k] > 0 ? (double)pt->accepts[k]/pt->attempts[k] : 0;
+		fprintf(fp, "%f\t%f\t%f\t%f\t%f\t%f\n", pt->T[k], E/N, C/N, absM/N, chi/N, rate);
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef _TEMPERING_H
+#define _TEMPERING_H
+
+#include <stdint.h> /* uint64_t */
+#include <stdio.h> /* FILE */
+#include "../ising/ising.h" /* Ising */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Parallel tempering (replica exchange) over a ladder of R temperatures.
+ *
+ * One lattice sits at each temperature of the ladder. A round sweeps every lattice on
+ * its own thread of the pool and then proposes swaps between neighbouring temperatures,
+ * alternating between the even and the odd pairs. A swap between inverse temperatures
+ * βₖ > βₖ₊₁ is accepted with probability min(1, exp((βₖ - βₖ₊₁)(Eₖ - Eₖ₊₁))), using the
+ * tracked energies. A swap exchanges the temperatures of the two lattices rather than
+ * their spins.
+ *
+ * tempering_adapt moves the inner temperatures towards equal swap rates between all
+ * neighbours. After every window of rounds, each gap in β is scaled by exp(aₖ - ā),
+ * where aₖ is the swap rate across it and ā is the mean rate. The gaps are then
+ * rescaled so that the ends of the ladder stay fixed.
+ *
+ * Lattice k is seeded with seed + k, and the swaps draw from their own stream, so a
+ * run gives the same result for any number of threads.
+ */
+
+/* Sums of the observables measured at one temperature */
+typedef struct TemperatureStats {
+	long samples; /* Number of rounds measured */
+	double E, E2; /* Σ E and Σ E² */
+	double absM, M2; /* Σ |M| and Σ M² */
+} TemperatureStats;
+
+typedef struct Tempering {
+	int D; /* Side length of every lattice */
+	int R; /* Number of temperatures */
+	double *T; /* Ladder of temperatures, in increasing order */
+	Ising **models; /* The R lattices */
+	int *model_at; /* Lattice at each temperature of the ladder */
+	int *direction; /* +1 for a lattice that has visited the lowest temperature since the highest, -1 for the reverse, 0 for neither */
+	long round_trips; /* Number of trips from the lowest temperature to the highest and back */
+	long *attempts, *accepts; /* Swaps proposed and accepted between temperatures k and k+1 */
+	TemperatureStats *stats; /* Observables at each temperature of the ladder */
+	int sweeps_per_round; /* Sweeps of every lattice between swaps */
+	uint64_t seed; /* Key of the random numbers of the swaps */
+	uint64_t rounds; /* Number of rounds so far */
+	ThreadPool *pool; /* Threads for the lattices. Owned. */
+} Tempering;
+
+/* Creates R lattices of side D at temperatures spaced geometrically from T_min to T_max */
+Tempering *tempering_create(const int D, const int R, const double T_min, const double T_max, const double J, const double H, const int sweeps_per_round, const uint64_t seed, const int num_threads);
+
+/* Frees the lattices */
+void tempering_destroy(Tempering *pt);
+
+/* Runs rounds of sweeps and swaps, measuring the observables at every temperature */
+void tempering_run(Tempering *pt, const long rounds);
+
+/* Runs rounds of sweeps and swaps, moving the inner temperatures after every window of rounds. Clears the statistics. */
+void tempering_adapt(Tempering *pt, const long rounds, const int window);
+
+/* Clears the observables, swap counts and round trips */
+void tempering_reset(Tempering *pt);
+
+/* Writes T, E/N, C/N, |M|/N, χ/N and the swap rate to the next temperature, one line per temperature */
+void tempering_export(const Tempering *pt, FILE *fp);
+
+#endif
@@ -0,0 +1,181 @@
+#include "threadpool.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // calloc, free, exit
+
+
+
+/* Runs one task with the mutex released. Called and returns with the mutex held. */
+static void run_task(ThreadPool *pool, const int index)
+{
+	pthread_mutex_unlock(&pool->mutex);
+	pool->task(pool->arg, index);
+	pthread_mutex_lock(&pool->mutex);
+	if(--pool->remaining == 0) {
+		pthread_cond_broadcast(&pool->work_done);
+	}
+}
+
+
+
+/* Runs the joining thread's range of a stealing loop, then steals from the others until none are left to hand out. Called and returns with the mutex held. */
+static void run_stealing(ThreadPool *pool)
+{
+	const int t = pool->joined++;
+	while(1) {
+		if(pool->lo[t] == pool->hi[t]) {
+			int victim = -1, most = 0;
+			for(int v=0; v<pool->num_threads; v++) {
+				if(pool->hi[v] - pool->lo[v] > most) {
+					most = pool->hi[v] - pool->lo[v];
+					victim = v;
+				}
+			}
+			if(victim < 0) {
+				return;
+			}
+			pool->lo[t] = pool->hi[victim] - (most + 1)/2;
+			pool->hi[t] = pool->hi[victim];
+			pool->hi[victim] = pool->lo[t];
+		}
+		pool->next++;
+		run_task(pool, pool->lo[t]++);
+	}
+}
+
+
+
+/* Runs tasks until none are left to hand out. Called and returns with the mutex held. */
+static void run_tasks(ThreadPool *pool)
+{
+	if(pool->stealing) {
+		run_stealing(pool);
+		return;
+	}
+	while(pool->next < pool->n) {
+		run_task(pool, pool->next++);
+	}
+}
+
+
+
+/* Waits for loops to start and helps to run them */
+static void *worker(void *arg)
+{
+	ThreadPool *pool = arg;
+	pthread_mutex_lock(&pool->mutex);
+	while(1) {
+		while(!pool->shutdown && pool->next >= pool->n) {
+			pthread_cond_wait(&pool->work_ready, &pool->mutex);
+		}
+		if(pool->shutdown) {
+			break;
+		}
+		run_tasks(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+
+
+/* Starts a pool with num_threads threads in total. Values below one mean one. */
+ThreadPool *threadpool_create(const int num_threads)
+{
+	ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+	pool->num_threads = num_threads > 1 ? num_threads : 1;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_ready, NULL);
+	pthread_cond_init(&pool->work_done, NULL);
+	pool->workers = calloc(pool->num_threads, sizeof(pthread_t));
+	pool->lo = calloc(pool->num_threads, sizeof(int));
+	pool->hi = calloc(pool->num_threads, sizeof(int));
+	for(int t=0; t<pool->num_threads-1; t++) {
+		if(pthread_create(&pool->workers[t], NULL, worker, pool) != 0) {
+			fprintf(stderr, "Could not start worker thread %d.\n", t);
+			exit(1);
+		}
+	}
+	return pool;
+}
+
+
+
+/* Stops the workers and frees the pool */
+void threadpool_destroy(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->mutex);
+	for(int t=0; t<pool->num_threads-1; t++) {
+		pthread_join(pool->workers[t], NULL);
+	}
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work_ready);
+	pthread_cond_destroy(&pool->work_done);
+	free(pool->workers);
+	free(pool->lo);
+	free(pool->hi);
+	free(pool);
+}
+
+
+
+/* Calls task(arg, i) for i = 0,...,n-1 across the pool and returns once every call has finished */
+void parallel_for(ThreadPool *pool, const int n, void (*task)(void *arg, const int index), void *arg)
+{
+	if(pool->num_threads == 1 || n == 1) {
+		for(int i=0; i<n; i++) {
+			task(arg, i);
+		}
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	pool->task = task;
+	pool->arg = arg;
+	pool->n = n;
+	pool->next = 0;
+	pool->remaining = n;
+	pthread_cond_broadcast(&pool->work_ready);
+	run_tasks(pool);
+	while(pool->remaining > 0) {
+		pthread_cond_wait(&pool->work_done, &pool->mutex);
+	}
+	pool->n = 0;
+	pool->next = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+
+
+/* As parallel_for, but with a contiguous range of indices per thread and work stealing between them */
+void parallel_for_stealing(ThreadPool *pool, const int n, void (*task)(void *arg, const int index), void *arg)
+{
+	if(pool->num_threads == 1 || n == 1) {
+		for(int i=0; i<n; i++) {
+			task(arg, i);
+		}
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	pool->task = task;
+	pool->arg = arg;
+	pool->n = n;
+	pool->next = 0;
+	pool->remaining = n;
+	pool->stealing = 1;
+	pool->joined = 0;
+	for(int t=0; t<pool->num_threads; t++) {
+		pool->lo[t] = (int)((long)n*t/pool->num_threads);
+		pool->hi[t] = (int)((long)n*(t+1)/pool->num_threads);
+	}
+	pthread_cond_broadcast(&pool->work_ready);
+	run_tasks(pool);
+	while(pool->remaining > 0) {
+		pthread_cond_wait(&pool->work_done, &pool->mutex);
+	}
+	pool->n = 0;
+	pool->next = 0;
+	pool->stealing = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,48 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <pthread.h> /* pthread_t, pthread_mutex_t, pthread_cond_t */
+
+/*
+ * Fixed set of worker threads for data-parallel loops.
+ *
+ * parallel_for hands out the indices 0,...,n-1 one at a time, so each task should be
+ * a sizeable piece of work (a particle, a block of points). The calling thread works
+ * on the loop too, and a pool created with one thread runs everything inline.
+ *
+ * parallel_for_stealing instead starts every thread on its own contiguous range of
+ * indices, which it runs in increasing order. A thread that runs out steals the back
+ * half of the largest range left. Neighbouring indices thus mostly run one after the
+ * other on the same thread, which suits tasks that reuse the results of the previous
+ * index, while the stealing still balances tasks of uneven length.
+ */
+typedef struct ThreadPool {
+	int num_threads; /* Number of threads including the caller */
+	pthread_t *workers; /* The num_threads - 1 worker threads */
+	pthread_mutex_t mutex; /* Guards every field below */
+	pthread_cond_t work_ready; /* Signalled when a loop starts or the pool shuts down */
+	pthread_cond_t work_done; /* Signalled when the last task of a loop finishes */
+	void (*task)(void *arg, const int index); /* Body of the current loop */
+	void *arg; /* Argument passed to every task */
+	int n; /* Number of tasks in the current loop */
+	int next; /* Next index to hand out */
+	int remaining; /* Number of tasks not yet finished */
+	int shutdown; /* Nonzero once the workers should exit */
+	int stealing; /* Nonzero while the current loop is run by parallel_for_stealing */
+	int joined; /* Number of threads that have joined the current stealing loop */
+	int *lo, *hi; /* Indices lo[t],...,hi[t]-1 are still to be run by thread t of a stealing loop */
+} ThreadPool;
+
+/* Starts a pool with num_threads threads in total. Values below one mean one. */
+ThreadPool *threadpool_create(const int num_threads);
+
+/* Stops the workers and frees the pool */
+void threadpool_destroy(ThreadPool *pool);
+
+/* Calls task(arg, i) for i = 0,...,n-1 across the pool and returns once every call has finished */
+void parallel_for(ThreadPool *pool, const int n, void (*task)(void *arg, const int index), void *arg);
+
+/* As parallel_for, but with a contiguous range of indices per thread and work stealing between them */
+void parallel_for_stealing(ThreadPool *pool, const int n, void (*task)(void *arg, const int index), void *arg);
+
+#endif
@@ -0,0 +1,250 @@
+#include "wham.h"
+#include <math.h> // log, exp, fabs, INFINITY
+#include <stdio.h> // fprintf
+#include <stdlib.h> // malloc, calloc, free, qsort, exit
+
+#define BLOCK_STATES 4096 // States per task of an iteration
+
+
+
+/* Adds v to the log sum held as exp(max)·sum, keeping the sum shifted by its largest term */
+static inline void log_accumulate(double *max, double *sum, const double v)
+{
+	if(v <= *max) {
+		*sum += exp(v - *max);
+	} else {
+		*sum = *sum*exp(*max - v) + 1;
+		*max = v;
+	}
+}
+
+
+
+/* State of the pooled histograms, ordered by bond sum and then magnetisation */
+typedef struct State {
+	int64_t bonds, M;
+	long count;
+} State;
+
+static int compare_states(const void *a, const void *b)
+{
+	const State *x = a, *y = b;
+	if(x->bonds != y->bonds) {
+		return x->bonds < y->bonds ? -1 : 1;
+	}
+	return (x->M > y->M) - (x->M < y->M);
+}
+
+
+
+/* Pools the histograms of num_runs runs. Exits if they differ in D, J or H. */
+Wham *wham_create(Histogram **runs, const int num_runs, const int num_threads)
+{
+	Wham *wham = calloc(1, sizeof(Wham));
+	wham->D = runs[0]->D;
+	wham->J = runs[0]->J;
+	wham->H = runs[0]->H;
+	wham->num_runs = num_runs;
+	wham->beta = malloc(num_runs*sizeof(double));
+	wham->log_samples = malloc(num_runs*sizeof(double));
+	wham->f = calloc(num_runs, sizeof(double));
+	long total = 0;
+	for(int k=0; k<num_runs; k++) {
+		if(runs[k]->D != wham->D || runs[k]->J != wham->J || runs[k]->H != wham->H || runs[k]->samples == 0) {
+			fprintf(stderr, "Run %d at D = %d, J = %g, H = %g with %ld samples cannot be pooled with D = %d, J = %g, H = %g\n",
+				k, runs[k]->D, runs[k]->J, runs[k]->H, runs[k]->samples, wham->D, wham->J, wham->H);
+			exit(1);
+		}
+		wham->beta[k] = 1/runs[k]->T;
+		wham->log_samples[k] = log((double)runs[k]->samples);
+		total += runs[k]->size;
+	}
+
+	// Merge the entries of every run, adding the counts of repeated states
+	State *states = malloc(total*sizeof(State));
+	long n = 0;
+	for(int k=0; k<num_runs; k++) {
+		for(size_t i=0; i<runs[k]->capacity; i++) {
+			if(histogram_entry(runs[k], i, &states[n].bonds, &states[n].M, &states[n].count)) {
+				n++;
+			}
+		}
+	}
+	qsort(states, n, sizeof(State), compare_states);
+	long num_states = 0;
+	for(long i=0; i<n; i++) {
+		if(num_states > 0 && compare_states(&states[num_states-1], &states[i]) == 0) {
+			states[num_states-1].count += states[i].count;
+		} else {
+			states[num_states++] = states[i];
+		}
+	}
+	wham->num_states = num_states;
+	wham->bonds = malloc(num_states*sizeof(int64_t));
+	wham->M = malloc(num_states*sizeof(int64_t));
+	wham->E = malloc(num_states*sizeof(double));
+	wham->log_count = malloc(num_states*sizeof(double));
+	wham->log_g = malloc(num_states*sizeof(double));
+	for(long i=0; i<num_states; i++) {
+		wham->bonds[i] = states[i].bonds;
+		wham->M[i] = states[i].M;
+		wham->E[i] = -wham->J*states[i].bonds - wham->H*states[i].M;
+		wham->log_count[i] = log((double)states[i].count);
+	}
+	free(states);
+
+	wham->num_blocks = (int)((num_states + BLOCK_STATES - 1)/BLOCK_STATES);
+	wham->partial_max = malloc(wham->num_blocks*num_runs*sizeof(double));
+	wham->partial_sum = malloc(wham->num_blocks*num_runs*sizeof(double));
+	wham->pool = threadpool_create(num_threads);
+	return wham;
+}
+
+
+
+/* Frees the solver */
+void wham_destroy(Wham *wham)
+{
+	threadpool_destroy(wham->pool);
+	free(wham->beta);
+	free(wham->log_samples);
+	free(wham->f);
+	free(wham->bonds);
+	free(wham->M);
+	free(wham->E);
+	free(wham->log_count);
+	free(wham->log_g);
+	free(wham->partial_max);
+	free(wham->partial_sum);
+	free(wham);
+}
+
+
+
+/* Updates log g over one block of states from the current fₖ, and the block's share of the next fₖ */
+static void iterate_block(void *arg, const int block)
+{
+	Wham *wham = arg;
+	const int K = wham->num_runs;
+	const long start = (long)block*BLOCK_STATES;
+	const long end = start + BLOCK_STATES < wham->num_states ? start + BLOCK_STATES : wham->num_states;
+	double *max = &wham->partial_max[block*K];
+	double *sum = &wham->partial_sum[block*K];
+	for(int k=0; k<K; k++) {
+		max[k] = -INFINITY;
+		sum[k] = 0;
+	}
+	double terms[K];
+	for(long i=start; i<end; i++) {
+		// log Σₖ Nₖ exp(fₖ - βₖE), shifted by its largest term
+		double largest = -INFINITY;
+		for(int k=0; k<K; k++) {
+			terms[k] = wham->log_samples[k] + wham->f[k] - wham->beta[k]*wham->E[i];
+			if(terms[k] > largest) {
+				largest = terms[k];
+			}
+		}
+		double denominator = 0;
+		for(int k=0; k<K; k++) {
+			denominator += exp(terms[k] - largest);
+		}
+		wham->log_g[i] = wham->log_count[i] - largest - log(denominator);
+		for(int k=0; k<K; k++) {
+			log_accumulate(&max[k], &sum[k], wham->log_g[i] - wham->beta[k]*wham->E[i]);
+		}
+	}
+}
+
+
+
+/* Iterates the free energies until none moves by more than tolerance. Returns the number of iterations. */
+int wham_solve(Wham *wham, const double tolerance, const int max_iterations)
+{
+	const int K = wham->num_runs;
+	int iteration = 0;
+	double change = INFINITY;
+	while(change > tolerance && iteration < max_iterations) {
+		parallel_for(wham->pool, wham->num_blocks, iterate_block, wham);
+		double f[K];
+		for(int k=0; k<K; k++) {
+			double max = -INFINITY, sum = 0;
+			for(int b=0; b<wham->num_blocks; b++) {
+				double block_max = wham->partial_max[b*K + k];
+				if(block_max == -INFINITY) {
+					continue;
+				}
+				if(block_max <= max) {
+					sum += wham->partial_sum[b*K + k]*exp(block_max - max);
+				} else {
+					sum = sum*exp(max - block_max) + wham->partial_sum[b*K + k];
+					max = block_max;
+				}
+			}
+			f[k] = -(max + log(sum));
+		}
+		// Only differences between the fₖ matter, so f₀ is held at zero
+		const double f0 = f[0];
+		change = 0;
+		for(int k=0; k<K; k++) {
+			f[k] -= f0;
+			if(fabs(f[k] - wham->f[k]) > change) {
+				change = fabs(f[k] - wham->f[k]);
+			}
+			wham->f[k] = f[k];
+		}
+		iteration++;
+	}
+	// log g from the final free energies
+	parallel_for(wham->pool, wham->num_blocks, iterate_block, wham);
+	return iteration;
+}
+
+
+
+/* Temperatures and results of wham_observables */
+typedef struct Curve {
+	Wham *wham;
+	const double *T;
+	double *E, *C, *absM, *chi;
+} Curve;
+
+/* Reweights the observables to one temperature */
+static void reweight(void *arg, const int index)
+{
+	Curve *curve = arg;
+	const Wham *wham = curve->wham;
+	const double beta = 1/curve->T[index];
+	double largest = -INFINITY;
+	for(long i=0; i<wham->num_states; i++) {
+		if(wham->log_g[i] - beta*wham->E[i] > largest) {
+			largest = wham->log_g[i] - beta*wham->E[i];
+		}
+	}
+	// Moments of E and |M| under the weights g(x) exp(-βE(x)), shifted by the largest
+	double Z = 0, E = 0, E2 = 0, absM = 0, M2 = 0;
+	for(long i=0; i<wham->num_states; i++) {
+		double w = exp(wham->log_g[i] - beta*wham->E[i] - largest);
+		double m = (double)(wham->M[i] < 0 ? -wham->M[i] : wham->M[i]);
+		Z += w;
+		E += w*wham->E[i];
+		E2 += w*wham->E[i]*wham->E[i];
+		absM += w*m;
+		M2 += w*m*m;
+	}
+	const double N = (double)wham->D*wham->D;
+	E /= Z;
+	absM /= Z;
+	curve->E[index] = E/N;
+	curve->C[index] = (E2/Z - E*E)*beta*beta/N;
+	curve->absM[index] = absM/N;
+	curve->chi[index] = (M2/Z - absM*absM)*beta/N;
+}
+
+
+
+/* Reweighted E/N, C/N, |M|/N and χ/N at each of the num_T temperatures, computed in parallel */
+void wham_observables(Wham *wham, const double *T, const int num_T, double *E, double *C, double *absM, double *chi)
+{
+	Curve curve = {wham, T, E, C, absM, chi};
+	parallel_for(wham->pool, num_T, reweight, &curve);
+}
@@ -0,0 +1,60 @@
+#ifndef _WHAM_H
+#define _WHAM_H
+
+#include <stdint.h> /* int64_t */
+#include "../histogram/histogram.h" /* Histogram */
+#include "../threadpool/threadpool.h" /* ThreadPool */
+
+/*
+ * Multiple histogram reweighting (Ferrenberg and Swendsen 1989, WHAM) of runs at
+ * several temperatures with the same D, J and H.
+ *
+ * The runs are pooled into the number of samples n(x) of every state x = (bonds, M)
+ * seen by any of them. Run k drew Nₖ samples at inverse temperature βₖ, and its free
+ * energy fₖ solves the self-consistent equations
+ *
+ *     g(x) = n(x) / Σₖ Nₖ exp(fₖ - βₖE(x)),        exp(-fₖ) = Σₓ g(x) exp(-βₖE(x)),
+ *
+ * where g is the density of states. wham_solve iterates them from fₖ = 0 until no fₖ
+ * moves by more than the tolerance, fixing f₀ = 0. Every sum is taken in log space,
+ * shifted by its largest term, since the terms span hundreds of orders of magnitude.
+ *
+ * An iteration splits the states into blocks on the pool. Each block updates log g
+ * from the previous fₖ and keeps a partial log sum for every run, and the partial
+ * sums are then combined in block order, so the result does not depend on the number
+ * of threads.
+ *
+ * Once solved, the observables at any temperature follow from log g. They are only
+ * reliable between the temperatures of the runs, where the histograms overlap.
+ */
+
+typedef struct Wham {
+	int D; /* Side length of the lattice */
+	double J, H; /* Parameters shared by the runs */
+	int num_runs; /* Number of runs */
+	double *beta; /* Inverse temperature of each run */
+	double *log_samples; /* log Nₖ of each run */
+	double *f; /* Free energy of each run */
+	long num_states; /* Number of distinct states seen */
+	int64_t *bonds, *M; /* Bond sum and magnetisation of each state */
+	double *E; /* Energy of each state */
+	double *log_count; /* log n(x) of each state */
+	double *log_g; /* Log density of states, up to a constant */
+	int num_blocks; /* Number of blocks of states */
+	double *partial_max, *partial_sum; /* Shift and shifted sum of the log sum of each block and run */
+	ThreadPool *pool; /* Threads for the blocks. Owned. */
+} Wham;
+
+/* Pools the histograms of num_runs runs. Exits if they differ in D, J or H. */
+Wham *wham_create(Histogram **runs, const int num_runs, const int num_threads);
+
+/* Frees the solver */
+void wham_destroy(Wham *wham);
+
+/* Iterates the free energies until none moves by more than tolerance. Returns the number of iterations. */
+int wham_solve(Wham *wham, const double tolerance, const int max_iterations);
+
+/* Reweighted E/N, C/N, |M|/N and χ/N at each of the num_T temperatures, computed in parallel */
+void wham_observables(Wham *wham, const double *T, const int num_T, double *E, double *C, double *absM, double *chi);
+
+#endif
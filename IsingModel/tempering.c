@@ -0,0 +1,45 @@
+#include "src/tempering/tempering.h" // tempering_create, tempering_adapt, tempering_run, tempering_export, tempering_destroy
+#include <stdio.h> // printf, fprintf, stdout
+#include <stdlib.h> // atoi, atof, atol, exit
+#include <time.h> // time, clock_gettime
+
+#define THREADS 4 // Number of lattices swept at once
+#define SWEEPS_PER_ROUND 1 // Sweeps of every lattice between swap proposals
+#define ADAPT_FRACTION 0.2 // Fraction of the rounds spent adapting the ladder, before the measurements
+#define ADAPT_WINDOW 100 // Rounds between moves of the ladder
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 8) {
+		fprintf(stderr, "Usage: %s D R T_min T_max J H rounds\n", argv[0]);
+		exit(1);
+	}
+	const int D = atoi(argv[1]); // Side length of every lattice
+	const int R = atoi(argv[2]); // Number of temperatures
+	const double T_min = atof(argv[3]);
+	const double T_max = atof(argv[4]);
+	const double J = atof(argv[5]); // Strength of pairwise interaction
+	const double H = atof(argv[6]); // Strength of external magnetic field
+	const long rounds = atol(argv[7]);
+	const long adapt_rounds = (long)(ADAPT_FRACTION*rounds);
+
+	Tempering *pt = tempering_create(D, R, T_min, T_max, J, H, SWEEPS_PER_ROUND, (uint64_t)time(NULL), THREADS);
+	double start = now();
+	tempering_adapt(pt, adapt_rounds, ADAPT_WINDOW);
+	tempering_run(pt, rounds - adapt_rounds);
+	double seconds = now() - start;
+	printf("%ld rounds of %d lattices of %d x %d on %d threads in %.3f s, %ld round trips after adapting\n", rounds, R, D, D, THREADS, seconds, pt->round_trips);
+	tempering_export(pt, stdout);
+	tempering_destroy(pt);
+	return 0;
+}
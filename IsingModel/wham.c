@@ -0,0 +1,76 @@
+#include "src/histogram/histogram.h" // histogram_read, histogram_destroy
+#include "src/wham/wham.h" // wham_create, wham_solve, wham_observables, wham_destroy
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // atoi, atof, malloc, free, exit
+#include <time.h> // clock_gettime
+
+#define THREADS 4 // Number of threads iterating the free energies
+#define TOLERANCE 1e-10 // Largest change of any free energy at convergence
+#define MAX_ITERATIONS 100000 // Iterations allowed before giving up on convergence
+
+/* Wall clock time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	if(argc < 5) {
+		fprintf(stderr, "Usage: %s T_min T_max points histogram...\n", argv[0]);
+		exit(1);
+	}
+	const double T_min = atof(argv[1]);
+	const double T_max = atof(argv[2]);
+	const int points = atoi(argv[3]); // Temperatures to reweight to, evenly spaced
+	const int num_runs = argc - 4;
+	if(points < 1 || T_min <= 0 || T_max < T_min) {
+		fprintf(stderr, "Invalid temperatures %g to %g at %d points\n", T_min, T_max, points);
+		exit(1);
+	}
+
+	Histogram **runs = malloc(num_runs*sizeof(Histogram *));
+	for(int k=0; k<num_runs; k++) {
+		runs[k] = histogram_read(argv[4+k]);
+	}
+	double start = now();
+	Wham *wham = wham_create(runs, num_runs, THREADS);
+	int iterations = wham_solve(wham, TOLERANCE, MAX_ITERATIONS);
+	double seconds = now() - start;
+	printf("# %d runs, %ld states, %d iterations in %.3f s on %d threads%s\n", num_runs, wham->num_states, iterations, seconds, THREADS,
+		iterations == MAX_ITERATIONS ? " (not converged)" : "");
+	printf("# T_run\tsamples\tf\n");
+	for(int k=0; k<num_runs; k++) {
+		printf("# %f\t%ld\t%f\n", runs[k]->T, runs[k]->samples, wham->f[k]);
+	}
+
+	double *T = malloc(points*sizeof(double));
+	double *E = malloc(points*sizeof(double));
+	double *C = malloc(points*sizeof(double));
+	double *absM = malloc(points*sizeof(double));
+	double *chi = malloc(points*sizeof(double));
+	for(int i=0; i<points; i++) {
+		T[i] = points > 1 ? T_min + (T_max - T_min)*i/(points - 1) : T_min;
+	}
+	wham_observables(wham, T, points, E, C, absM, chi);
+	printf("T\tE/N\tC/N\t|M|/N\tchi/N\n");
+	for(int i=0; i<points; i++) {
+		printf("%f\t%f\t%f\t%f\t%f\n", T[i], E[i], C[i], absM[i], chi[i]);
+	}
+
+	free(T);
+	free(E);
+	free(C);
+	free(absM);
+	free(chi);
+	wham_destroy(wham);
+	for(int k=0; k<num_runs; k++) {
+		histogram_destroy(runs[k]);
+	}
+	free(runs);
+	return 0;
+}